@@ -26,10 +26,17 @@
 #import "LBBaseMultiDelegateSingleton.h"
 #import "LBBaseSingleton.h"
 #import "LBCLLocationManagerProxy.h"
+#import "LBFormURLEncodedBodyStream.h"
 #import "LBGlobalFullScreenSpinner.h"
 #import "LBNetworkStatusSpinnerManager.h"
+#import "LBOAuth1Signer.h"
+#import "LBQueryParameters.h"
+#import "LBSingletonLaunchProfiler.h"
 #import "LBSingletonResetManager.h"
 #import "LBStyledActivityIndicator.h"
+#import "LBTextMeasurementCache.h"
+#import "LBThumbnailService.h"
 #import "LBTimer.h"
 #import "LBUtils.h"
+#import "LBWeakKeyTable.h"
 #import "LBZeroingWeakContainer.h"
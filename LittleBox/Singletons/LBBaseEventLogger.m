@@ -365,7 +365,9 @@ LB_DECLARE_SHARED_INSTANCE_M(LBBaseEventLogger)
 }
 
 - (void)startNewSession {
-    self.sessionId = [LBUtils generateGUID];
+    // time ordered, so a backend indexing events by session sees new
+    // sessions arrive in order.
+    self.sessionId = [LBUtils generateTimeOrderedGUID];
     [self logVerbose:@"generated new session id (%@)", self.sessionId];
     self.sessionActive = YES;
     self.counter = 0;
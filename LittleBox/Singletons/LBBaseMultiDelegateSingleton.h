@@ -18,6 +18,7 @@
 
 #import "LBBaseSingleton.h"
 #import "LBLog.h"
+#import "LBWeakKeyTable.h"
 #import "LBZeroingWeakContainer.h"
 
 /*
@@ -105,7 +106,10 @@
 // that not all observers can respond to. To mitigate for this, use protocols and
 // the DECLARE_METHODS_USING_DELEGATE_PROTOCOL macro (see the .m file).
 #define LB_SEND_MESSAGE_TO_DELEGATES(message) \
-NSArray* immutableCopy = [NSArray arrayWithArray:self.sortedDelegates]; \
+NSArray* immutableCopy = nil; \
+@synchronized(self) { \
+  immutableCopy = [NSArray arrayWithArray:self.sortedDelegates]; \
+} \
 for (LBZeroingWeakContainer *c in immutableCopy) { \
   id delegate = [c weakValue]; \
   [delegate message]; \
@@ -122,14 +126,11 @@ for (LBZeroingWeakContainer *c in immutableCopy) { \
 #define LB_DECLARE_DELEGATE_PROTOCOL_M(protocolName) \
 + (void)addDelegate:(id<protocolName>)delegate withOrder:(int)order { \
     if (NO) LBLog(@"%@ addDelegate:%@ order:%d", NSStringFromClass([self class]), NSStringFromClass([delegate class]), order); \
-    BOOL found = NO; \
-    for (LBZeroingWeakContainer *c in [self sharedInstance].delegates) { \
-        id checkDelegate = [c weakValue]; \
-        if (delegate == checkDelegate) found = YES; \
-    } \
-    if (!found) { \
-        [[self sharedInstance].delegates setObject:[NSNumber numberWithInt:order] forKey:[LBZeroingWeakContainer containerWithValue:delegate]]; \
-        [[self sharedInstance] updateSortedDelegates]; \
+    @synchronized([self sharedInstance]) { \
+        if (delegate && ![[self sharedInstance].delegates objectForKey:delegate]) { \
+            [[self sharedInstance].delegates setObject:[NSNumber numberWithInt:order] forKey:delegate]; \
+            [[self sharedInstance] updateSortedDelegates]; \
+        } \
     } \
 } \
 \
@@ -148,10 +149,13 @@ for (LBZeroingWeakContainer *c in immutableCopy) { \
 
 LB_DECLARE_SHARED_INSTANCE_H(LBBaseMultiDelegateSingleton)
 
-// an dictionary of LBZeroingWeakContainer objects to NSNumber order values. the
-// keys (LBZeroingWeakContainer objects) holding references to the registered
-// delegates.
-@property (nonatomic, strong) NSMutableDictionary *delegates;
+// a table of the registered delegates (weakly held keys) to NSNumber order
+// values. sortedDelegates holds LBZeroingWeakContainer objects referencing the
+// same delegates, in message order. the add/remove methods and
+// LB_SEND_MESSAGE_TO_DELEGATES synchronize on the shared instance, so delegates
+// may register from any thread; do the same if you touch these properties
+// directly.
+@property (nonatomic, strong) LBWeakKeyTable *delegates;
 @property (nonatomic, strong) NSArray *sortedDelegates; // a performance optimization
 
 // add a delegate to the list, with an integral order, or with a default order
@@ -25,7 +25,7 @@ LB_DECLARE_DELEGATE_PROTOCOL_M(NSObject)
 
 - (void)reusableInit {
     [super reusableInit];
-    self.delegates = [NSMutableDictionary dictionary];
+    self.delegates = [LBWeakKeyTable table];
     self.sortedDelegates = [NSArray array];
 }
 
@@ -44,27 +44,31 @@ LB_DECLARE_DELEGATE_PROTOCOL_M(NSObject)
 }
 
 - (void)updateSortedDelegates {
-    self.sortedDelegates = [self.delegates keysSortedByValueUsingComparator: ^(id obj1, id obj2) {
-        if ([obj1 intValue] > [obj2 intValue]) {
+    NSArray *sorted = [[self.delegates allKeys] sortedArrayUsingComparator: ^(id delegate1, id delegate2) {
+        int order1 = [[self.delegates objectForKey:delegate1] intValue];
+        int order2 = [[self.delegates objectForKey:delegate2] intValue];
+        if (order1 > order2) {
             return (NSComparisonResult)NSOrderedDescending;
         }
-        if ([obj1 intValue] < [obj2 intValue]) {
+        if (order1 < order2) {
             return (NSComparisonResult)NSOrderedAscending;
         }
         return (NSComparisonResult)NSOrderedSame;
     }];
+    NSMutableArray *containers = [NSMutableArray arrayWithCapacity:[sorted count]];
+    for (id delegate in sorted) {
+        [containers addObject:[LBZeroingWeakContainer containerWithValue:delegate]];
+    }
+    self.sortedDelegates = containers;
 }
 
 + (void)removeDelegate:(id)delegate {
     // LBLog(@"%@ removeDelegate:%@", NSStringFromClass([self class]), NSStringFromClass([delegate class]));
-    LBZeroingWeakContainer *foundContainer = nil;
-    for (LBZeroingWeakContainer *c in [self sharedInstance].delegates) {
-        id checkDelegate = [c weakValue];
-        if (delegate == checkDelegate) foundContainer = c;
-    }
-    if (foundContainer) {
-        [[self sharedInstance].delegates removeObjectForKey:foundContainer];
-        [[self sharedInstance] updateSortedDelegates];
+    @synchronized([self sharedInstance]) {
+        if ([[self sharedInstance].delegates objectForKey:delegate]) {
+            [[self sharedInstance].delegates removeObjectForKey:delegate];
+            [[self sharedInstance] updateSortedDelegates];
+        }
     }
 }
 
@@ -17,6 +17,7 @@
  */
 
 #import "LBLog.h"
+#import "LBSingletonLaunchProfiler.h"
 
 /*
 
@@ -101,6 +102,19 @@
  it's included for completeness. it's like dealloc in that sense and in fact is
  simply called from dealloc.
  
+ - (void)deferrableInit;
+ optional, and only interesting together with the defersActivation property.
+ put runtime setup here that the singleton doesn't need until it is actually
+ used, and call [self activateIfNeeded] at the top of every method that relies
+ on it. normally deferrableInit simply runs right after reusableInit, but if
+ you set self.defersActivation = YES in initialInit, it instead runs the first
+ time activateIfNeeded is called or the next time the main run loop goes idle,
+ whichever happens first. this keeps expensive setup out of app launch when a
+ singleton is touched early (say, to register a delegate) but not really used
+ until later. reusableTeardown must cope with deferrableInit not having run
+ yet. see LBSingletonLaunchProfiler to find out which singletons are worth
+ deferring.
+ 
  Lifecycle graph:
  
    first access to singleton sharedInstance
@@ -111,6 +125,8 @@
       |
    reusableInit() <------------- reusableTeardown()
       |                                       |
+   deferrableInit() (maybe later)             |
+      |                                       |
    time passes                                |
       |      \_____________                   |
       |                    \                  |
@@ -122,13 +138,26 @@
  
  */
 
+// the sharedInstance fast path is a single acquire-load of a "ready" flag, so
+// once the instance exists callers never touch the class lock. the first call(s)
+// take the same @synchronized slow path as always, and the flag is published
+// with release semantics only after init (and thus initialInit/reusableInit) has
+// completed, so a fast-path reader can never see a half-built instance. the
+// instance itself is never recreated (see the reset() discussion above) so the
+// flag never needs to be cleared.
 #define LB_DECLARE_SHARED_INSTANCE_M(CLASSNAME)             \
 static CLASSNAME *_sharedInstance = nil;                    \
+static volatile long _sharedInstanceReady = 0;              \
                                                             \
 + (CLASSNAME *)sharedInstance {                             \
+    if (__atomic_load_n(&_sharedInstanceReady, __ATOMIC_ACQUIRE)) { \
+        return _sharedInstance;                             \
+    }                                                       \
     @synchronized([CLASSNAME class]) {                      \
         if (_sharedInstance == nil) {                       \
+            [LBSingletonLaunchProfiler recordFirstAccessOfClass:[CLASSNAME class]]; \
             _sharedInstance = [[CLASSNAME alloc] init];     \
+            __atomic_store_n(&_sharedInstanceReady, 1, __ATOMIC_RELEASE); \
         }                                                   \
     }                                                       \
     return _sharedInstance;                                 \
@@ -138,8 +167,7 @@ static CLASSNAME *_sharedInstance = nil;                    \
     @synchronized([CLASSNAME class]) {                      \
         if((self = [super init])) {                         \
             if (self.initialized == NO) {                   \
-                [self initialInit];                         \
-                [self reusableInit];                        \
+                [self runInitialLifecycle];                 \
                 self.initialized = YES;                     \
             }                                               \
         }                                                   \
@@ -179,6 +207,18 @@ typedef enum {
 - (void)reusableTeardown;
 - (void)finalTeardown;
 
+@optional
+
+// see the deferrableInit discussion above.
+- (void)deferrableInit;
+
+// used by LBSingletonResetManager to decide how reset() may be scheduled. see
+// the resetOnMainThread and resetDependencies properties of LBBaseSingleton.
+// objects that don't implement these are reset on the main thread with no
+// dependencies.
+- (BOOL)resetOnMainThread;
+- (NSArray *)resetDependencies;
+
 @end
 
 @interface LBBaseSingleton : NSObject <LBResettable>
@@ -201,8 +241,32 @@ typedef enum {
 @property (nonatomic, assign) BOOL resettable;
 @property (nonatomic, assign) LBResetOrderGroup resetOrder;
 
+// singletons in the same resetOrder group are reset concurrently by
+// LBSingletonResetManager. resetOnMainThread (default YES) pins this
+// singleton's reset() to the main thread; only set it to NO if your
+// reusableTeardown and reusableInit are safe to run on a background thread
+// (no UIKit, no dispatch_sync to the main queue). resetDependencies is an
+// optional array of singleton classes in the same resetOrder group that must
+// finish resetting before this one starts. like resettable and resetOrder, set
+// these in initialInit().
+@property (nonatomic, assign) BOOL resetOnMainThread;
+@property (nonatomic, strong) NSArray *resetDependencies;
+
+// if YES, deferrableInit is postponed until activateIfNeeded is called or the
+// main run loop is idle. defaults to NO. set it in initialInit().
+@property (nonatomic, assign) BOOL defersActivation;
+
+// runs deferrableInit if it hasn't run since the last reusableInit. cheap once
+// activated, and safe to call from any thread.
+- (void)activateIfNeeded;
+
 // for internal use, prevent multiple calls to initialInit and reusableInit when
 // a subclass is instantiated
 @property (nonatomic, assign) BOOL initialized;
 
+// for internal use by LB_DECLARE_SHARED_INSTANCE_M: runs initialInit,
+// reusableInit and (unless deferred) deferrableInit, reporting to
+// LBSingletonLaunchProfiler.
+- (void)runInitialLifecycle;
+
 @end
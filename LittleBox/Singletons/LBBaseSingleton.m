@@ -18,8 +18,17 @@
 
 #import "LBBaseSingleton.h"
 #import "LBSingletonResetManager.h"
+#import "LBUtils.h"
 
-@implementation LBBaseSingleton
+// singletons waiting for an idle main run loop to run their deferrableInit,
+// and the observer that drains them.
+static NSMutableArray *_idleActivationQueue = nil;
+static CFRunLoopObserverRef _idleActivationObserver = NULL;
+
+@implementation LBBaseSingleton {
+    volatile long _activated;
+    BOOL _activating;
+}
 
 + (id)sharedInstance {
     // this method is actually redefined in each subclass using the
@@ -35,6 +44,8 @@
     // LBLog(@"%@ initialInit (LBBaseSingleton super method)", NSStringFromClass([self class]));
     self.resettable = YES; // register with LBSingletonResetManager by default
     self.resetOrder = LBResetOrderGroup5; // with the middle order (5 out of 10) by default
+    self.resetOnMainThread = YES; // UIKit-safe by default, opt in to background resets
+    self.resetDependencies = nil;
 }
 
 - (void)reusableInit {
@@ -48,6 +59,10 @@
     }
 }
 
+- (void)deferrableInit {
+    // LBLog(@"%@ deferrableInit (LBBaseSingleton super method)", NSStringFromClass([self class]));
+}
+
 - (void)reusableTeardown {
     // LBLog(@"%@ reusableTeardown (LBBaseSingleton super method)", NSStringFromClass([self class]));
 }
@@ -58,8 +73,98 @@
 
 - (void)reset {
     // LBLog(@"%@ reset (LBBaseSingleton super method)", NSStringFromClass([self class]));
+    BOOL profiling = [LBSingletonLaunchProfiler isEnabled];
+    NSTimeInterval start = profiling ? [LBUtils monotonicTime] : 0.0;
     [self reusableTeardown];
+    [self runReusableInit];
+    if (profiling) {
+        [LBSingletonLaunchProfiler recordResetDuration:([LBUtils monotonicTime] - start) ofClass:[self class]];
+    }
+}
+
+#pragma mark instrumented lifecycle
+
+- (void)runInitialLifecycle {
+    BOOL profiling = [LBSingletonLaunchProfiler isEnabled];
+    NSTimeInterval start = profiling ? [LBUtils monotonicTime] : 0.0;
+    [self initialInit];
+    if (profiling) {
+        [LBSingletonLaunchProfiler recordDuration:([LBUtils monotonicTime] - start) forPhase:LBSingletonProfileInitialInitKey ofClass:[self class]];
+    }
+    [self runReusableInit];
+}
+
+- (void)runReusableInit {
+    BOOL profiling = [LBSingletonLaunchProfiler isEnabled];
+    NSTimeInterval start = profiling ? [LBUtils monotonicTime] : 0.0;
     [self reusableInit];
+    if (profiling) {
+        [LBSingletonLaunchProfiler recordDuration:([LBUtils monotonicTime] - start) forPhase:LBSingletonProfileReusableInitKey ofClass:[self class]];
+    }
+    // deferrableInit has to run again after every reusableInit
+    @synchronized(self) {
+        __atomic_store_n(&_activated, 0, __ATOMIC_RELEASE);
+    }
+    if (self.defersActivation) {
+        [[self class] enqueueIdleActivation:self];
+    } else {
+        [self activateIfNeeded];
+    }
+}
+
+- (void)activateIfNeeded {
+    if (__atomic_load_n(&_activated, __ATOMIC_ACQUIRE)) return;
+    @synchronized(self) {
+        // _activating catches a deferrableInit that (indirectly) calls back
+        // into activateIfNeeded on the same thread. other threads wait on the
+        // lock until deferrableInit is done.
+        if (_activated || _activating) return;
+        _activating = YES;
+        BOOL profiling = [LBSingletonLaunchProfiler isEnabled];
+        NSTimeInterval start = profiling ? [LBUtils monotonicTime] : 0.0;
+        [self deferrableInit];
+        if (profiling) {
+            [LBSingletonLaunchProfiler recordDuration:([LBUtils monotonicTime] - start) forPhase:LBSingletonProfileDeferrableInitKey ofClass:[self class]];
+        }
+        _activating = NO;
+        __atomic_store_n(&_activated, 1, __ATOMIC_RELEASE);
+    }
+}
+
+#pragma mark idle activation
+
+static void LBIdleActivationObserverCallback(CFRunLoopObserverRef observer, CFRunLoopActivity activity, void *info) {
+    // activate one singleton per idle pass, so a long list of deferred
+    // singletons can't stall a frame.
+    LBBaseSingleton *singleton = nil;
+    @synchronized([LBBaseSingleton class]) {
+        if ([_idleActivationQueue count] > 0) {
+            singleton = [_idleActivationQueue objectAtIndex:0];
+            [_idleActivationQueue removeObjectAtIndex:0];
+        }
+        if ([_idleActivationQueue count] == 0 && _idleActivationObserver) {
+            CFRunLoopObserverInvalidate(_idleActivationObserver);
+            CFRelease(_idleActivationObserver);
+            _idleActivationObserver = NULL;
+        }
+    }
+    [singleton activateIfNeeded];
+}
+
++ (void)enqueueIdleActivation:(LBBaseSingleton *)singleton {
+    @synchronized([LBBaseSingleton class]) {
+        if (!_idleActivationQueue) _idleActivationQueue = [NSMutableArray array];
+        if ([_idleActivationQueue indexOfObjectIdenticalTo:singleton] == NSNotFound) {
+            [_idleActivationQueue addObject:singleton];
+        }
+        if (!_idleActivationObserver) {
+            // the lowest priority order, so everything else that wants to run
+            // before the main thread sleeps gets to go first.
+            _idleActivationObserver = CFRunLoopObserverCreate(kCFAllocatorDefault, kCFRunLoopBeforeWaiting, true, LONG_MAX, LBIdleActivationObserverCallback, NULL);
+            CFRunLoopAddObserver(CFRunLoopGetMain(), _idleActivationObserver, kCFRunLoopCommonModes);
+            CFRunLoopWakeUp(CFRunLoopGetMain());
+        }
+    }
 }
 
 - (void)dealloc {
@@ -60,6 +60,18 @@
  initial application sign in sequence controller, for which we have a dedicated
  spinner overlayed on a splash screen graphic.
  
+ Use cases are counted: registering the same one twice takes two unregisters
+ to clear it, so independent pieces of code can share a use case string without
+ hiding the spinner out from under each other. Registering and unregistering
+ is safe from any thread and doesn't wait on the main thread; the spinner view
+ catches up there afterwards, once for any number of changes made in the
+ meantime.
+ 
+ With useDelayToMitigateForFlashing (the default), the spinner only appears
+ once it has been wanted for showDelay seconds, and stays up for at least
+ minimumShowDuration seconds once it has, so short operations don't flash it on
+ and off.
+ 
  */
 
 #import <Foundation/Foundation.h>
@@ -74,6 +86,7 @@
 
 LB_DECLARE_SHARED_INSTANCE_H(LBGlobalFullScreenSpinner)
 
+// use case -> NSNumber count. guarded by @synchronized on the spinner.
 @property (nonatomic, strong) NSMutableDictionary *activeUseCases;
 @property (nonatomic, strong) NSMutableDictionary *activeSuppressionUseCases;
 @property (nonatomic, assign) BOOL spinnerIsActive;
@@ -81,6 +94,9 @@ LB_DECLARE_SHARED_INSTANCE_H(LBGlobalFullScreenSpinner)
 @property (nonatomic, strong) LBStyledActivityIndicator *spinner;
 @property (nonatomic, weak) id<AlternateGlobalSpinnerDelegateProtocol> alternateGlobalSpinnerDelegate;
 @property (nonatomic, assign) BOOL useDelayToMitigateForFlashing;
+// seconds, defaults 0.2 and 0.5. see above.
+@property (nonatomic, assign) NSTimeInterval showDelay;
+@property (nonatomic, assign) NSTimeInterval minimumShowDuration;
 
 + (void)registerActiveUseCase:(NSString*)useCase;
 + (void)unregisterInactiveUseCase:(NSString*)useCase;
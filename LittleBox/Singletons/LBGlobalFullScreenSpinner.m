@@ -17,6 +17,14 @@
  */
 
 #import "LBGlobalFullScreenSpinner.h"
+#import "LBUtils.h"
+
+@interface LBGlobalFullScreenSpinner () {
+    // set when a view update is already on its way to the main thread
+    volatile long _viewUpdateScheduled;
+}
+@property (nonatomic, assign) NSTimeInterval shownAt;
+@end
 
 @implementation LBGlobalFullScreenSpinner
 
@@ -30,73 +38,64 @@ LB_DECLARE_SHARED_INSTANCE_M(LBGlobalFullScreenSpinner)
 - (void)reusableInit {
     [super reusableInit];
     self.alternateGlobalSpinnerDelegate = nil;
-    self.activeUseCases = [NSMutableDictionary dictionary];
-    self.activeSuppressionUseCases = [NSMutableDictionary dictionary];
+    @synchronized(self) {
+        self.activeUseCases = [NSMutableDictionary dictionary];
+        self.activeSuppressionUseCases = [NSMutableDictionary dictionary];
+    }
     self.spinner = [[LBStyledActivityIndicator alloc] init];
     self.spinner.style = LBStyledActivityIndicatorStyleFull;
     self.spinnerIsActive = NO;
     self.lastSentBool = NO;
     self.useDelayToMitigateForFlashing = YES;
+    self.showDelay = 0.2;
+    self.minimumShowDuration = 0.5;
 }
 
 - (void)reusableTeardown {
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(sendSpinnerViewState) object:nil];
     self.alternateGlobalSpinnerDelegate = nil;
-    self.activeUseCases = nil;
-    self.activeSuppressionUseCases = nil;
+    @synchronized(self) {
+        self.activeUseCases = nil;
+        self.activeSuppressionUseCases = nil;
+    }
     self.spinnerIsActive = NO;
     [self.spinner stop];
     self.spinner = nil;
     [super reusableTeardown];
 }
 
-- (void)registerActiveUseCase:(NSString*)useCase {
+#pragma mark use cases
+
+// adds delta to the use case's count, dropping it once it reaches zero. safe
+// from any thread; the view catches up on the main thread afterwards.
+- (void)adjustUseCase:(NSString *)useCase inSuppressions:(BOOL)suppression by:(NSInteger)delta {
     if (!useCase) return;
-    if ([NSThread isMainThread]) {
-        [self.activeUseCases setObject:@"holder" forKey:useCase];
-        [self updateSpinnerIsActive];
-    } else {
-        dispatch_async(dispatch_get_main_queue(), ^{
-            [self.activeUseCases setObject:@"holder" forKey:useCase];
-            [self updateSpinnerIsActive];
-        });
+    @synchronized(self) {
+        NSMutableDictionary *useCases = suppression ? self.activeSuppressionUseCases : self.activeUseCases;
+        NSInteger count = [[useCases objectForKey:useCase] integerValue] + delta;
+        if (count > 0) {
+            [useCases setObject:[NSNumber numberWithInteger:count] forKey:useCase];
+        } else {
+            [useCases removeObjectForKey:useCase];
+        }
     }
+    [self scheduleSpinnerViewUpdate];
+}
+
+- (void)registerActiveUseCase:(NSString*)useCase {
+    [self adjustUseCase:useCase inSuppressions:NO by:1];
 }
 
 - (void)unregisterInactiveUseCase:(NSString*)useCase {
-    if (!useCase) return;
-    if ([NSThread isMainThread]) {
-        [self.activeUseCases removeObjectForKey:useCase];
-        [self updateSpinnerIsActive];
-    } else {
-        dispatch_async(dispatch_get_main_queue(), ^{
-            [self.activeUseCases removeObjectForKey:useCase];
-            [self updateSpinnerIsActive];
-        });
-    }
+    [self adjustUseCase:useCase inSuppressions:NO by:-1];
 }
 
 - (void)registerActiveSuppressionUseCase:(NSString*)useCase {
-    if ([NSThread isMainThread]) {
-        [self.activeSuppressionUseCases setObject:@"holder" forKey:useCase];
-        [self updateSpinnerIsActive];
-    } else {
-        dispatch_async(dispatch_get_main_queue(), ^{
-            [self.activeSuppressionUseCases setObject:@"holder" forKey:useCase];
-            [self updateSpinnerIsActive];
-        });
-    }
+    [self adjustUseCase:useCase inSuppressions:YES by:1];
 }
 
 - (void)unregisterInactiveSuppressionUseCase:(NSString*)useCase {
-    if ([NSThread isMainThread]) {
-        [self.activeSuppressionUseCases removeObjectForKey:useCase];
-        [self updateSpinnerIsActive];
-    } else {
-        dispatch_async(dispatch_get_main_queue(), ^{
-            [self.activeSuppressionUseCases removeObjectForKey:useCase];
-            [self updateSpinnerIsActive];
-        });
-    }
+    [self adjustUseCase:useCase inSuppressions:YES by:-1];
 }
 
 + (void)registerActiveUseCase:(NSString*)useCase {
@@ -115,21 +114,15 @@ LB_DECLARE_SHARED_INSTANCE_M(LBGlobalFullScreenSpinner)
     [[self sharedInstance] unregisterInactiveSuppressionUseCase:useCase];
 }
 
-- (void)updateSpinnerIsActive {
-    self.spinnerIsActive = (([self.activeUseCases count] > 0) && ([self.activeSuppressionUseCases count] == 0));
-}
+#pragma mark view state
 
-- (void)setSpinnerIsActive:(BOOL)spinnerIsActive {
-    BOOL wasActive = _spinnerIsActive;
-    _spinnerIsActive = spinnerIsActive;
-    if (_spinnerIsActive != wasActive) {
-        // we just want this to run in the next run loop to give time for code
-        // remaining to be executed in this runloop to register new spinner use
-        // cases. also this prevents unexpected scenarios where a callback to
-        // the delegate is done synchronously as a result of spinner state
-        // twiddling. note that this deferred method is just the view update
-        // signal, the actual boolean (_spinnerIsActive) has already been set as
-        // to whether the spinner should be visible.
+- (void)scheduleSpinnerViewUpdate {
+    // however many changes happen before the main thread gets to it, from
+    // however many threads, there's one update for all of them. it also runs
+    // in a later run loop pass, which gives code remaining in this one time to
+    // register new use cases, and means the delegate is never called back
+    // synchronously as a result of spinner state twiddling.
+    if (__atomic_exchange_n(&_viewUpdateScheduled, 1, __ATOMIC_ACQ_REL) == 0) {
         dispatch_async(dispatch_get_main_queue(), ^{
             [self updateSpinnerViewState];
         });
@@ -137,8 +130,36 @@ LB_DECLARE_SHARED_INSTANCE_M(LBGlobalFullScreenSpinner)
 }
 
 - (void)updateSpinnerViewState {
+    __atomic_store_n(&_viewUpdateScheduled, 0, __ATOMIC_RELEASE);
+    @synchronized(self) {
+        self.spinnerIsActive = (([self.activeUseCases count] > 0) && ([self.activeSuppressionUseCases count] == 0));
+    }
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(sendSpinnerViewState) object:nil];
+    if (self.spinnerIsActive == self.lastSentBool) return;
+    // to avoid flashing, only show once the spinner has been wanted for a
+    // moment, and once shown, keep it up for a moment. a quick hide and show
+    // again in between simply cancels out.
+    NSTimeInterval delay = 0;
+    if (self.useDelayToMitigateForFlashing) {
+        if (self.spinnerIsActive) {
+            delay = self.showDelay;
+        } else {
+            delay = self.minimumShowDuration - ([LBUtils monotonicTime] - self.shownAt);
+        }
+    }
+    if (delay > 0) {
+        [self performSelector:@selector(sendSpinnerViewState) withObject:nil afterDelay:delay];
+    } else {
+        [self sendSpinnerViewState];
+    }
+}
+
+- (void)sendSpinnerViewState {
     if (self.spinnerIsActive != self.lastSentBool) {
         self.lastSentBool = self.spinnerIsActive;
+        if (self.spinnerIsActive) {
+            self.shownAt = [LBUtils monotonicTime];
+        }
         if (self.alternateGlobalSpinnerDelegate) {
             [self.alternateGlobalSpinnerDelegate alternateGlobalSpinnerShouldShow:self.spinnerIsActive];
         }
@@ -32,19 +32,68 @@
  with other code that twiddles the state of the networkActivityIndicatorVisible
  property of the UIApplication.
  
+ Since it sees every connection start and finish anyway, it also keeps
+ statistics on them, readable with -statistics (see the keys below):
+ 
+ - how many connections are in flight, the peak, and how long in total the app
+   has spent with 0, 1, 2, ... of them in flight.
+ - a latency histogram per identifier prefix, the part of the identifier before
+   prefixSeparator (default @":"), so e.g. @"feed:1234" and @"feed:5678" add
+   up under @"feed". buckets are powers of two milliseconds.
+ - connections that leaked: still registered leakTimeout seconds (default 60)
+   after they started. a check is scheduled for when the oldest one would
+   leak, and they stop counting as in flight then, so the indicator can't spin
+   forever, but if they do finish later their latency is still recorded. the
+   most recent 64 are remembered, until -resetStatistics forgets them.
+ 
+ Times come from a monotonic clock (LBUtils monotonicTime). Registering and
+ unregistering is safe from any thread; the indicator itself is updated on the
+ main thread afterwards. Registering an identifier that's already in flight
+ restarts its clock.
+ 
  */
 
 #import "LBBaseSingleton.h"
 
+// keys of the dictionary returned by -statistics. times are NSNumber seconds.
+extern NSString * const LBConnectionStatsInFlightKey;
+extern NSString * const LBConnectionStatsPeakInFlightKey;
+extern NSString * const LBConnectionStatsStartedKey;
+extern NSString * const LBConnectionStatsCompletedKey;
+extern NSString * const LBConnectionStatsLeakedCountKey;
+extern NSString * const LBConnectionStatsLeakedKey; // NSArray of {identifier, age}
+extern NSString * const LBConnectionStatsConcurrencyKey; // NSArray, seconds at 0, 1, ... in flight; the last is that many or more
+extern NSString * const LBConnectionStatsLatencyKey; // prefix -> latency dictionary
+extern NSString * const LBConnectionStatsDurationKey; // seconds covered by these statistics
+// keys of each prefix's latency dictionary
+extern NSString * const LBConnectionLatencyCountKey;
+extern NSString * const LBConnectionLatencyMeanKey;
+extern NSString * const LBConnectionLatencyMinKey;
+extern NSString * const LBConnectionLatencyMaxKey;
+extern NSString * const LBConnectionLatencyP50Key; // percentiles are bucket upper bounds
+extern NSString * const LBConnectionLatencyP90Key;
+extern NSString * const LBConnectionLatencyP99Key;
+extern NSString * const LBConnectionLatencyBucketsKey; // NSArray of counts, bucket i < 2^i ms
+// keys of each entry of LBConnectionStatsLeakedKey
+extern NSString * const LBConnectionIdentifierKey;
+extern NSString * const LBConnectionAgeKey;
+
 @interface LBNetworkStatusSpinnerManager : LBBaseSingleton
 
 LB_DECLARE_SHARED_INSTANCE_H(LBNetworkStatusSpinnerManager)
 
+// identifier -> NSNumber start time. guarded by @synchronized on the manager.
 @property (nonatomic, strong) NSMutableDictionary *connectionsActive;
+@property (nonatomic, copy) NSString *prefixSeparator;
+@property (nonatomic, assign) NSTimeInterval leakTimeout;
 
 + (void)registerConnection:(NSString *)connectionIdentifier;
 + (void)unregisterConnection:(NSString *)connectionIdentifier;
 - (void)registerConnection:(NSString *)connectionIdentifier;
 - (void)unregisterConnection:(NSString *)connectionIdentifier;
 
+// a snapshot, see the keys above
+- (NSDictionary *)statistics;
+- (void)resetStatistics;
+
 @end
@@ -17,6 +17,108 @@
  */
 
 #import "LBNetworkStatusSpinnerManager.h"
+#import "LBUtils.h"
+
+NSString * const LBConnectionStatsInFlightKey = @"inFlight";
+NSString * const LBConnectionStatsPeakInFlightKey = @"peakInFlight";
+NSString * const LBConnectionStatsStartedKey = @"started";
+NSString * const LBConnectionStatsCompletedKey = @"completed";
+NSString * const LBConnectionStatsLeakedCountKey = @"leakedCount";
+NSString * const LBConnectionStatsLeakedKey = @"leaked";
+NSString * const LBConnectionStatsConcurrencyKey = @"concurrency";
+NSString * const LBConnectionStatsLatencyKey = @"latency";
+NSString * const LBConnectionStatsDurationKey = @"duration";
+NSString * const LBConnectionLatencyCountKey = @"count";
+NSString * const LBConnectionLatencyMeanKey = @"mean";
+NSString * const LBConnectionLatencyMinKey = @"min";
+NSString * const LBConnectionLatencyMaxKey = @"max";
+NSString * const LBConnectionLatencyP50Key = @"p50";
+NSString * const LBConnectionLatencyP90Key = @"p90";
+NSString * const LBConnectionLatencyP99Key = @"p99";
+NSString * const LBConnectionLatencyBucketsKey = @"buckets";
+NSString * const LBConnectionIdentifierKey = @"identifier";
+NSString * const LBConnectionAgeKey = @"age";
+
+// bucket 0 is under 1ms, bucket i under 2^i ms, the last one everything longer
+#define LB_LATENCY_BUCKETS 20
+// time is tracked at 0 .. LB_CONCURRENCY_LEVELS - 1 connections in flight, the
+// last level standing for that many or more
+#define LB_CONCURRENCY_LEVELS 17
+// leaked connections remembered (for a late finish and for -statistics), past
+// which the oldest is forgotten
+#define LB_LEAKED_CONNECTIONS_KEPT 64
+
+@interface LBConnectionLatencyHistogram : NSObject {
+@public
+    NSUInteger _buckets[LB_LATENCY_BUCKETS];
+    NSUInteger _count;
+    NSTimeInterval _total;
+    NSTimeInterval _min;
+    NSTimeInterval _max;
+}
+- (void)addLatency:(NSTimeInterval)latency;
+- (NSDictionary *)dictionary;
+@end
+
+@implementation LBConnectionLatencyHistogram
+
+- (void)addLatency:(NSTimeInterval)latency {
+    double milliseconds = latency * 1000.0;
+    int bucket = milliseconds < 1.0 ? 0 : (int)log2(milliseconds) + 1;
+    _buckets[MIN(bucket, LB_LATENCY_BUCKETS - 1)]++;
+    _min = _count ? MIN(_min, latency) : latency;
+    _max = _count ? MAX(_max, latency) : latency;
+    _total += latency;
+    _count++;
+}
+
+- (NSTimeInterval)percentile:(double)fraction {
+    NSUInteger target = (NSUInteger)ceil(fraction * _count);
+    NSUInteger seen = 0;
+    for (int i = 0; i < LB_LATENCY_BUCKETS - 1; i++) {
+        seen += _buckets[i];
+        if (seen >= target) return MIN(ldexp(1.0, i) / 1000.0, _max);
+    }
+    return _max;
+}
+
+- (NSDictionary *)dictionary {
+    NSMutableArray *buckets = [NSMutableArray arrayWithCapacity:LB_LATENCY_BUCKETS];
+    for (int i = 0; i < LB_LATENCY_BUCKETS; i++) {
+        [buckets addObject:[NSNumber numberWithUnsignedInteger:_buckets[i]]];
+    }
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+            [NSNumber numberWithUnsignedInteger:_count], LBConnectionLatencyCountKey,
+            [NSNumber numberWithDouble:_count ? _total / _count : 0.0], LBConnectionLatencyMeanKey,
+            [NSNumber numberWithDouble:_min], LBConnectionLatencyMinKey,
+            [NSNumber numberWithDouble:_max], LBConnectionLatencyMaxKey,
+            [NSNumber numberWithDouble:[self percentile:0.5]], LBConnectionLatencyP50Key,
+            [NSNumber numberWithDouble:[self percentile:0.9]], LBConnectionLatencyP90Key,
+            [NSNumber numberWithDouble:[self percentile:0.99]], LBConnectionLatencyP99Key,
+            buckets, LBConnectionLatencyBucketsKey,
+            nil];
+}
+
+@end
+
+@interface LBNetworkStatusSpinnerManager () {
+    NSTimeInterval _concurrencyTime[LB_CONCURRENCY_LEVELS];
+    NSTimeInterval _lastTransition;
+    NSTimeInterval _statisticsStart;
+    NSUInteger _peakInFlight;
+    NSUInteger _started;
+    NSUInteger _completed;
+    NSUInteger _leakedCount;
+    // set when an indicator update is already on its way to the main thread
+    volatile long _indicatorUpdateScheduled;
+    // when the pending leak check is due, 0 if none is pending
+    NSTimeInterval _leakCheckAt;
+}
+// identifier -> NSNumber start time, for connections past the leak timeout
+@property (nonatomic, strong) NSMutableDictionary *connectionsLeaked;
+// prefix -> LBConnectionLatencyHistogram
+@property (nonatomic, strong) NSMutableDictionary *latencies;
+@end
 
 @implementation LBNetworkStatusSpinnerManager
 
@@ -25,11 +127,18 @@ LB_DECLARE_SHARED_INSTANCE_M(LBNetworkStatusSpinnerManager)
 - (void)initialInit {
     [super initialInit];
     self.resetOrder = LBResetOrderGroup5;
+    self.prefixSeparator = @":";
+    self.leakTimeout = 60.0;
 }
 
 - (void)reusableInit {
     [super reusableInit];
-    self.connectionsActive = [[NSMutableDictionary alloc] init];
+    @synchronized(self) {
+        self.connectionsActive = [[NSMutableDictionary alloc] init];
+        self.connectionsLeaked = [[NSMutableDictionary alloc] init];
+        _leakCheckAt = 0;
+        [self clearStatistics];
+    }
     [[NSNotificationCenter defaultCenter] addObserver:self
                                              selector:@selector(willResignActive:)
                                                  name:UIApplicationWillResignActiveNotification
@@ -38,7 +147,12 @@ LB_DECLARE_SHARED_INSTANCE_M(LBNetworkStatusSpinnerManager)
 
 - (void)reusableTeardown {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
-    self.connectionsActive = nil;
+    @synchronized(self) {
+        self.connectionsActive = nil;
+        self.connectionsLeaked = nil;
+        self.latencies = nil;
+        _leakCheckAt = 0;
+    }
     [UIApplication sharedApplication].networkActivityIndicatorVisible = NO;
     [super reusableTeardown];
 }
@@ -52,22 +166,203 @@ LB_DECLARE_SHARED_INSTANCE_M(LBNetworkStatusSpinnerManager)
 }
 
 - (void)registerConnection:(NSString *)connectionIdentifier {
-    [UIApplication sharedApplication].networkActivityIndicatorVisible = YES;
-    [self.connectionsActive setObject:@"holder" forKey:connectionIdentifier];
+    if (!connectionIdentifier) return;
+    NSTimeInterval now = [LBUtils monotonicTime];
+    @synchronized(self) {
+        [self reapLeakedConnectionsAt:now];
+        [self noteConcurrencyAt:now];
+        [self.connectionsLeaked removeObjectForKey:connectionIdentifier];
+        [self.connectionsActive setObject:[NSNumber numberWithDouble:now] forKey:connectionIdentifier];
+        _started++;
+        _peakInFlight = MAX(_peakInFlight, [self.connectionsActive count]);
+        [self scheduleLeakCheck];
+    }
+    [self scheduleIndicatorUpdate];
 }
 
 - (void)unregisterConnection:(NSString *)connectionIdentifier {
-    [self.connectionsActive removeObjectForKey:connectionIdentifier];
-    if([self.connectionsActive count] == 0) {
-        [UIApplication sharedApplication].networkActivityIndicatorVisible = NO;
+    if (!connectionIdentifier) return;
+    NSTimeInterval now = [LBUtils monotonicTime];
+    @synchronized(self) {
+        [self reapLeakedConnectionsAt:now];
+        [self noteConcurrencyAt:now];
+        NSNumber *start = [self.connectionsActive objectForKey:connectionIdentifier];
+        if (start) {
+            [self.connectionsActive removeObjectForKey:connectionIdentifier];
+        } else if ((start = [self.connectionsLeaked objectForKey:connectionIdentifier])) {
+            [self.connectionsLeaked removeObjectForKey:connectionIdentifier];
+        }
+        if (start) {
+            _completed++;
+            [self addLatency:now - [start doubleValue] forIdentifier:connectionIdentifier];
+        }
+    }
+    [self scheduleIndicatorUpdate];
+}
+
+- (void)scheduleIndicatorUpdate {
+    // one main thread update for however many changes come in before it runs
+    if (__atomic_exchange_n(&_indicatorUpdateScheduled, 1, __ATOMIC_ACQ_REL) == 0) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            __atomic_store_n(&_indicatorUpdateScheduled, 0, __ATOMIC_RELEASE);
+            BOOL visible;
+            @synchronized(self) {
+                visible = [self.connectionsActive count] > 0;
+            }
+            [UIApplication sharedApplication].networkActivityIndicatorVisible = visible;
+        });
     }
 }
 
 - (void)willResignActive:(NSNotification*)notification {
-    // as a safety valve against permanent spinning, clear spinner state on
-    // entering background
-    [self.connectionsActive removeAllObjects];
-    [UIApplication sharedApplication].networkActivityIndicatorVisible = NO;
+    // as a safety valve against permanent spinning, anything that has been
+    // running too long is written off as leaked. (this used to forget every
+    // connection, which lost track of the ones that were just slow.)
+    @synchronized(self) {
+        [self reapLeakedConnectionsAt:[LBUtils monotonicTime]];
+    }
+    [self scheduleIndicatorUpdate];
+}
+
+#pragma mark leak checks
+
+// without this, leaks would only be noticed by the next register, unregister
+// or statistics call, and the indicator could spin on with nothing else going
+// on. expects @synchronized(self).
+- (void)scheduleLeakCheck {
+    // a newer registration never makes the pending check due any sooner. one
+    // made early by its connection finishing just reschedules itself.
+    if (_leakCheckAt || ![self.connectionsActive count]) return;
+    NSTimeInterval oldest = INFINITY;
+    for (NSNumber *start in [self.connectionsActive objectEnumerator]) {
+        oldest = MIN(oldest, [start doubleValue]);
+    }
+    NSTimeInterval deadline = oldest + self.leakTimeout;
+    _leakCheckAt = deadline;
+    // a hair past the deadline, since only connections older than leakTimeout
+    // are reaped
+    NSTimeInterval delay = MAX(deadline - [LBUtils monotonicTime], 0.0) + 0.01;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self leakCheckDue:deadline];
+    });
+}
+
+- (void)leakCheckDue:(NSTimeInterval)deadline {
+    @synchronized(self) {
+        // superseded by a teardown
+        if (_leakCheckAt != deadline) return;
+        _leakCheckAt = 0;
+        [self reapLeakedConnectionsAt:[LBUtils monotonicTime]];
+        [self scheduleLeakCheck];
+    }
+    [self scheduleIndicatorUpdate];
+}
+
+#pragma mark statistics
+
+// these expect @synchronized(self)
+
+- (void)clearStatistics {
+    self.latencies = [NSMutableDictionary dictionary];
+    [self.connectionsLeaked removeAllObjects];
+    memset(_concurrencyTime, 0, sizeof(_concurrencyTime));
+    _statisticsStart = _lastTransition = [LBUtils monotonicTime];
+    _peakInFlight = [self.connectionsActive count];
+    _started = 0;
+    _completed = 0;
+    _leakedCount = 0;
+}
+
+// credits the time since the last change to the number in flight until now
+- (void)noteConcurrencyAt:(NSTimeInterval)now {
+    NSUInteger level = MIN([self.connectionsActive count], (NSUInteger)LB_CONCURRENCY_LEVELS - 1);
+    _concurrencyTime[level] += now - _lastTransition;
+    _lastTransition = now;
+}
+
+- (void)reapLeakedConnectionsAt:(NSTimeInterval)now {
+    if (![self.connectionsActive count]) return;
+    NSMutableArray *leaked = nil;
+    for (NSString *identifier in self.connectionsActive) {
+        if (now - [[self.connectionsActive objectForKey:identifier] doubleValue] > self.leakTimeout) {
+            if (!leaked) leaked = [NSMutableArray array];
+            [leaked addObject:identifier];
+        }
+    }
+    if (!leaked) return;
+    [self noteConcurrencyAt:now];
+    for (NSString *identifier in leaked) {
+        [self.connectionsLeaked setObject:[self.connectionsActive objectForKey:identifier] forKey:identifier];
+        [self.connectionsActive removeObjectForKey:identifier];
+        _leakedCount++;
+    }
+    while ([self.connectionsLeaked count] > LB_LEAKED_CONNECTIONS_KEPT) {
+        NSString *oldest = nil;
+        NSTimeInterval oldestStart = INFINITY;
+        for (NSString *identifier in self.connectionsLeaked) {
+            NSTimeInterval start = [[self.connectionsLeaked objectForKey:identifier] doubleValue];
+            if (start < oldestStart) {
+                oldestStart = start;
+                oldest = identifier;
+            }
+        }
+        [self.connectionsLeaked removeObjectForKey:oldest];
+    }
+}
+
+- (void)addLatency:(NSTimeInterval)latency forIdentifier:(NSString *)identifier {
+    NSString *prefix = identifier;
+    if ([self.prefixSeparator length]) {
+        NSRange separator = [identifier rangeOfString:self.prefixSeparator];
+        if (separator.location != NSNotFound) prefix = [identifier substringToIndex:separator.location];
+    }
+    LBConnectionLatencyHistogram *histogram = [self.latencies objectForKey:prefix];
+    if (!histogram) {
+        histogram = [[LBConnectionLatencyHistogram alloc] init];
+        [self.latencies setObject:histogram forKey:prefix];
+    }
+    [histogram addLatency:latency];
+}
+
+- (NSDictionary *)statistics {
+    NSTimeInterval now = [LBUtils monotonicTime];
+    @synchronized(self) {
+        [self reapLeakedConnectionsAt:now];
+        [self noteConcurrencyAt:now];
+        NSMutableArray *concurrency = [NSMutableArray arrayWithCapacity:LB_CONCURRENCY_LEVELS];
+        for (int i = 0; i < LB_CONCURRENCY_LEVELS; i++) {
+            [concurrency addObject:[NSNumber numberWithDouble:_concurrencyTime[i]]];
+        }
+        NSMutableDictionary *latencies = [NSMutableDictionary dictionaryWithCapacity:[self.latencies count]];
+        for (NSString *prefix in self.latencies) {
+            [latencies setObject:[[self.latencies objectForKey:prefix] dictionary] forKey:prefix];
+        }
+        NSMutableArray *leaked = [NSMutableArray arrayWithCapacity:[self.connectionsLeaked count]];
+        for (NSString *identifier in self.connectionsLeaked) {
+            NSTimeInterval age = now - [[self.connectionsLeaked objectForKey:identifier] doubleValue];
+            [leaked addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                               identifier, LBConnectionIdentifierKey,
+                               [NSNumber numberWithDouble:age], LBConnectionAgeKey,
+                               nil]];
+        }
+        return [NSDictionary dictionaryWithObjectsAndKeys:
+                [NSNumber numberWithUnsignedInteger:[self.connectionsActive count]], LBConnectionStatsInFlightKey,
+                [NSNumber numberWithUnsignedInteger:_peakInFlight], LBConnectionStatsPeakInFlightKey,
+                [NSNumber numberWithUnsignedInteger:_started], LBConnectionStatsStartedKey,
+                [NSNumber numberWithUnsignedInteger:_completed], LBConnectionStatsCompletedKey,
+                [NSNumber numberWithUnsignedInteger:_leakedCount], LBConnectionStatsLeakedCountKey,
+                leaked, LBConnectionStatsLeakedKey,
+                concurrency, LBConnectionStatsConcurrencyKey,
+                latencies, LBConnectionStatsLatencyKey,
+                [NSNumber numberWithDouble:now - _statisticsStart], LBConnectionStatsDurationKey,
+                nil];
+    }
+}
+
+- (void)resetStatistics {
+    @synchronized(self) {
+        [self clearStatistics];
+    }
 }
 
 @end
@@ -0,0 +1,76 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ LBSingletonLaunchProfiler records what every LBBaseSingleton subclass costs:
+ how long its initialInit, reusableInit and deferrableInit took, how long its
+ resets take, and where in the app it was first touched. It's meant for
+ answering "which singletons are slowing down app launch?"
+ 
+ Profiling is off by default and costs a single BOOL check per singleton
+ lifecycle event when off. Because singletons tend to be created very early,
+ turn it on before anything touches a singleton, either by calling
+ [LBSingletonLaunchProfiler setEnabled:YES] at the top of main(), or by setting
+ the LB_PROFILE_SINGLETONS environment variable to 1 in your scheme. Then, once
+ your first screen is up, dump the report:
+ 
+   LBLogRaw(@"%@", [LBSingletonLaunchProfiler launchReport]);
+ 
+ First-access call sites are captured with [NSThread callStackSymbols], which
+ is slow, so don't leave profiling enabled in production builds.
+ 
+ This is deliberately not an LBBaseSingleton itself, since it is called from
+ inside singleton initialization.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+// keys of the per-class dictionaries returned by +entries. durations are
+// NSNumber seconds.
+extern NSString * const LBSingletonProfileClassKey;
+extern NSString * const LBSingletonProfileInitialInitKey;
+extern NSString * const LBSingletonProfileReusableInitKey;
+extern NSString * const LBSingletonProfileDeferrableInitKey;
+extern NSString * const LBSingletonProfileResetCountKey;
+extern NSString * const LBSingletonProfileResetTotalKey;
+extern NSString * const LBSingletonProfileFirstAccessTimeKey; // seconds since profiling was enabled
+extern NSString * const LBSingletonProfileFirstAccessCallSiteKey;
+extern NSString * const LBSingletonProfileFirstAccessOnMainThreadKey;
+
+@interface LBSingletonLaunchProfiler : NSObject
+
++ (void)setEnabled:(BOOL)enabled;
++ (BOOL)isEnabled;
+
+// forget everything recorded so far.
++ (void)clear;
+
+// one dictionary per singleton class, in order of first access.
++ (NSArray *)entries;
+
+// a human readable table of the entries, most expensive first.
++ (NSString *)launchReport;
+
+// called by LBBaseSingleton and the LB_DECLARE_SHARED_INSTANCE_M macro.
++ (void)recordFirstAccessOfClass:(Class)singletonClass;
++ (void)recordDuration:(NSTimeInterval)duration forPhase:(NSString *)phaseKey ofClass:(Class)singletonClass;
++ (void)recordResetDuration:(NSTimeInterval)duration ofClass:(Class)singletonClass;
+
+@end
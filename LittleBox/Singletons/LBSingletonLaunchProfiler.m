@@ -0,0 +1,177 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#import "LBSingletonLaunchProfiler.h"
+#import "LBUtils.h"
+
+NSString * const LBSingletonProfileClassKey = @"class";
+NSString * const LBSingletonProfileInitialInitKey = @"initialInit";
+NSString * const LBSingletonProfileReusableInitKey = @"reusableInit";
+NSString * const LBSingletonProfileDeferrableInitKey = @"deferrableInit";
+NSString * const LBSingletonProfileResetCountKey = @"resetCount";
+NSString * const LBSingletonProfileResetTotalKey = @"resetTotal";
+NSString * const LBSingletonProfileFirstAccessTimeKey = @"firstAccessTime";
+NSString * const LBSingletonProfileFirstAccessCallSiteKey = @"firstAccessCallSite";
+NSString * const LBSingletonProfileFirstAccessOnMainThreadKey = @"firstAccessOnMainThread";
+
+static BOOL _enabled = NO;
+static NSTimeInterval _enabledAt = 0.0;
+static NSMutableArray *_entries = nil; // of NSMutableDictionary, in order of first access
+static NSMutableDictionary *_entriesByClass = nil; // class name -> entry
+
+@implementation LBSingletonLaunchProfiler
+
++ (void)load {
+    // +load runs before main(), so the environment variable catches even the
+    // earliest singletons.
+    char *env = getenv("LB_PROFILE_SINGLETONS");
+    if (env && atoi(env) != 0) {
+        [self setEnabled:YES];
+    }
+}
+
++ (void)setEnabled:(BOOL)enabled {
+    @synchronized(self) {
+        if (enabled && !_enabled) {
+            _enabledAt = [LBUtils monotonicTime];
+        }
+        _enabled = enabled;
+    }
+}
+
++ (BOOL)isEnabled {
+    return _enabled;
+}
+
++ (void)clear {
+    @synchronized(self) {
+        _entries = nil;
+        _entriesByClass = nil;
+        _enabledAt = [LBUtils monotonicTime];
+    }
+}
+
++ (NSMutableDictionary *)entryForClass:(Class)singletonClass {
+    // must be called while synchronized on self
+    if (!_entries) {
+        _entries = [NSMutableArray array];
+        _entriesByClass = [NSMutableDictionary dictionary];
+    }
+    NSString *className = NSStringFromClass(singletonClass);
+    NSMutableDictionary *entry = [_entriesByClass objectForKey:className];
+    if (!entry) {
+        entry = [NSMutableDictionary dictionaryWithObject:className forKey:LBSingletonProfileClassKey];
+        [_entriesByClass setObject:entry forKey:className];
+        [_entries addObject:entry];
+    }
+    return entry;
+}
+
++ (void)recordFirstAccessOfClass:(Class)singletonClass {
+    if (!_enabled) return;
+    // frame 0 is this method, frame 1 is +sharedInstance, frame 2 is whoever
+    // asked for the singleton.
+    NSArray *symbols = [NSThread callStackSymbols];
+    NSString *callSite = ([symbols count] > 2) ? [symbols objectAtIndex:2] : @"?";
+    NSTimeInterval now = [LBUtils monotonicTime];
+    BOOL onMainThread = [NSThread isMainThread];
+    @synchronized(self) {
+        NSMutableDictionary *entry = [self entryForClass:singletonClass];
+        if (![entry objectForKey:LBSingletonProfileFirstAccessTimeKey]) {
+            [entry setObject:[NSNumber numberWithDouble:(now - _enabledAt)] forKey:LBSingletonProfileFirstAccessTimeKey];
+            [entry setObject:callSite forKey:LBSingletonProfileFirstAccessCallSiteKey];
+            [entry setObject:[NSNumber numberWithBool:onMainThread] forKey:LBSingletonProfileFirstAccessOnMainThreadKey];
+        }
+    }
+}
+
++ (void)recordDuration:(NSTimeInterval)duration forPhase:(NSString *)phaseKey ofClass:(Class)singletonClass {
+    if (!_enabled) return;
+    @synchronized(self) {
+        NSMutableDictionary *entry = [self entryForClass:singletonClass];
+        // phases can run more than once (reusableInit and deferrableInit run
+        // again on every reset), only the first run counts toward launch.
+        if (![entry objectForKey:phaseKey]) {
+            [entry setObject:[NSNumber numberWithDouble:duration] forKey:phaseKey];
+        }
+    }
+}
+
++ (void)recordResetDuration:(NSTimeInterval)duration ofClass:(Class)singletonClass {
+    if (!_enabled) return;
+    @synchronized(self) {
+        NSMutableDictionary *entry = [self entryForClass:singletonClass];
+        int count = [[entry objectForKey:LBSingletonProfileResetCountKey] intValue];
+        double total = [[entry objectForKey:LBSingletonProfileResetTotalKey] doubleValue];
+        [entry setObject:[NSNumber numberWithInt:(count + 1)] forKey:LBSingletonProfileResetCountKey];
+        [entry setObject:[NSNumber numberWithDouble:(total + duration)] forKey:LBSingletonProfileResetTotalKey];
+    }
+}
+
++ (NSArray *)entries {
+    NSMutableArray *copies = [NSMutableArray array];
+    @synchronized(self) {
+        for (NSDictionary *entry in _entries) {
+            [copies addObject:[NSDictionary dictionaryWithDictionary:entry]];
+        }
+    }
+    return copies;
+}
+
++ (NSTimeInterval)launchCostOfEntry:(NSDictionary *)entry {
+    return [[entry objectForKey:LBSingletonProfileInitialInitKey] doubleValue] +
+           [[entry objectForKey:LBSingletonProfileReusableInitKey] doubleValue];
+}
+
++ (NSString *)launchReport {
+    NSArray *sorted = [[self entries] sortedArrayUsingComparator:^NSComparisonResult(id obj1, id obj2) {
+        NSTimeInterval cost1 = [self launchCostOfEntry:obj1];
+        NSTimeInterval cost2 = [self launchCostOfEntry:obj2];
+        if (cost1 < cost2) return (NSComparisonResult)NSOrderedDescending;
+        if (cost1 > cost2) return (NSComparisonResult)NSOrderedAscending;
+        return (NSComparisonResult)NSOrderedSame;
+    }];
+    NSTimeInterval total = 0.0;
+    for (NSDictionary *entry in sorted) {
+        total += [self launchCostOfEntry:entry];
+    }
+    NSMutableString *report = [NSMutableString stringWithFormat:@"LBBaseSingleton launch report: %d singletons, %.2f ms synchronous init\n",
+                               (int)[sorted count], total * 1000.0];
+    for (NSDictionary *entry in sorted) {
+        [report appendFormat:@"%8.2f ms  %@ (initialInit %.2f, reusableInit %.2f, deferrableInit %.2f",
+         [self launchCostOfEntry:entry] * 1000.0,
+         [entry objectForKey:LBSingletonProfileClassKey],
+         [[entry objectForKey:LBSingletonProfileInitialInitKey] doubleValue] * 1000.0,
+         [[entry objectForKey:LBSingletonProfileReusableInitKey] doubleValue] * 1000.0,
+         [[entry objectForKey:LBSingletonProfileDeferrableInitKey] doubleValue] * 1000.0];
+        int resets = [[entry objectForKey:LBSingletonProfileResetCountKey] intValue];
+        if (resets > 0) {
+            [report appendFormat:@", %d resets %.2f ms", resets, [[entry objectForKey:LBSingletonProfileResetTotalKey] doubleValue] * 1000.0];
+        }
+        [report appendString:@")\n"];
+        if ([entry objectForKey:LBSingletonProfileFirstAccessTimeKey]) {
+            [report appendFormat:@"            first accessed at +%.1f ms%@ from: %@\n",
+             [[entry objectForKey:LBSingletonProfileFirstAccessTimeKey] doubleValue] * 1000.0,
+             [[entry objectForKey:LBSingletonProfileFirstAccessOnMainThreadKey] boolValue] ? @"" : @" (background thread)",
+             [entry objectForKey:LBSingletonProfileFirstAccessCallSiteKey]];
+        }
+    }
+    return report;
+}
+
+@end
@@ -35,6 +35,19 @@
  initialInit() method to either (a) turn off registration with this class, or
  (b) adjust the resetOrder to one of the values of the LBResetOrderGroup enum.
  
+ Each order group is a barrier: every singleton in a group finishes resetting
+ before any singleton in the next group starts. Within a group, singletons are
+ reset concurrently. Those with resetOnMainThread == YES (the default, see
+ LBBaseSingleton) run on the main thread, the rest run on a background worker
+ queue. A singleton may also list resetDependencies, which are classes in the
+ same group that must finish resetting before it starts. Dependencies on
+ singletons in a later group can't be honored and are logged and ignored, as
+ are dependency cycles (the singletons involved are then reset serially in
+ their normal order).
+ 
+ resetAllSingletons blocks until every singleton has been reset, and records
+ how long each one took in lastResetTimings.
+ 
  */
 
 #import "LBBaseMultiDelegateSingleton.h"
@@ -47,4 +60,10 @@ LB_DECLARE_DELEGATE_PROTOCOL_H(LBResettable)
 - (void)resetAllSingletons;
 + (void)resetAllSingletons;
 
+// per-singleton reset durations from the most recent resetAllSingletons, as a
+// dictionary of class names to NSNumber seconds, and the wall time the whole
+// reset took.
+@property (nonatomic, strong) NSDictionary *lastResetTimings;
+@property (nonatomic, assign) NSTimeInterval lastResetDuration;
+
 @end
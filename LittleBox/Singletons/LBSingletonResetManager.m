@@ -17,6 +17,7 @@
  */
 
 #import "LBSingletonResetManager.h"
+#import "LBUtils.h"
 
 @implementation LBSingletonResetManager
 
@@ -30,12 +31,151 @@ LB_DECLARE_DELEGATE_PROTOCOL_M(LBResettable)
 
 - (void)resetAllSingletons {
     LBLog(@"resetting all singletons!");
-    LB_SEND_MESSAGE_TO_DELEGATES(reset); // BOOM!
-    LBLog(@"all singletons have been reset!");
+    NSTimeInterval start = [LBUtils monotonicTime];
+    NSMutableDictionary *timings = [NSMutableDictionary dictionary];
+    NSArray *groups = [self resetGroups];
+    [self warnAboutUnsatisfiableDependenciesInGroups:groups];
+    for (NSArray *group in groups) {
+        [self resetGroup:group timings:timings]; // BOOM!
+    }
+    self.lastResetTimings = [NSDictionary dictionaryWithDictionary:timings];
+    self.lastResetDuration = [LBUtils monotonicTime] - start;
+    LBLog(@"all singletons have been reset! (%.3fs) %@", self.lastResetDuration, self.lastResetTimings);
 }
 
 + (void)resetAllSingletons {
     [[self sharedInstance] resetAllSingletons];
 }
 
+#pragma mark scheduling
+
+- (NSArray *)resetGroups {
+    // snapshot the registered singletons as an array of groups, one per
+    // distinct order value, in reset order. the snapshot holds strong
+    // references so nothing disappears out from under a reset in progress.
+    NSMutableArray *groups = [NSMutableArray array];
+    @synchronized(self) {
+        NSMutableArray *group = nil;
+        NSNumber *groupOrder = nil;
+        for (LBZeroingWeakContainer *c in self.sortedDelegates) {
+            id delegate = [c weakValue];
+            if (!delegate) continue;
+            NSNumber *order = [self.delegates objectForKey:delegate];
+            if (!group || ![order isEqualToNumber:groupOrder]) {
+                group = [NSMutableArray array];
+                groupOrder = order;
+                [groups addObject:group];
+            }
+            [group addObject:delegate];
+        }
+    }
+    return groups;
+}
+
+- (void)warnAboutUnsatisfiableDependenciesInGroups:(NSArray *)groups {
+    // a singleton can only wait on dependencies in its own group. anything in
+    // a later group is reset after it no matter what.
+    for (NSUInteger i = 0; i < [groups count]; i++) {
+        for (id singleton in [groups objectAtIndex:i]) {
+            for (Class dependency in [self dependenciesOfSingleton:singleton]) {
+                for (NSUInteger j = i + 1; j < [groups count]; j++) {
+                    for (id other in [groups objectAtIndex:j]) {
+                        if ([other isKindOfClass:dependency]) {
+                            LBLog(@"WARNING! %@ declares a reset dependency on %@, which is in a later reset order group. the dependency will be ignored.", NSStringFromClass([singleton class]), NSStringFromClass([other class]));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+- (NSArray *)dependenciesOfSingleton:(id)singleton {
+    if ([singleton respondsToSelector:@selector(resetDependencies)]) {
+        return [singleton resetDependencies];
+    }
+    return nil;
+}
+
+- (BOOL)singletonResetsOnMainThread:(id)singleton {
+    if ([singleton respondsToSelector:@selector(resetOnMainThread)]) {
+        return [singleton resetOnMainThread];
+    }
+    return YES;
+}
+
+- (BOOL)singleton:(id)singleton hasDependencyIn:(NSArray *)pending {
+    for (Class dependency in [self dependenciesOfSingleton:singleton]) {
+        for (id other in pending) {
+            if (other != singleton && [other isKindOfClass:dependency]) return YES;
+        }
+    }
+    return NO;
+}
+
+- (void)resetGroup:(NSArray *)group timings:(NSMutableDictionary *)timings {
+    // peel off "waves" of singletons whose dependencies have all been reset,
+    // and reset each wave concurrently.
+    NSMutableArray *pending = [NSMutableArray arrayWithArray:group];
+    while ([pending count] > 0) {
+        NSMutableArray *wave = [NSMutableArray array];
+        for (id singleton in pending) {
+            if (![self singleton:singleton hasDependencyIn:pending]) {
+                [wave addObject:singleton];
+            }
+        }
+        if ([wave count] == 0) {
+            LBLog(@"WARNING! reset dependency cycle among %@, resetting them serially", pending);
+            for (id singleton in pending) {
+                [self resetWave:[NSArray arrayWithObject:singleton] timings:timings];
+            }
+            return;
+        }
+        [self resetWave:wave timings:timings];
+        for (id singleton in wave) {
+            [pending removeObjectIdenticalTo:singleton];
+        }
+    }
+}
+
+- (void)resetWave:(NSArray *)wave timings:(NSMutableDictionary *)timings {
+    // background-safe singletons go to the worker pool, the rest run on the
+    // main thread while the workers are busy. either way this doesn't return
+    // until the whole wave is done.
+    NSMutableArray *mainThreadSingletons = [NSMutableArray array];
+    dispatch_group_t backgroundResets = dispatch_group_create();
+    dispatch_queue_t workers = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0);
+    for (id singleton in wave) {
+        if ([self singletonResetsOnMainThread:singleton]) {
+            [mainThreadSingletons addObject:singleton];
+        } else {
+            dispatch_group_async(backgroundResets, workers, ^{
+                [self resetSingleton:singleton timings:timings];
+            });
+        }
+    }
+    if ([mainThreadSingletons count] > 0) {
+        void (^resetOnMain)(void) = ^{
+            for (id singleton in mainThreadSingletons) {
+                [self resetSingleton:singleton timings:timings];
+            }
+        };
+        if ([NSThread isMainThread]) {
+            resetOnMain();
+        } else {
+            dispatch_sync(dispatch_get_main_queue(), resetOnMain);
+        }
+    }
+    dispatch_group_wait(backgroundResets, DISPATCH_TIME_FOREVER);
+}
+
+- (void)resetSingleton:(id<LBResettable>)singleton timings:(NSMutableDictionary *)timings {
+    NSTimeInterval start = [LBUtils monotonicTime];
+    [singleton reset];
+    NSTimeInterval duration = [LBUtils monotonicTime] - start;
+    @synchronized(timings) {
+        [timings setObject:[NSNumber numberWithDouble:duration] forKey:NSStringFromClass([singleton class])];
+    }
+}
+
 @end
@@ -0,0 +1,66 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ LBTextMeasurementCache remembers how big text comes out in a given font,
+ width and line break mode, so that sizing labels and text views for every
+ table cell on every layout pass doesn't redo the same text layout over and
+ over. LBUtils autoAdjustHeightForUnlimitedLinesUILabel: and friends go
+ through it.
+ 
+ Measurements are keyed by the text itself (hashed, but compared in full, so
+ two texts never share an answer), the font's name and point size, the size
+ it's constrained to, and the line break mode. They are kept in an NSCache
+ bounded by totalCostLimit characters of text, which also lets go of them
+ under memory pressure.
+ 
+ The whole cache is dropped when the preferred text size changes (on iOS
+ versions that have Dynamic Type) and when the singleton is reset.
+ 
+ sizeOfText: may be called from any thread, which is what
+ measureTexts:...completion: does to have a whole screenful of text measured
+ on a background queue before it's displayed. Text view measurement goes
+ through the view itself and so is main thread only.
+ 
+ */
+
+#import <UIKit/UIKit.h>
+#import "LBBaseSingleton.h"
+
+@interface LBTextMeasurementCache : LBBaseSingleton
+
+LB_DECLARE_SHARED_INSTANCE_H(LBTextMeasurementCache)
+
+// in characters of cached text, defaults to 256K
+@property (nonatomic, assign) NSUInteger totalCostLimit;
+
+// same as -[NSString sizeWithFont:constrainedToSize:lineBreakMode:]
+- (CGSize)sizeOfText:(NSString *)text font:(UIFont *)font constrainedToSize:(CGSize)size lineBreakMode:(NSLineBreakMode)lineBreakMode;
+
+// same as -[UITextView sizeThatFits:] with the text view's current text,
+// font, attributed text and insets. main thread only.
+- (CGSize)sizeOfTextView:(UITextView *)textView fittingSize:(CGSize)size;
+
+// measures whichever of the texts aren't cached yet on a background queue,
+// then calls completion (if any) on the main thread.
+- (void)measureTexts:(NSArray *)texts font:(UIFont *)font constrainedToSize:(CGSize)size lineBreakMode:(NSLineBreakMode)lineBreakMode completion:(void (^)(void))completion;
+
+- (void)removeAllMeasurements;
+
+@end
@@ -0,0 +1,181 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#import "LBTextMeasurementCache.h"
+
+// a measurement's cache key. text views get a lineBreakMode of -1, since their
+// layout isn't the same as plain text's, plus whatever else about the view
+// changes its fitting size (see layoutOfTextView:), compared with isEqual:.
+@interface LBTextMeasurementKey : NSObject <NSCopying> {
+    NSString *_text;
+    NSString *_fontName;
+    CGFloat _pointSize;
+    CGSize _size;
+    NSInteger _lineBreakMode;
+    id _layout;
+    NSUInteger _hash;
+}
+- (id)initWithText:(NSString *)text font:(UIFont *)font size:(CGSize)size lineBreakMode:(NSInteger)lineBreakMode layout:(id)layout;
+@end
+
+@implementation LBTextMeasurementKey
+
+- (id)initWithText:(NSString *)text font:(UIFont *)font size:(CGSize)size lineBreakMode:(NSInteger)lineBreakMode layout:(id)layout {
+    if ((self = [super init])) {
+        _text = [text copy];
+        _fontName = [font.fontName copy];
+        _pointSize = font.pointSize;
+        _size = size;
+        _lineBreakMode = lineBreakMode;
+        _layout = layout;
+        // the text's hash is the expensive part, so the combination is worked out once
+        NSUInteger hash = [_text hash];
+        hash = hash * 31 + [_fontName hash];
+        hash = hash * 31 + (NSUInteger)(_pointSize * 64);
+        hash = hash * 31 + (NSUInteger)(_size.width * 64);
+        hash = hash * 31 + (NSUInteger)(_size.height * 64);
+        hash = hash * 31 + (NSUInteger)_lineBreakMode;
+        _hash = hash * 31 + [_layout hash];
+    }
+    return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    // immutable
+    return self;
+}
+
+- (NSUInteger)hash {
+    return _hash;
+}
+
+- (BOOL)isEqual:(id)object {
+    if (object == self) return YES;
+    if (![object isKindOfClass:[LBTextMeasurementKey class]]) return NO;
+    LBTextMeasurementKey *other = object;
+    return _hash == other->_hash
+        && _pointSize == other->_pointSize
+        && CGSizeEqualToSize(_size, other->_size)
+        && _lineBreakMode == other->_lineBreakMode
+        && [_fontName isEqualToString:other->_fontName]
+        && [_text isEqualToString:other->_text]
+        && (_layout == other->_layout || [_layout isEqual:other->_layout]);
+}
+
+- (NSUInteger)cost {
+    return [_text length];
+}
+
+@end
+
+@interface LBTextMeasurementCache ()
+@property (nonatomic, strong) NSCache *measurements;
+@end
+
+@implementation LBTextMeasurementCache
+
+LB_DECLARE_SHARED_INSTANCE_M(LBTextMeasurementCache)
+
+- (void)initialInit {
+    [super initialInit];
+    self.measurements = [[NSCache alloc] init];
+    self.totalCostLimit = 256 * 1024;
+}
+
+- (void)reusableInit {
+    [super reusableInit];
+    // by name, since the constant only exists from iOS 7 on
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(contentSizeCategoryDidChange:)
+                                                 name:@"UIContentSizeCategoryDidChangeNotification"
+                                               object:nil];
+}
+
+- (void)reusableTeardown {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    [self removeAllMeasurements];
+    [super reusableTeardown];
+}
+
+- (void)setTotalCostLimit:(NSUInteger)totalCostLimit {
+    _totalCostLimit = totalCostLimit;
+    self.measurements.totalCostLimit = totalCostLimit;
+}
+
+- (void)contentSizeCategoryDidChange:(NSNotification *)notification {
+    [self removeAllMeasurements];
+}
+
+- (void)removeAllMeasurements {
+    [self.measurements removeAllObjects];
+}
+
+#pragma mark measuring
+
+- (CGSize)cachedSizeForKey:(LBTextMeasurementKey *)key measuredBy:(CGSize (^)(void))measure {
+    NSValue *cached = [self.measurements objectForKey:key];
+    if (cached) return [cached CGSizeValue];
+    CGSize size = measure();
+    [self.measurements setObject:[NSValue valueWithCGSize:size] forKey:key cost:[key cost]];
+    return size;
+}
+
+- (CGSize)sizeOfText:(NSString *)text font:(UIFont *)font constrainedToSize:(CGSize)size lineBreakMode:(NSLineBreakMode)lineBreakMode {
+    if (!text || !font) return CGSizeZero;
+    LBTextMeasurementKey *key = [[LBTextMeasurementKey alloc] initWithText:text font:font size:size lineBreakMode:lineBreakMode layout:nil];
+    return [self cachedSizeForKey:key measuredBy:^CGSize{
+        return [text sizeWithFont:font constrainedToSize:size lineBreakMode:lineBreakMode];
+    }];
+}
+
+// everything besides text, font and size that a text view's sizeThatFits:
+// depends on: its attributed text (attributes and all), content inset, and on
+// iOS 7 its text container inset and line fragment padding
+- (NSArray *)layoutOfTextView:(UITextView *)textView {
+    NSMutableArray *layout = [NSMutableArray arrayWithCapacity:4];
+    NSAttributedString *attributedText = [textView respondsToSelector:@selector(attributedText)] ? [textView.attributedText copy] : nil;
+    [layout addObject:(attributedText ? attributedText : [NSNull null])];
+    [layout addObject:[NSValue valueWithUIEdgeInsets:textView.contentInset]];
+    if ([textView respondsToSelector:NSSelectorFromString(@"textContainerInset")]) {
+        [layout addObject:[textView valueForKey:@"textContainerInset"]];
+        [layout addObject:[textView valueForKeyPath:@"textContainer.lineFragmentPadding"]];
+    }
+    return layout;
+}
+
+- (CGSize)sizeOfTextView:(UITextView *)textView fittingSize:(CGSize)size {
+    if (!textView.text || !textView.font) return [textView sizeThatFits:size];
+    LBTextMeasurementKey *key = [[LBTextMeasurementKey alloc] initWithText:textView.text font:textView.font size:size lineBreakMode:-1
+                                                                    layout:[self layoutOfTextView:textView]];
+    return [self cachedSizeForKey:key measuredBy:^CGSize{
+        return [textView sizeThatFits:size];
+    }];
+}
+
+- (void)measureTexts:(NSArray *)texts font:(UIFont *)font constrainedToSize:(CGSize)size lineBreakMode:(NSLineBreakMode)lineBreakMode completion:(void (^)(void))completion {
+    NSArray *snapshot = [texts copy];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        for (NSString *text in snapshot) {
+            if (![text isKindOfClass:[NSString class]]) continue;
+            [self sizeOfText:text font:font constrainedToSize:size lineBreakMode:lineBreakMode];
+        }
+        if (completion) dispatch_async(dispatch_get_main_queue(), completion);
+    });
+}
+
+@end
@@ -0,0 +1,100 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ LBThumbnailService makes square thumbnails (cropped the way LBUtils
+ squareCroppedImageFromImage:withSize: crops) for many images at once, off the
+ main thread, and caches them.
+ 
+ Sources can be file NSURLs, NSString paths, NSData of an encoded image, or
+ UIImages. Files and data are decoded with ImageIO straight to roughly the
+ needed size (a JPEG decodes at a fraction of its full resolution), which is
+ where most of the time and memory go when done one by one on the main thread.
+ 
+ Work runs on up to maxConcurrentDecodes threads, but only as much at a time as
+ fits in maxWorkingSetBytes of estimated decode buffers; the rest waits its
+ turn. A single job bigger than the whole budget still runs, on its own.
+ 
+ Results are cached by (source identity, dimension):
+ 
+ - in memory, least recently used first out once memoryCacheByteLimit is
+   reached, and all of it on a memory warning.
+ - on disk in diskCachePath, as PNGs, trimmed oldest first down to
+   diskCacheByteLimit. UIImage sources skip the disk cache, since they have no
+   identity that survives a relaunch.
+ 
+ A file's identity is its path, modification date and size, so a replaced file
+ gets new thumbnails. NSData is identified by a SHA-1 of its bytes, a UIImage by
+ the object itself for as long as it lives.
+ 
+ Asking for a thumbnail that's already being made doesn't make it twice; the
+ second caller is simply called back with the first one's result.
+ 
+ Completion blocks are always called asynchronously on the main thread, with
+ nil (or NSNull, in the array version) for sources that couldn't be decoded.
+ 
+ Resetting the singleton (e.g. on logout) empties both caches, forgets the
+ statistics, and calls back anything still in flight with nil.
+ 
+ */
+
+#import <UIKit/UIKit.h>
+#import "LBBaseSingleton.h"
+
+typedef struct {
+    NSUInteger requests;
+    NSUInteger memoryHits;
+    NSUInteger diskHits;
+    NSUInteger coalesced; // joined an identical request already in flight
+    NSUInteger generated;
+    NSUInteger failures;
+} LBThumbnailStatistics;
+
+@interface LBThumbnailService : LBBaseSingleton
+
+LB_DECLARE_SHARED_INSTANCE_H(LBThumbnailService)
+
+// defaults to the number of cores
+@property (nonatomic, assign) NSUInteger maxConcurrentDecodes;
+// defaults to 32MB
+@property (nonatomic, assign) unsigned long long maxWorkingSetBytes;
+// defaults to 8MB, measured as decoded pixel bytes
+@property (nonatomic, assign) unsigned long long memoryCacheByteLimit;
+// defaults to Library/Caches/LBThumbnails. nil turns the disk cache off.
+@property (nonatomic, copy) NSString *diskCachePath;
+// defaults to 50MB
+@property (nonatomic, assign) unsigned long long diskCacheByteLimit;
+
+// dimension is in points, as with squareCroppedImageFromImage:withSize:
+- (void)thumbnailForSource:(id)source dimension:(int)dimension completion:(void (^)(UIImage *thumbnail))completion;
+// one callback once all are done, thumbnails in the same order as the sources
+- (void)thumbnailsForSources:(NSArray *)sources dimension:(int)dimension completion:(void (^)(NSArray *thumbnails))completion;
+
+// memory cache only, and synchronous, e.g. for configuring a table cell before
+// falling back to thumbnailForSource:
+- (UIImage *)cachedThumbnailForSource:(id)source dimension:(int)dimension;
+
+- (void)removeAllCachedThumbnails;
+
+- (LBThumbnailStatistics)statistics;
+// (memory hits + disk hits) / requests, 0 before any request
+- (double)hitRate;
+- (void)resetStatistics;
+
+@end
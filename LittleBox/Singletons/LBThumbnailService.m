@@ -0,0 +1,579 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#import "LBThumbnailService.h"
+#import <ImageIO/ImageIO.h>
+#import <sys/stat.h>
+#import "LBHMAC.h"
+#import "LBUtils.h"
+#import "LBWeakKeyTable.h"
+
+// a node of the memory cache's recency list, most recently used at the head
+@interface LBThumbnailCacheEntry : NSObject
+@property (nonatomic, copy) NSString *key;
+@property (nonatomic, strong) UIImage *image;
+@property (nonatomic, assign) unsigned long long cost;
+@property (nonatomic, strong) LBThumbnailCacheEntry *next;
+@property (nonatomic, weak) LBThumbnailCacheEntry *previous;
+@end
+
+@implementation LBThumbnailCacheEntry
+@end
+
+@interface LBThumbnailService () {
+    LBThumbnailStatistics _statistics;
+    // bumped by reset, so work started before it doesn't report back after it
+    NSUInteger _generation;
+    // bumped whenever the disk cache is wiped, so a thumbnail made before
+    // that isn't written into the fresh directory after it
+    NSUInteger _diskGeneration;
+    unsigned long long _memoryCacheBytes;
+    unsigned long long _workingSetBytes;
+    unsigned long long _diskBytesSinceTrim;
+    CGFloat _screenScale;
+}
+@property (nonatomic, strong) NSOperationQueue *workQueue;
+// computes cache keys, which can mean hashing a big NSData, off the caller's thread
+@property (nonatomic, strong) dispatch_queue_t intakeQueue;
+// creates, trims and deletes the disk cache directory, in order
+@property (nonatomic, strong) dispatch_queue_t diskQueue;
+@property (nonatomic, strong) NSCondition *workingSetCondition;
+@property (nonatomic, strong) NSMutableDictionary *memoryEntries;
+@property (nonatomic, strong) LBThumbnailCacheEntry *mostRecentEntry;
+@property (nonatomic, strong) LBThumbnailCacheEntry *leastRecentEntry;
+// cache key -> NSMutableArray of completion blocks waiting on it
+@property (nonatomic, strong) NSMutableDictionary *inFlight;
+// UIImage -> identity string, for as long as the image lives
+@property (nonatomic, strong) LBWeakKeyTable *imageIdentities;
+@end
+
+static NSString *hexSHA1(const void *bytes, size_t length) {
+    uint8_t digest[LB_SHA1_DIGEST_LENGTH];
+    LBHash(LBHashSHA1, bytes, length, digest);
+    char hex[LB_SHA1_DIGEST_LENGTH * 2 + 1];
+    for (size_t i = 0; i < LB_SHA1_DIGEST_LENGTH; i++) {
+        snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+    }
+    return [NSString stringWithUTF8String:hex];
+}
+
+@implementation LBThumbnailService
+
+LB_DECLARE_SHARED_INSTANCE_M(LBThumbnailService)
+
+- (void)initialInit {
+    [super initialInit];
+    // creating the disk cache directory can wait until someone wants a thumbnail
+    self.defersActivation = YES;
+    _screenScale = [[UIScreen mainScreen] scale];
+    self.workQueue = [[NSOperationQueue alloc] init];
+    self.maxConcurrentDecodes = [[NSProcessInfo processInfo] activeProcessorCount];
+    self.maxWorkingSetBytes = 32 * 1024 * 1024;
+    self.memoryCacheByteLimit = 8 * 1024 * 1024;
+    self.diskCacheByteLimit = 50 * 1024 * 1024;
+    NSString *caches = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+    self.diskCachePath = [caches stringByAppendingPathComponent:@"LBThumbnails"];
+    self.intakeQueue = dispatch_queue_create("LBThumbnailService.intake", DISPATCH_QUEUE_SERIAL);
+    self.diskQueue = dispatch_queue_create("LBThumbnailService.disk", DISPATCH_QUEUE_SERIAL);
+    self.workingSetCondition = [[NSCondition alloc] init];
+}
+
+- (void)reusableInit {
+    [super reusableInit];
+    @synchronized(self) {
+        self.memoryEntries = [NSMutableDictionary dictionary];
+        self.inFlight = [NSMutableDictionary dictionary];
+        self.imageIdentities = [LBWeakKeyTable table];
+    }
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(didReceiveMemoryWarning:)
+                                                 name:UIApplicationDidReceiveMemoryWarningNotification
+                                               object:nil];
+}
+
+- (void)deferrableInit {
+    NSString *path = self.diskCachePath;
+    if (!path) return;
+    dispatch_async(self.diskQueue, ^{
+        [[NSFileManager defaultManager] createDirectoryAtPath:path withIntermediateDirectories:YES attributes:nil error:NULL];
+        [self trimDiskCacheAtPath:path];
+    });
+}
+
+- (void)reusableTeardown {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    NSDictionary *inFlight;
+    @synchronized(self) {
+        _generation++;
+        inFlight = self.inFlight;
+        self.inFlight = nil;
+        [self removeAllMemoryEntries];
+        self.memoryEntries = nil;
+        self.imageIdentities = nil;
+        memset(&_statistics, 0, sizeof(_statistics));
+    }
+    // whatever was still being made won't be delivered now, see finishKey:
+    for (NSArray *waiters in [inFlight allValues]) {
+        [self deliverThumbnail:nil toWaiters:waiters];
+    }
+    [self removeDiskCache];
+    [super reusableTeardown];
+}
+
+- (void)setMaxConcurrentDecodes:(NSUInteger)maxConcurrentDecodes {
+    _maxConcurrentDecodes = MAX(maxConcurrentDecodes, (NSUInteger)1);
+    self.workQueue.maxConcurrentOperationCount = _maxConcurrentDecodes;
+}
+
+#pragma mark requests
+
+- (void)thumbnailForSource:(id)source dimension:(int)dimension completion:(void (^)(UIImage *thumbnail))completion {
+    [self activateIfNeeded];
+    void (^callback)(UIImage *) = completion ? [completion copy] : ^(UIImage *thumbnail) {};
+    dispatch_async(self.intakeQueue, ^{
+        [self requestThumbnailForSource:source dimension:dimension completion:callback];
+    });
+}
+
+- (void)thumbnailsForSources:(NSArray *)sources dimension:(int)dimension completion:(void (^)(NSArray *thumbnails))completion {
+    NSUInteger count = [sources count];
+    NSMutableArray *thumbnails = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [thumbnails addObject:[NSNull null]];
+    }
+    if (!count) {
+        if (completion) dispatch_async(dispatch_get_main_queue(), ^{ completion(thumbnails); });
+        return;
+    }
+    __block NSUInteger remaining = count;
+    [sources enumerateObjectsUsingBlock:^(id source, NSUInteger index, BOOL *stop) {
+        [self thumbnailForSource:source dimension:dimension completion:^(UIImage *thumbnail) {
+            // always on the main thread, so no locking needed
+            if (thumbnail) [thumbnails replaceObjectAtIndex:index withObject:thumbnail];
+            if (--remaining == 0 && completion) completion(thumbnails);
+        }];
+    }];
+}
+
+- (UIImage *)cachedThumbnailForSource:(id)source dimension:(int)dimension {
+    NSString *key = [self keyForSource:source dimension:dimension];
+    if (!key) return nil;
+    @synchronized(self) {
+        return [self memoryCachedThumbnailForKey:key];
+    }
+}
+
+// on the intake queue
+- (void)requestThumbnailForSource:(id)source dimension:(int)dimension completion:(void (^)(UIImage *thumbnail))completion {
+    NSString *key = [self keyForSource:source dimension:dimension];
+    UIImage *cached = nil;
+    BOOL start = NO;
+    NSUInteger generation;
+    @synchronized(self) {
+        _statistics.requests++;
+        generation = _generation;
+        if (!key) {
+            _statistics.failures++;
+        } else if (!self.inFlight) {
+            // torn down and not yet reinitialized, nothing would finish it
+        } else if ((cached = [self memoryCachedThumbnailForKey:key])) {
+            _statistics.memoryHits++;
+        } else {
+            NSMutableArray *waiters = [self.inFlight objectForKey:key];
+            if (waiters) {
+                _statistics.coalesced++;
+            } else {
+                waiters = [NSMutableArray array];
+                [self.inFlight setObject:waiters forKey:key];
+                start = YES;
+            }
+            [waiters addObject:completion];
+            completion = nil;
+        }
+    }
+    if (completion) {
+        [self deliverThumbnail:cached toWaiters:[NSArray arrayWithObject:completion]];
+    }
+    if (start) {
+        [self.workQueue addOperationWithBlock:^{
+            [self makeThumbnailForSource:source key:key dimension:dimension generation:generation];
+        }];
+    }
+}
+
+- (void)deliverThumbnail:(UIImage *)thumbnail toWaiters:(NSArray *)waiters {
+    dispatch_async(dispatch_get_main_queue(), ^{
+        for (void (^waiter)(UIImage *) in waiters) {
+            waiter(thumbnail);
+        }
+    });
+}
+
+#pragma mark identity
+
+- (NSURL *)fileURLForSource:(id)source {
+    if ([source isKindOfClass:[NSURL class]]) return [source isFileURL] ? source : nil;
+    if ([source isKindOfClass:[NSString class]]) return [NSURL fileURLWithPath:source];
+    return nil;
+}
+
+- (NSString *)identityForSource:(id)source {
+    if ([source isKindOfClass:[UIImage class]]) {
+        @synchronized(self) {
+            NSString *identity = [self.imageIdentities objectForKey:source];
+            if (!identity) {
+                identity = [@"image:" stringByAppendingString:[LBUtils generateGUID]];
+                [self.imageIdentities setObject:identity forKey:source];
+            }
+            return identity;
+        }
+    }
+    if ([source isKindOfClass:[NSData class]]) {
+        return [@"data:" stringByAppendingString:hexSHA1([source bytes], [source length])];
+    }
+    NSURL *url = [self fileURLForSource:source];
+    struct stat info;
+    if (!url || stat([[url path] fileSystemRepresentation], &info) != 0) return nil;
+    return [NSString stringWithFormat:@"file:%@:%lld.%09ld:%lld", [url path],
+            (long long)info.st_mtimespec.tv_sec, (long)info.st_mtimespec.tv_nsec, (long long)info.st_size];
+}
+
+- (size_t)pixelSizeForDimension:(int)dimension {
+    return (size_t)(dimension * _screenScale + 0.5);
+}
+
+- (NSString *)keyForSource:(id)source dimension:(int)dimension {
+    if (!source || dimension <= 0) return nil;
+    NSString *identity = [self identityForSource:source];
+    if (!identity) return nil;
+    return [NSString stringWithFormat:@"%@|%zu", identity, [self pixelSizeForDimension:dimension]];
+}
+
+#pragma mark making thumbnails
+
+// on the work queue
+- (void)makeThumbnailForSource:(id)source key:(NSString *)key dimension:(int)dimension generation:(NSUInteger)generation {
+    NSUInteger diskGeneration;
+    @synchronized(self) {
+        diskGeneration = _diskGeneration;
+    }
+    NSString *diskPath = [source isKindOfClass:[UIImage class]] ? nil : [self diskPathForKey:key];
+    UIImage *thumbnail = nil;
+    if (diskPath) {
+        NSData *data = [NSData dataWithContentsOfFile:diskPath];
+        if (data) thumbnail = [UIImage imageWithData:data scale:_screenScale];
+        if (thumbnail) {
+            // the trim goes by modification date, so this marks it as recently used
+            [[NSFileManager defaultManager] setAttributes:[NSDictionary dictionaryWithObject:[NSDate date] forKey:NSFileModificationDate]
+                                             ofItemAtPath:diskPath
+                                                    error:NULL];
+            [self finishKey:key thumbnail:thumbnail fromDisk:YES generation:generation];
+            return;
+        }
+    }
+    thumbnail = [self generateThumbnailForSource:source dimension:dimension];
+    if (thumbnail && diskPath) {
+        [self writeThumbnail:thumbnail toDiskPath:diskPath diskGeneration:diskGeneration];
+    }
+    [self finishKey:key thumbnail:thumbnail fromDisk:NO generation:generation];
+}
+
+- (void)finishKey:(NSString *)key thumbnail:(UIImage *)thumbnail fromDisk:(BOOL)fromDisk generation:(NSUInteger)generation {
+    NSArray *waiters;
+    @synchronized(self) {
+        // reset already called these waiters back
+        if (generation != _generation) return;
+        waiters = [self.inFlight objectForKey:key];
+        [self.inFlight removeObjectForKey:key];
+        if (!thumbnail) {
+            _statistics.failures++;
+        } else {
+            if (fromDisk) {
+                _statistics.diskHits++;
+            } else {
+                _statistics.generated++;
+            }
+            [self storeMemoryCachedThumbnail:thumbnail forKey:key];
+        }
+    }
+    [self deliverThumbnail:thumbnail toWaiters:waiters];
+}
+
+- (UIImage *)generateThumbnailForSource:(id)source dimension:(int)dimension {
+    size_t outputSize = [self pixelSizeForDimension:dimension];
+    unsigned long long outputBytes = (unsigned long long)outputSize * outputSize * 4;
+
+    if ([source isKindOfClass:[UIImage class]]) {
+        // already decoded, but may need one full size copy of its pixels
+        CGImageRef image = [source CGImage];
+        unsigned long long bytes = outputBytes + (image ? (unsigned long long)CGImageGetWidth(image) * CGImageGetHeight(image) * 4 : 0);
+        [self acquireWorkingSetBytes:bytes];
+        UIImage *thumbnail = [LBUtils squareCroppedImageFromImage:source withSize:dimension];
+        [self releaseWorkingSetBytes:bytes];
+        return thumbnail;
+    }
+
+    CGImageSourceRef imageSource = NULL;
+    if ([source isKindOfClass:[NSData class]]) {
+        imageSource = CGImageSourceCreateWithData((__bridge CFDataRef)source, NULL);
+    } else {
+        NSURL *url = [self fileURLForSource:source];
+        if (url) imageSource = CGImageSourceCreateWithURL((__bridge CFURLRef)url, NULL);
+    }
+    if (!imageSource) return nil;
+
+    // the header alone tells us how big the decode will be
+    size_t width = 0, height = 0;
+    CFDictionaryRef properties = CGImageSourceCopyPropertiesAtIndex(imageSource, 0, NULL);
+    if (properties) {
+        NSDictionary *dict = (__bridge NSDictionary *)properties;
+        width = [[dict objectForKey:(__bridge NSString *)kCGImagePropertyPixelWidth] unsignedLongValue];
+        height = [[dict objectForKey:(__bridge NSString *)kCGImagePropertyPixelHeight] unsignedLongValue];
+        CFRelease(properties);
+    }
+    if (!width || !height) {
+        CFRelease(imageSource);
+        return nil;
+    }
+
+    // decode just big enough that the short side still covers the output
+    size_t shortSide = MIN(width, height);
+    size_t longSide = MAX(width, height);
+    size_t maxPixelSize = MIN(longSide, (size_t)ceil((double)outputSize * longSide / shortSide));
+    unsigned long long bytes = outputBytes + (unsigned long long)maxPixelSize * (maxPixelSize * shortSide / longSide + 1) * 4;
+    NSDictionary *options = [NSDictionary dictionaryWithObjectsAndKeys:
+                             (id)kCFBooleanTrue, (__bridge id)kCGImageSourceCreateThumbnailFromImageAlways,
+                             (id)kCFBooleanTrue, (__bridge id)kCGImageSourceCreateThumbnailWithTransform,
+                             (id)kCFBooleanFalse, (__bridge id)kCGImageSourceShouldCache,
+                             [NSNumber numberWithUnsignedLong:maxPixelSize], (__bridge id)kCGImageSourceThumbnailMaxPixelSize,
+                             nil];
+    [self acquireWorkingSetBytes:bytes];
+    CGImageRef decoded = CGImageSourceCreateThumbnailAtIndex(imageSource, 0, (__bridge CFDictionaryRef)options);
+    UIImage *thumbnail = nil;
+    if (decoded) {
+        // the transform option already applied any EXIF orientation
+        thumbnail = [LBUtils squareCroppedImageFromImage:[UIImage imageWithCGImage:decoded] withSize:dimension];
+        CGImageRelease(decoded);
+    }
+    [self releaseWorkingSetBytes:bytes];
+    CFRelease(imageSource);
+    return thumbnail;
+}
+
+- (void)acquireWorkingSetBytes:(unsigned long long)bytes {
+    [self.workingSetCondition lock];
+    // an oversized job still gets to run once nothing else is
+    while (_workingSetBytes > 0 && _workingSetBytes + bytes > self.maxWorkingSetBytes) {
+        [self.workingSetCondition wait];
+    }
+    _workingSetBytes += bytes;
+    [self.workingSetCondition unlock];
+}
+
+- (void)releaseWorkingSetBytes:(unsigned long long)bytes {
+    [self.workingSetCondition lock];
+    _workingSetBytes -= bytes;
+    [self.workingSetCondition broadcast];
+    [self.workingSetCondition unlock];
+}
+
+#pragma mark memory cache
+
+// these all expect @synchronized(self)
+
+- (void)unlinkEntry:(LBThumbnailCacheEntry *)entry {
+    LBThumbnailCacheEntry *previous = entry.previous;
+    LBThumbnailCacheEntry *next = entry.next;
+    if (previous) previous.next = next; else self.mostRecentEntry = next;
+    if (next) next.previous = previous; else self.leastRecentEntry = previous;
+    entry.next = nil;
+    entry.previous = nil;
+}
+
+- (void)pushEntry:(LBThumbnailCacheEntry *)entry {
+    entry.next = self.mostRecentEntry;
+    self.mostRecentEntry.previous = entry;
+    self.mostRecentEntry = entry;
+    if (!self.leastRecentEntry) self.leastRecentEntry = entry;
+}
+
+- (UIImage *)memoryCachedThumbnailForKey:(NSString *)key {
+    LBThumbnailCacheEntry *entry = [self.memoryEntries objectForKey:key];
+    if (!entry) return nil;
+    if (entry != self.mostRecentEntry) {
+        [self unlinkEntry:entry];
+        [self pushEntry:entry];
+    }
+    return entry.image;
+}
+
+- (void)storeMemoryCachedThumbnail:(UIImage *)thumbnail forKey:(NSString *)key {
+    if (!self.memoryEntries) return;
+    LBThumbnailCacheEntry *entry = [self.memoryEntries objectForKey:key];
+    if (entry) {
+        [self unlinkEntry:entry];
+        _memoryCacheBytes -= entry.cost;
+    } else {
+        entry = [[LBThumbnailCacheEntry alloc] init];
+        entry.key = key;
+        [self.memoryEntries setObject:entry forKey:key];
+    }
+    CGImageRef image = thumbnail.CGImage;
+    entry.image = thumbnail;
+    entry.cost = image ? (unsigned long long)CGImageGetBytesPerRow(image) * CGImageGetHeight(image) : 0;
+    _memoryCacheBytes += entry.cost;
+    [self pushEntry:entry];
+    // never evicts the entry just added, even if it alone is over the limit
+    while (_memoryCacheBytes > self.memoryCacheByteLimit && self.leastRecentEntry != entry) {
+        LBThumbnailCacheEntry *evicted = self.leastRecentEntry;
+        [self unlinkEntry:evicted];
+        [self.memoryEntries removeObjectForKey:evicted.key];
+        _memoryCacheBytes -= evicted.cost;
+    }
+}
+
+- (void)removeAllMemoryEntries {
+    // unlinked one by one so a long list doesn't release recursively
+    while (self.leastRecentEntry) {
+        [self unlinkEntry:self.leastRecentEntry];
+    }
+    [self.memoryEntries removeAllObjects];
+    _memoryCacheBytes = 0;
+}
+
+- (void)didReceiveMemoryWarning:(NSNotification *)notification {
+    @synchronized(self) {
+        [self removeAllMemoryEntries];
+    }
+}
+
+#pragma mark disk cache
+
+- (NSString *)diskPathForKey:(NSString *)key {
+    NSString *path = self.diskCachePath;
+    if (!path) return nil;
+    NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+    NSString *name = [hexSHA1([keyData bytes], [keyData length]) stringByAppendingPathExtension:@"png"];
+    return [path stringByAppendingPathComponent:name];
+}
+
+// encodes on the work queue, writes on the disk queue, in order with the
+// directory's creation, trims and removal
+- (void)writeThumbnail:(UIImage *)thumbnail toDiskPath:(NSString *)diskPath diskGeneration:(NSUInteger)diskGeneration {
+    NSData *data = UIImagePNGRepresentation(thumbnail);
+    if (!data) return;
+    dispatch_async(self.diskQueue, ^{
+        @synchronized(self) {
+            // the cache was wiped (e.g. on logout) after this was started
+            if (diskGeneration != _diskGeneration) return;
+        }
+        NSString *path = [diskPath stringByDeletingLastPathComponent];
+        // the directory may not be there yet if deferrableInit hasn't run
+        [[NSFileManager defaultManager] createDirectoryAtPath:path withIntermediateDirectories:YES attributes:nil error:NULL];
+        if (![data writeToFile:diskPath atomically:YES]) return;
+        BOOL trim = NO;
+        @synchronized(self) {
+            _diskBytesSinceTrim += [data length];
+            // trimming lists the whole directory, so only every so often
+            if (_diskBytesSinceTrim > self.diskCacheByteLimit / 8) {
+                _diskBytesSinceTrim = 0;
+                trim = YES;
+            }
+        }
+        if (trim) [self trimDiskCacheAtPath:path];
+    });
+}
+
+// on the disk queue. deletes the oldest files until the cache is down to 3/4
+// of its limit, so it doesn't need trimming again right away.
+- (void)trimDiskCacheAtPath:(NSString *)path {
+    NSArray *keys = [NSArray arrayWithObjects:NSURLContentModificationDateKey, NSURLTotalFileAllocatedSizeKey, nil];
+    NSArray *files = [[NSFileManager defaultManager] contentsOfDirectoryAtURL:[NSURL fileURLWithPath:path isDirectory:YES]
+                                                   includingPropertiesForKeys:keys
+                                                                      options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                                        error:NULL];
+    unsigned long long total = 0;
+    NSMutableArray *entries = [NSMutableArray arrayWithCapacity:[files count]];
+    for (NSURL *file in files) {
+        NSDictionary *values = [file resourceValuesForKeys:keys error:NULL];
+        NSDate *modified = [values objectForKey:NSURLContentModificationDateKey];
+        NSNumber *size = [values objectForKey:NSURLTotalFileAllocatedSizeKey];
+        if (!modified || !size) continue;
+        total += [size unsignedLongLongValue];
+        [entries addObject:[NSArray arrayWithObjects:modified, size, file, nil]];
+    }
+    unsigned long long limit = self.diskCacheByteLimit;
+    if (total <= limit) return;
+    [entries sortUsingComparator:^NSComparisonResult(NSArray *a, NSArray *b) {
+        return [[a objectAtIndex:0] compare:[b objectAtIndex:0]];
+    }];
+    for (NSArray *entry in entries) {
+        if (total <= limit / 4 * 3) break;
+        if ([[NSFileManager defaultManager] removeItemAtURL:[entry objectAtIndex:2] error:NULL]) {
+            total -= [[entry objectAtIndex:1] unsignedLongLongValue];
+        }
+    }
+}
+
+- (void)removeDiskCache {
+    @synchronized(self) {
+        _diskGeneration++;
+    }
+    NSString *path = self.diskCachePath;
+    if (!path) return;
+    // the directory is recreated (on the same queue) by the next deferrableInit
+    dispatch_async(self.diskQueue, ^{
+        [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+    });
+}
+
+- (void)removeAllCachedThumbnails {
+    @synchronized(self) {
+        [self removeAllMemoryEntries];
+        _diskGeneration++;
+    }
+    NSString *path = self.diskCachePath;
+    if (!path) return;
+    dispatch_async(self.diskQueue, ^{
+        NSFileManager *fileManager = [NSFileManager defaultManager];
+        [fileManager removeItemAtPath:path error:NULL];
+        [fileManager createDirectoryAtPath:path withIntermediateDirectories:YES attributes:nil error:NULL];
+    });
+}
+
+#pragma mark statistics
+
+- (LBThumbnailStatistics)statistics {
+    @synchronized(self) {
+        return _statistics;
+    }
+}
+
+- (double)hitRate {
+    LBThumbnailStatistics statistics = [self statistics];
+    if (!statistics.requests) return 0.0;
+    return (double)(statistics.memoryHits + statistics.diskHits) / statistics.requests;
+}
+
+- (void)resetStatistics {
+    @synchronized(self) {
+        memset(&_statistics, 0, sizeof(_statistics));
+    }
+}
+
+@end
@@ -0,0 +1,572 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#include "LBBase64.h"
+#include <string.h>
+
+#if defined(__aarch64__) || defined(__arm64__)
+#define LB_BASE64_NEON 1
+#include <arm_neon.h>
+#elif (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define LB_BASE64_X86 1
+#include <immintrin.h>
+#endif
+
+static const char kStandardAlphabet[64] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char kURLSafeAlphabet[64] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// char -> 6-bit value, 0xFF for anything outside the alphabet (including "=")
+static const uint8_t kStandardDecodeTable[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+static const uint8_t kURLSafeDecodeTable[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0x3F,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+static const char *alphabetForOptions(LBBase64Options options) {
+    return (options & LBBase64URLSafe) ? kURLSafeAlphabet : kStandardAlphabet;
+}
+
+static const uint8_t *decodeTableForOptions(LBBase64Options options) {
+    return (options & LBBase64URLSafe) ? kURLSafeDecodeTable : kStandardDecodeTable;
+}
+
+#pragma mark - scalar
+
+static void encodeBlocksScalar(const uint8_t *input, size_t length, char *output, const char *alphabet) {
+    for (size_t i = 0; i + 3 <= length; i += 3) {
+        uint32_t word = ((uint32_t)input[i] << 16) | ((uint32_t)input[i + 1] << 8) | input[i + 2];
+        output[0] = alphabet[(word >> 18) & 0x3F];
+        output[1] = alphabet[(word >> 12) & 0x3F];
+        output[2] = alphabet[(word >> 6) & 0x3F];
+        output[3] = alphabet[word & 0x3F];
+        output += 4;
+    }
+}
+
+static bool decodeBlocksScalar(const char *input, size_t blocks, uint8_t *output, const uint8_t *table) {
+    const uint8_t *in = (const uint8_t *)input;
+    for (size_t i = 0; i < blocks; i++) {
+        uint32_t a = table[in[0]], b = table[in[1]], c = table[in[2]], d = table[in[3]];
+        // invalid chars map to 0xFF, so any of them sets bit 7 here
+        if ((a | b | c | d) & 0x80) return false;
+        uint32_t word = (a << 18) | (b << 12) | (c << 6) | d;
+        output[0] = (uint8_t)(word >> 16);
+        output[1] = (uint8_t)(word >> 8);
+        output[2] = (uint8_t)word;
+        in += 4;
+        output += 3;
+    }
+    return true;
+}
+
+#pragma mark - NEON
+
+#if LB_BASE64_NEON
+
+static uint8x16x4_t loadTable64(const uint8_t *table) {
+    uint8x16x4_t result;
+    result.val[0] = vld1q_u8(table);
+    result.val[1] = vld1q_u8(table + 16);
+    result.val[2] = vld1q_u8(table + 32);
+    result.val[3] = vld1q_u8(table + 48);
+    return result;
+}
+
+// 48 bytes in, 64 chars out per iteration. returns the bytes consumed.
+static size_t encodeBlocksNEON(const uint8_t *input, size_t length, char *output, const char *alphabet) {
+    uint8x16x4_t lut = loadTable64((const uint8_t *)alphabet);
+    uint8x16_t mask6 = vdupq_n_u8(0x3F);
+    size_t done = 0;
+    while (length - done >= 48) {
+        // de-interleave so each register holds one byte of every 3-byte group
+        uint8x16x3_t in = vld3q_u8(input + done);
+        uint8x16x4_t indices;
+        indices.val[0] = vshrq_n_u8(in.val[0], 2);
+        indices.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask6);
+        indices.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask6);
+        indices.val[3] = vandq_u8(in.val[2], mask6);
+        uint8x16x4_t out;
+        out.val[0] = vqtbl4q_u8(lut, indices.val[0]);
+        out.val[1] = vqtbl4q_u8(lut, indices.val[1]);
+        out.val[2] = vqtbl4q_u8(lut, indices.val[2]);
+        out.val[3] = vqtbl4q_u8(lut, indices.val[3]);
+        vst4q_u8((uint8_t *)output + done / 3 * 4, out);
+        done += 48;
+    }
+    return done;
+}
+
+static uint8x16_t lookupNEON(uint8x16x4_t low, uint8x16x4_t high, uint8x16_t chars) {
+    // chars 0-63 come from the first table, 64-127 from the second. anything
+    // 128 and up falls outside both and yields 0, so callers check for it.
+    uint8x16_t values = vqtbl4q_u8(low, chars);
+    return vqtbx4q_u8(values, high, vsubq_u8(chars, vdupq_n_u8(64)));
+}
+
+// 64 chars in, 48 bytes out per iteration. returns the blocks consumed, or
+// SIZE_MAX if the input is invalid.
+static size_t decodeBlocksNEON(const char *input, size_t blocks, uint8_t *output, const uint8_t *table) {
+    uint8x16x4_t low = loadTable64(table);
+    uint8x16x4_t high = loadTable64(table + 64);
+    size_t done = 0;
+    while (blocks - done >= 16) {
+        uint8x16x4_t in = vld4q_u8((const uint8_t *)input + done * 4);
+        uint8x16_t a = lookupNEON(low, high, in.val[0]);
+        uint8x16_t b = lookupNEON(low, high, in.val[1]);
+        uint8x16_t c = lookupNEON(low, high, in.val[2]);
+        uint8x16_t d = lookupNEON(low, high, in.val[3]);
+        // bit 7 is set for invalid chars (0xFF in the table) and non-ASCII input
+        uint8x16_t check = vorrq_u8(vorrq_u8(vorrq_u8(a, b), vorrq_u8(c, d)), vorrq_u8(vorrq_u8(in.val[0], in.val[1]), vorrq_u8(in.val[2], in.val[3])));
+        if (vmaxvq_u8(check) & 0x80) return SIZE_MAX;
+        uint8x16x3_t out;
+        out.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+        out.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+        out.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+        vst3q_u8(output + done * 3, out);
+        done += 16;
+    }
+    return done;
+}
+
+#endif
+
+#pragma mark - SSSE3 / AVX2
+
+#if LB_BASE64_X86
+
+// the bit-shuffling below follows Wojciech Muła's well known SIMD base64
+// scheme. each 3 input bytes are spread into a 32-bit lane, the four 6-bit
+// fields pulled out with multiplies, then mapped to ASCII by adding a per-range
+// offset picked with a byte shuffle.
+
+#define LB_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define LB_TARGET_AVX2 __attribute__((target("avx2")))
+
+LB_TARGET_SSSE3 static __m128i encodeIndicesSSSE3(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00));
+    __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003F03F0));
+    __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+LB_TARGET_SSSE3 static __m128i encodeTranslateSSSE3(__m128i indices, __m128i offsets) {
+    // 0 for 26-51, 1-10 for the digits, 11 and 12 for the last two chars, and
+    // 13 for 0-25
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+    return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+}
+
+static void encodeOffsets(const char *alphabet, int8_t offsets[16]) {
+    offsets[0] = 'a' - 26;
+    for (int i = 1; i <= 10; i++) offsets[i] = '0' - 52;
+    offsets[11] = (int8_t)(alphabet[62] - 62);
+    offsets[12] = (int8_t)(alphabet[63] - 63);
+    offsets[13] = 'A';
+    offsets[14] = 0;
+    offsets[15] = 0;
+}
+
+LB_TARGET_SSSE3 static size_t encodeBlocksSSSE3(const uint8_t *input, size_t length, char *output, const char *alphabet) {
+    int8_t offsetBytes[16];
+    encodeOffsets(alphabet, offsetBytes);
+    __m128i offsets = _mm_loadu_si128((const __m128i *)offsetBytes);
+    size_t done = 0;
+    // 12 bytes are used per iteration but 16 are loaded
+    while (length - done >= 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(input + done));
+        __m128i out = encodeTranslateSSSE3(encodeIndicesSSSE3(in), offsets);
+        _mm_storeu_si128((__m128i *)(output + done / 3 * 4), out);
+        done += 12;
+    }
+    return done;
+}
+
+LB_TARGET_AVX2 static size_t encodeBlocksAVX2(const uint8_t *input, size_t length, char *output, const char *alphabet) {
+    int8_t offsetBytes[16];
+    encodeOffsets(alphabet, offsetBytes);
+    __m256i offsets = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)offsetBytes));
+    __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                      1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    size_t done = 0;
+    // two 12-byte groups per iteration, one in each 128-bit lane
+    while (length - done >= 28) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(input + done));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(input + done + 12));
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        in = _mm256_shuffle_epi8(in, spread);
+        __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00));
+        __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0));
+        __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        __m256i indices = _mm256_or_si256(t1, t3);
+        __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+        __m256i out = _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range));
+        _mm256_storeu_si256((__m256i *)(output + done / 3 * 4), out);
+        done += 24;
+    }
+    return done;
+}
+
+// maps 16 chars to their 6-bit values with range compares, which works for
+// either alphabet. sets *valid to a mask of the chars that were in it.
+LB_TARGET_SSSE3 static __m128i decodeValuesSSSE3(__m128i in, __m128i char62, __m128i char63, __m128i *valid) {
+    // signed compares are fine: anything non-ASCII is negative and in no range
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), in));
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), in));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), in));
+    __m128i is62 = _mm_cmpeq_epi8(in, char62);
+    __m128i is63 = _mm_cmpeq_epi8(in, char63);
+    __m128i offset = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+    offset = _mm_or_si128(offset, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+    offset = _mm_or_si128(offset, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+    __m128i values = _mm_add_epi8(in, offset);
+    // the last two chars don't sit in a range, so substitute them outright
+    values = _mm_andnot_si128(_mm_or_si128(is62, is63), values);
+    values = _mm_or_si128(values, _mm_and_si128(is62, _mm_set1_epi8(62)));
+    values = _mm_or_si128(values, _mm_and_si128(is63, _mm_set1_epi8(63)));
+    *valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(is62, is63)));
+    return values;
+}
+
+LB_TARGET_SSSE3 static __m128i decodePackSSSE3(__m128i values) {
+    // merge the 6-bit fields of each 32-bit lane into 24 bits, then gather the
+    // three bytes of each lane into the low 12 bytes
+    __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+LB_TARGET_SSSE3 static size_t decodeBlocksSSSE3(const char *input, size_t blocks, uint8_t *output, const char *alphabet) {
+    __m128i char62 = _mm_set1_epi8(alphabet[62]);
+    __m128i char63 = _mm_set1_epi8(alphabet[63]);
+    size_t done = 0;
+    while (blocks - done >= 4) {
+        __m128i valid;
+        __m128i values = decodeValuesSSSE3(_mm_loadu_si128((const __m128i *)(input + done * 4)), char62, char63, &valid);
+        if (_mm_movemask_epi8(valid) != 0xFFFF) return SIZE_MAX;
+        __m128i out = decodePackSSSE3(values);
+        uint8_t *dst = output + done * 3;
+        _mm_storel_epi64((__m128i *)dst, out);
+        uint32_t last = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(out, 8));
+        memcpy(dst + 8, &last, 4);
+        done += 4;
+    }
+    return done;
+}
+
+LB_TARGET_AVX2 static size_t decodeBlocksAVX2(const char *input, size_t blocks, uint8_t *output, const char *alphabet) {
+    __m256i char62 = _mm256_set1_epi8(alphabet[62]);
+    __m256i char63 = _mm256_set1_epi8(alphabet[63]);
+    __m256i gather = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    __m256i compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    size_t done = 0;
+    while (blocks - done >= 8) {
+        __m256i in = _mm256_loadu_si256((const __m256i *)(input + done * 4));
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), in));
+        __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), in));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), in));
+        __m256i is62 = _mm256_cmpeq_epi8(in, char62);
+        __m256i is63 = _mm256_cmpeq_epi8(in, char63);
+        __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(digit, _mm256_or_si256(is62, is63)));
+        if (_mm256_movemask_epi8(valid) != -1) return SIZE_MAX;
+        __m256i offset = _mm256_and_si256(upper, _mm256_set1_epi8(-'A'));
+        offset = _mm256_or_si256(offset, _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')));
+        offset = _mm256_or_si256(offset, _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')));
+        __m256i values = _mm256_add_epi8(in, offset);
+        values = _mm256_andnot_si256(_mm256_or_si256(is62, is63), values);
+        values = _mm256_or_si256(values, _mm256_and_si256(is62, _mm256_set1_epi8(62)));
+        values = _mm256_or_si256(values, _mm256_and_si256(is63, _mm256_set1_epi8(63)));
+        __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        merged = _mm256_shuffle_epi8(merged, gather);
+        // 12 bytes per lane -> 24 contiguous bytes
+        merged = _mm256_permutevar8x32_epi32(merged, compact);
+        uint8_t *dst = output + done * 3;
+        _mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(merged));
+        _mm_storel_epi64((__m128i *)(dst + 16), _mm256_extracti128_si256(merged, 1));
+        done += 8;
+    }
+    return done;
+}
+
+typedef enum {
+    LBBase64LevelUnknown = 0,
+    LBBase64LevelScalar,
+    LBBase64LevelSSSE3,
+    LBBase64LevelAVX2
+} LBBase64Level;
+
+static LBBase64Level simdLevel(void) {
+    // racing threads all compute the same answer, so no locking needed
+    static volatile LBBase64Level level = LBBase64LevelUnknown;
+    if (level == LBBase64LevelUnknown) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) level = LBBase64LevelAVX2;
+        else if (__builtin_cpu_supports("ssse3")) level = LBBase64LevelSSSE3;
+        else level = LBBase64LevelScalar;
+    }
+    return level;
+}
+
+#endif
+
+#pragma mark - block dispatch
+
+// encodes length bytes (a multiple of 3) as whole groups.
+static void encodeBlocks(const uint8_t *input, size_t length, char *output, LBBase64Options options) {
+    const char *alphabet = alphabetForOptions(options);
+    size_t done = 0;
+#if LB_BASE64_NEON
+    done = encodeBlocksNEON(input, length, output, alphabet);
+#elif LB_BASE64_X86
+    LBBase64Level level = simdLevel();
+    if (level == LBBase64LevelAVX2) done = encodeBlocksAVX2(input, length, output, alphabet);
+    if (level >= LBBase64LevelSSSE3) done += encodeBlocksSSSE3(input + done, length - done, output + done / 3 * 4, alphabet);
+#endif
+    encodeBlocksScalar(input + done, length - done, output + done / 3 * 4, alphabet);
+}
+
+// decodes whole groups of 4 chars, none of which may be padding.
+static bool decodeBlocks(const char *input, size_t blocks, uint8_t *output, LBBase64Options options) {
+    size_t done = 0;
+#if LB_BASE64_NEON
+    done = decodeBlocksNEON(input, blocks, output, decodeTableForOptions(options));
+    if (done == SIZE_MAX) return false;
+#elif LB_BASE64_X86
+    const char *alphabet = alphabetForOptions(options);
+    LBBase64Level level = simdLevel();
+    if (level == LBBase64LevelAVX2) {
+        done = decodeBlocksAVX2(input, blocks, output, alphabet);
+        if (done == SIZE_MAX) return false;
+    }
+    if (level >= LBBase64LevelSSSE3) {
+        size_t more = decodeBlocksSSSE3(input + done * 4, blocks - done, output + done * 3, alphabet);
+        if (more == SIZE_MAX) return false;
+        done += more;
+    }
+#endif
+    return decodeBlocksScalar(input + done * 4, blocks - done, output + done * 3, decodeTableForOptions(options));
+}
+
+// the last group of an encoding: 1 or 2 leftover bytes.
+static size_t encodeTail(const uint8_t *input, size_t length, char *output, LBBase64Options options) {
+    if (length == 0) return 0;
+    const char *alphabet = alphabetForOptions(options);
+    uint32_t word = (uint32_t)input[0] << 16;
+    if (length == 2) word |= (uint32_t)input[1] << 8;
+    output[0] = alphabet[(word >> 18) & 0x3F];
+    output[1] = alphabet[(word >> 12) & 0x3F];
+    if (length == 2) output[2] = alphabet[(word >> 6) & 0x3F];
+    if (options & LBBase64Unpadded) return length + 1;
+    if (length == 1) output[2] = '=';
+    output[3] = '=';
+    return 4;
+}
+
+// the last group of a decoding: up to 4 chars, where padding is allowed.
+static bool decodeTail(const char *input, size_t length, uint8_t *output, size_t *outputLength, LBBase64Options options) {
+    *outputLength = 0;
+    if (length == 0) return true;
+    if (options & LBBase64Unpadded) {
+        if (length == 1) return false;
+    } else {
+        if (length != 4) return false;
+        if (input[3] == '=') length = (input[2] == '=') ? 2 : 3;
+    }
+    const uint8_t *table = decodeTableForOptions(options);
+    const uint8_t *in = (const uint8_t *)input;
+    uint32_t values[4] = {0, 0, 0, 0};
+    for (size_t i = 0; i < length; i++) {
+        values[i] = table[in[i]];
+        if (values[i] & 0x80) return false;
+    }
+    uint32_t word = (values[0] << 18) | (values[1] << 12) | (values[2] << 6) | values[3];
+    // the bits past the last whole byte must be zero, or the encoding isn't
+    // the canonical one
+    if (length == 2 && (values[1] & 0x0F)) return false;
+    if (length == 3 && (values[2] & 0x03)) return false;
+    output[0] = (uint8_t)(word >> 16);
+    if (length > 2) output[1] = (uint8_t)(word >> 8);
+    if (length > 3) output[2] = (uint8_t)word;
+    *outputLength = length - 1;
+    return true;
+}
+
+#pragma mark - one-shot
+
+size_t LBBase64EncodedLength(size_t length, LBBase64Options options) {
+    if (options & LBBase64Unpadded) {
+        size_t tail = length % 3;
+        return length / 3 * 4 + (tail ? tail + 1 : 0);
+    }
+    return (length + 2) / 3 * 4;
+}
+
+size_t LBBase64Encode(const uint8_t *input, size_t length, char *output, LBBase64Options options) {
+    size_t whole = length - length % 3;
+    encodeBlocks(input, whole, output, options);
+    return whole / 3 * 4 + encodeTail(input + whole, length - whole, output + whole / 3 * 4, options);
+}
+
+size_t LBBase64DecodedMaxLength(size_t length) {
+    return (length + 3) / 4 * 3;
+}
+
+// how many trailing chars to hold back as the final group
+static size_t tailLength(size_t length) {
+    if (length == 0) return 0;
+    size_t tail = length % 4;
+    return tail ? tail : 4;
+}
+
+bool LBBase64Decode(const char *input, size_t length, uint8_t *output, size_t *outputLength, LBBase64Options options) {
+    *outputLength = 0;
+    if (!(options & LBBase64Unpadded) && (length % 4)) return false;
+    size_t tail = tailLength(length);
+    size_t blocks = (length - tail) / 4;
+    if (!decodeBlocks(input, blocks, output, options)) return false;
+    size_t tailOutput;
+    if (!decodeTail(input + blocks * 4, tail, output + blocks * 3, &tailOutput, options)) return false;
+    *outputLength = blocks * 3 + tailOutput;
+    return true;
+}
+
+#pragma mark - streaming
+
+void LBBase64EncoderInit(LBBase64Encoder *encoder, LBBase64Options options) {
+    encoder->options = options;
+    encoder->carryLength = 0;
+}
+
+size_t LBBase64EncoderUpdateMaxLength(size_t length) {
+    return (length + 2) / 3 * 4;
+}
+
+size_t LBBase64EncoderUpdate(LBBase64Encoder *encoder, const uint8_t *input, size_t length, char *output) {
+    size_t written = 0;
+    if (encoder->carryLength) {
+        // top up the carried partial group first
+        while (encoder->carryLength < 3 && length) {
+            encoder->carry[encoder->carryLength++] = *input++;
+            length--;
+        }
+        if (encoder->carryLength < 3) return 0;
+        encodeBlocks(encoder->carry, 3, output, encoder->options);
+        encoder->carryLength = 0;
+        written = 4;
+    }
+    size_t whole = length - length % 3;
+    encodeBlocks(input, whole, output + written, encoder->options);
+    written += whole / 3 * 4;
+    for (size_t i = whole; i < length; i++) {
+        encoder->carry[encoder->carryLength++] = input[i];
+    }
+    return written;
+}
+
+size_t LBBase64EncoderFinal(LBBase64Encoder *encoder, char *output) {
+    size_t written = encodeTail(encoder->carry, encoder->carryLength, output, encoder->options);
+    encoder->carryLength = 0;
+    return written;
+}
+
+void LBBase64DecoderInit(LBBase64Decoder *decoder, LBBase64Options options) {
+    decoder->options = options;
+    decoder->carryLength = 0;
+    decoder->failed = false;
+}
+
+size_t LBBase64DecoderUpdateMaxLength(size_t length) {
+    return (length / 4 + 1) * 3;
+}
+
+bool LBBase64DecoderUpdate(LBBase64Decoder *decoder, const char *input, size_t length, uint8_t *output, size_t *outputLength) {
+    *outputLength = 0;
+    if (decoder->failed) return false;
+    // the last (up to) 4 chars seen are always held back, since only the
+    // final group may be padded and we can't know which one that is yet.
+    while (decoder->carryLength < 4 && length) {
+        decoder->carry[decoder->carryLength++] = *input++;
+        length--;
+    }
+    if (!length) return true;
+    if (!decodeBlocks(decoder->carry, 1, output, decoder->options)) {
+        decoder->failed = true;
+        return false;
+    }
+    size_t tail = tailLength(length);
+    size_t blocks = (length - tail) / 4;
+    if (!decodeBlocks(input, blocks, output + 3, decoder->options)) {
+        decoder->failed = true;
+        return false;
+    }
+    memcpy(decoder->carry, input + blocks * 4, tail);
+    decoder->carryLength = (uint8_t)tail;
+    *outputLength = 3 + blocks * 3;
+    return true;
+}
+
+bool LBBase64DecoderFinal(LBBase64Decoder *decoder, uint8_t *output, size_t *outputLength) {
+    *outputLength = 0;
+    if (decoder->failed) return false;
+    if (!decodeTail(decoder->carry, decoder->carryLength, output, outputLength, decoder->options)) {
+        decoder->failed = true;
+        return false;
+    }
+    decoder->carryLength = 0;
+    return true;
+}
@@ -0,0 +1,109 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ Base64 encoding and decoding (RFC 4648) in plain C, behind the base64 methods
+ of LBUtils(string).
+ 
+ Both directions are vectorized where the CPU allows: NEON on 64-bit ARM,
+ SSSE3 or AVX2 on Intel (picked at runtime, so this covers the simulator), with
+ a scalar fallback for everything else and for the ends of buffers.
+ 
+ Options select the standard alphabet or the URL and filename safe one ("-" and
+ "_" in place of "+" and "/"), and whether output is padded with "=".
+ 
+ Decoding is strict: any character outside the alphabet (including whitespace
+ and line breaks), misplaced or missing padding, or non-zero unused bits in the
+ final character is an error. With LBBase64Unpadded, input must have no padding
+ at all; without it, input must be padded to a multiple of 4 characters.
+ 
+ For large blobs, the streaming encoder and decoder take input in chunks of any
+ size and carry partial groups between calls, so you never need the whole input
+ or output in memory at once. e.g.:
+ 
+   LBBase64Encoder encoder;
+   LBBase64EncoderInit(&encoder, LBBase64Standard);
+   while (more chunks) {
+     size_t n = LBBase64EncoderUpdate(&encoder, chunk, chunkLength, out);
+     write out n chars, out needs LBBase64EncoderUpdateMaxLength(chunkLength)
+   }
+   n = LBBase64EncoderFinal(&encoder, out); // at most 4 more chars
+ 
+ */
+
+#ifndef LBBase64_h
+#define LBBase64_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    LBBase64Standard = 0,
+    LBBase64URLSafe = 1 << 0, // "-" and "_" instead of "+" and "/"
+    LBBase64Unpadded = 1 << 1 // no trailing "=", on both encode and decode
+} LBBase64Options;
+
+// one-shot encoding. returns the number of chars written, which is always
+// LBBase64EncodedLength(). no terminating NUL is written.
+size_t LBBase64EncodedLength(size_t length, LBBase64Options options);
+size_t LBBase64Encode(const uint8_t *input, size_t length, char *output, LBBase64Options options);
+
+// one-shot decoding. output must have room for LBBase64DecodedMaxLength bytes.
+// returns false if the input is invalid, in which case the contents of output
+// are undefined.
+size_t LBBase64DecodedMaxLength(size_t length);
+bool LBBase64Decode(const char *input, size_t length, uint8_t *output, size_t *outputLength, LBBase64Options options);
+
+// streaming encoding, see above.
+typedef struct {
+    LBBase64Options options;
+    uint8_t carry[3];
+    uint8_t carryLength;
+} LBBase64Encoder;
+
+void LBBase64EncoderInit(LBBase64Encoder *encoder, LBBase64Options options);
+size_t LBBase64EncoderUpdateMaxLength(size_t length);
+size_t LBBase64EncoderUpdate(LBBase64Encoder *encoder, const uint8_t *input, size_t length, char *output);
+size_t LBBase64EncoderFinal(LBBase64Encoder *encoder, char *output);
+
+// streaming decoding. once either call returns false the decoder stays failed.
+// output for an update needs LBBase64DecoderUpdateMaxLength(length) bytes, and
+// for the final call up to 3.
+typedef struct {
+    LBBase64Options options;
+    char carry[4];
+    uint8_t carryLength;
+    bool failed;
+} LBBase64Decoder;
+
+void LBBase64DecoderInit(LBBase64Decoder *decoder, LBBase64Options options);
+size_t LBBase64DecoderUpdateMaxLength(size_t length);
+bool LBBase64DecoderUpdate(LBBase64Decoder *decoder, const char *input, size_t length, uint8_t *output, size_t *outputLength);
+bool LBBase64DecoderFinal(LBBase64Decoder *decoder, uint8_t *output, size_t *outputLength);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
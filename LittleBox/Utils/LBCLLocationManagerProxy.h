@@ -44,6 +44,24 @@
  mode, callbacks to the CLLocationManagerDelegate location update methods are
  sent on a 2 second timer.
  
+ Region crossings are found with a spatial index of the monitored circular
+ regions (see LBGeoRegionIndex.h), so a mockLocation change only tests the
+ regions near the old and new locations, even with thousands monitored. All
+ the crossings and the location update from one change are delivered together,
+ shortly after it, on the main thread.
+ 
+ A recorded trace (GPX or CSV, see LBTraceReplay.h for what's read) can also be
+ played back, at many times real speed if you like, with
+ startReplayingTraceAtPath:speed:. The trace is mapped rather than loaded, and
+ fixes are made every replaySampleInterval of trace time by interpolating the
+ recorded points, so sparse traces still move smoothly. Fixes carry the trace's
+ timestamps, speeds and courses, go through distanceFilter, and are held back
+ and delivered together by allowDeferredLocationUpdatesUntilTraveled:timeout:
+ (with the timeout in trace time). Each tick's fixes go out in one
+ didUpdateLocations: call, then the region crossings along them. Replay
+ switches to mock mode if needed and leaves mockLocation at the last fix;
+ setting mockLocation to nil stops it.
+ 
  To turn off mock behavior and have this be a straight proxy to the real
  location manager, set mockLocation to nil.
  
@@ -96,6 +114,12 @@
 @optional - (void)locationManagerDidPauseLocationUpdates:(id)manager;
 @optional - (void)locationManagerDidResumeLocationUpdates:(id)manager;
 @optional - (BOOL)locationManagerShouldDisplayHeadingCalibration:(id)manager;
+// mock mode only: every region a single mockLocation change entered or exited,
+// in one call. if not implemented, the same crossings are sent as separate
+// didExitRegion: calls and then didEnterRegion: calls.
+@optional - (void)locationManager:(id)manager didEnterRegions:(NSArray *)enteredRegions exitRegions:(NSArray *)exitedRegions;
+// a trace replay reached the end of the trace
+@optional - (void)locationManagerDidFinishReplayingTrace:(id)manager;
 @end
 
 
@@ -111,6 +135,16 @@
 @property (weak, nonatomic) id<LBCLLocationManagerProxyDelegate> delegate;
 @property (nonatomic, strong) NSMutableArray *mockMonitoredRegions;
 
+// pertaining to trace replay:
+@property (nonatomic, readonly) BOOL replayingTrace;
+@property (nonatomic, assign) double replaySpeed; // trace seconds per clock second, 1 by default. can be changed mid-replay.
+@property (nonatomic, assign) NSTimeInterval replaySampleInterval; // trace seconds between fixes, 1 by default
+@property (nonatomic, copy) NSTimeInterval (^replayClock)(void); // seconds on any monotonic scale; nil means [LBUtils monotonicTime]
+// returns NO if the file can't be read or has no replayable points. a speed
+// of 0 keeps replaySpeed.
+- (BOOL)startReplayingTraceAtPath:(NSString *)path speed:(double)speed;
+- (void)stopReplayingTrace;
+
 // pertaining to the real CLLocationManager. includes deprecated methods/properties:
 @property(assign, nonatomic) CLActivityType activityType;
 @property(assign, nonatomic) CLLocationAccuracy desiredAccuracy;
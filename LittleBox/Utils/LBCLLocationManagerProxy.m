@@ -25,11 +25,57 @@
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 
 #import "LBCLLocationManagerProxy.h"
+#import "LBGeoRegionIndex.h"
+#import "LBTraceReplay.h"
+#import "LBUtils.h"
+
+// how often a trace replay advances, in clock time
+#define LB_TRACE_REPLAY_TICK 0.1
+
+@interface LBCLLocationManagerProxy () {
+    // the mock monitored regions, indexed so a location change only tests the
+    // regions near it. see LBGeoRegionIndex.h
+    LBGeoRegionIndex _mockRegionIndex;
+    CFMutableDictionaryRef _mockRegionHandles; // region -> handle + 1, not retained (mockMonitoredRegions has them)
+    NSMutableDictionary *_mockRegionsByHandle;
+    NSMutableArray *_mockRegionsIndexed; // mockMonitoredRegions as the index last saw it
+    // trace replay, see LBTraceReplay.h. _traceReplay is NULL unless replaying
+    LBTraceReader _traceReader;
+    LBTraceReplay *_traceReplay;
+    LBTimer *_replayTimer;
+    BOOL _cancelingDeferredUpdates;
+    BOOL _advancingReplay; // in a delivery, see driveReplayAdvancing:
+    BOOL _replayStopRequested;
+    BOOL _replayDisallowRequested;
+}
+- (void)deliverTracePoints:(const LBTracePoint *)points count:(size_t)count finishedDeferring:(BOOL)finishedDeferring;
+@end
+
+typedef struct {
+    __unsafe_unretained NSDictionary *regionsByHandle;
+    __unsafe_unretained NSMutableArray *enteredRegions;
+    __unsafe_unretained NSMutableArray *exitedRegions;
+} LBMockRegionCrossings;
+
+static void collectMockRegionCrossing(size_t handle, bool entered, void *context) {
+    LBMockRegionCrossings *crossings = context;
+    CLRegion *region = [crossings->regionsByHandle objectForKey:[NSNumber numberWithUnsignedLong:handle]];
+    if (region) [(entered ? crossings->enteredRegions : crossings->exitedRegions) addObject:region];
+}
+
+static void deliverTracePoints(const LBTracePoint *points, size_t count, bool finishedDeferring, void *context) {
+    [(__bridge LBCLLocationManagerProxy *)context deliverTracePoints:points count:count finishedDeferring:finishedDeferring];
+}
 
 @implementation LBCLLocationManagerProxy
 
 - (id)init {
     if ((self = [super init])) {
+        LBGeoRegionIndexInit(&_mockRegionIndex, LBGeoRegionIndexDefaultCellDegrees);
+        _mockRegionHandles = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+        _mockRegionsByHandle = [NSMutableDictionary dictionary];
+        _replaySpeed = 1.0;
+        _replaySampleInterval = LBTraceReplayDefaultSampleInterval;
         self.realManager = [[CLLocationManager alloc] init];
         self.realManager.delegate = self;
     }
@@ -42,25 +88,21 @@
     CLLocation *oldMockLocation = _mockLocation;
     CLLocation *effectiveOldLocation = oldMockLocation;
     CLLocation *effectiveNewLocation = mockLocation;
+    if (!mockLocation) {
+        [self stopReplayingTrace];
+    }
     if (_mockLocation != mockLocation) {
         _mockLocation = mockLocation;
     }
     if (!oldMockLocation && _mockLocation) {
-        // switch to mock mode
-        self.mockMonitoredRegions = [NSMutableArray array];
-        for (CLRegion* region in self.realManager.monitoredRegions) {
-            [self.mockMonitoredRegions addObject:region];
-        }
-        self.mockTimer = [LBTimer scheduledTimerWithTimeInterval:2.0 target:self selector:@selector(mockTimerPing) userInfo:nil repeats:YES];
-        self.mockLastSentLocation = nil;
+        [self beginMockMode];
         effectiveOldLocation = self.realManager.location; // trigger region crossings / updates on a shift from real to mock loc
     }
-    NSArray *checkRegions = self.mockMonitoredRegions;
-    if (oldMockLocation && !_mockLocation) {
+    BOOL returningToRealMode = (oldMockLocation && !_mockLocation);
+    if (returningToRealMode) {
         // return to real mode
         [self.mockTimer invalidate];
         self.mockTimer = nil;
-        self.mockMonitoredRegions = nil;
         self.mockLastSentLocation = nil;
         if (self.realManager.location) {
             // trigger region crossings / updates on a shift from mock back to real loc. these will be the last "fake" signals the delegate gets, and are sent just to maintain an apparently consistent behavior during the real/mock mode switch. it's not perfect: if the real location has moved outside of really monitored regions that the mock location is also outside of, those real region crossings will not be fired.
@@ -68,40 +110,126 @@
         }
     }
     if (effectiveOldLocation && effectiveNewLocation && ([effectiveOldLocation distanceFromLocation:effectiveNewLocation] > 0.0)) {
-        int64_t delayInSeconds = 0.1;
-        dispatch_time_t popTime = dispatch_time(DISPATCH_TIME_NOW, delayInSeconds * NSEC_PER_SEC);
         // emit loc update if one or more svcs is active
-        if (self.anyLocationUpdatesActive || self.anySignificantLocationChangeUpdatesActive) {
+        BOOL sendLocation = (self.anyLocationUpdatesActive || self.anySignificantLocationChangeUpdatesActive);
+        // find any necessary region crossings, testing only the regions near
+        // the old and new locations
+        NSMutableArray *enteredRegions = [NSMutableArray array];
+        NSMutableArray *exitedRegions = [NSMutableArray array];
+        [self findMockRegionCrossingsFromLocation:effectiveOldLocation toLocation:effectiveNewLocation entered:enteredRegions exited:exitedRegions];
+        if (sendLocation || [enteredRegions count] || [exitedRegions count]) {
+            // everything this change caused goes out together in one go, the
+            // loc update first, then exits, then entries
+            int64_t delayInSeconds = 0.1;
+            dispatch_time_t popTime = dispatch_time(DISPATCH_TIME_NOW, delayInSeconds * NSEC_PER_SEC);
             dispatch_after(popTime, dispatch_get_main_queue(), ^(void){
-                if ([self.delegate respondsToSelector:@selector(locationManager:didUpdateLocations:)]) {
-                    [self.delegate locationManager:self didUpdateLocations:[NSArray arrayWithObject:effectiveNewLocation]];
-                } else if ([self.delegate respondsToSelector:@selector(locationManager:didUpdateToLocation:fromLocation:)]) {
-                    [self.delegate locationManager:self didUpdateToLocation:effectiveNewLocation fromLocation:effectiveOldLocation];
+                if (sendLocation) {
+                    if ([self.delegate respondsToSelector:@selector(locationManager:didUpdateLocations:)]) {
+                        [self.delegate locationManager:self didUpdateLocations:[NSArray arrayWithObject:effectiveNewLocation]];
+                    } else if ([self.delegate respondsToSelector:@selector(locationManager:didUpdateToLocation:fromLocation:)]) {
+                        [self.delegate locationManager:self didUpdateToLocation:effectiveNewLocation fromLocation:effectiveOldLocation];
+                    }
                 }
+                [self sendMockRegionCrossingsEntered:enteredRegions exited:exitedRegions];
             });
         }
-        // emit any necessary region crossings
-        for (CLRegion* region in checkRegions) {
-            if (![region containsCoordinate:effectiveOldLocation.coordinate] && [region containsCoordinate:effectiveNewLocation.coordinate]) {
-                // enter
-                dispatch_after(popTime, dispatch_get_main_queue(), ^(void){
-                    if ([self.delegate respondsToSelector:@selector(locationManager:didEnterRegion:)]) {
-                        [self.delegate locationManager:self didEnterRegion:region];
-                    }
-                });
-            } else if ([region containsCoordinate:effectiveOldLocation.coordinate] && ![region containsCoordinate:effectiveNewLocation.coordinate]) {
-                // exit
-                dispatch_after(popTime, dispatch_get_main_queue(), ^(void){
-                    if ([self.delegate respondsToSelector:@selector(locationManager:didExitRegion:)]) {
-                        [self.delegate locationManager:self didExitRegion:region];
-                    }
-                });
-            }
+    }
+    if (returningToRealMode) {
+        self.mockMonitoredRegions = nil;
+    }
+}
+
+- (void)beginMockMode {
+    // switch to mock mode
+    NSMutableArray *regions = [NSMutableArray array];
+    for (CLRegion* region in self.realManager.monitoredRegions) {
+        [regions addObject:region];
+    }
+    self.mockMonitoredRegions = regions;
+    self.mockTimer = [LBTimer scheduledTimerWithTimeInterval:2.0 target:self selector:@selector(mockTimerPing) userInfo:nil repeats:YES];
+    self.mockLastSentLocation = nil;
+}
+
+- (void)setMockMonitoredRegions:(NSMutableArray *)mockMonitoredRegions {
+    _mockMonitoredRegions = mockMonitoredRegions;
+    [self rebuildMockRegionIndex];
+}
+
+- (void)rebuildMockRegionIndex {
+    LBGeoRegionIndexDestroy(&_mockRegionIndex);
+    LBGeoRegionIndexInit(&_mockRegionIndex, LBGeoRegionIndexDefaultCellDegrees);
+    CFDictionaryRemoveAllValues(_mockRegionHandles);
+    [_mockRegionsByHandle removeAllObjects];
+    for (CLRegion *region in _mockMonitoredRegions) {
+        [self indexMockRegion:region];
+    }
+    _mockRegionsIndexed = [_mockMonitoredRegions mutableCopy];
+}
+
+// whether mockMonitoredRegions still holds exactly the regions the index last
+// saw, in the same order. by identity, so a region replaced with another one
+// (even an equal one) counts as a change.
+- (BOOL)mockRegionIndexIsCurrent {
+    NSUInteger count = [_mockMonitoredRegions count];
+    if (count != [_mockRegionsIndexed count]) return NO;
+    for (NSUInteger i = 0; i < count; i++) {
+        if ([_mockMonitoredRegions objectAtIndex:i] != [_mockRegionsIndexed objectAtIndex:i]) return NO;
+    }
+    return YES;
+}
+
+- (void)indexMockRegion:(CLRegion *)region {
+    // only circular regions can be crossed by moving the coordinate
+    if (![region respondsToSelector:@selector(center)] || ![region respondsToSelector:@selector(radius)]) return;
+    if (CFDictionaryContainsKey(_mockRegionHandles, (__bridge const void *)region)) return;
+    size_t handle = LBGeoRegionIndexAdd(&_mockRegionIndex, region.center.latitude, region.center.longitude, region.radius);
+    if (handle == LBGeoRegionNoHandle) return;
+    CFDictionarySetValue(_mockRegionHandles, (__bridge const void *)region, (const void *)(uintptr_t)(handle + 1));
+    [_mockRegionsByHandle setObject:region forKey:[NSNumber numberWithUnsignedLong:handle]];
+}
+
+- (void)unindexMockRegion:(CLRegion *)region {
+    uintptr_t stored = (uintptr_t)CFDictionaryGetValue(_mockRegionHandles, (__bridge const void *)region);
+    if (!stored) return;
+    LBGeoRegionIndexRemove(&_mockRegionIndex, stored - 1);
+    CFDictionaryRemoveValue(_mockRegionHandles, (__bridge const void *)region);
+    [_mockRegionsByHandle removeObjectForKey:[NSNumber numberWithUnsignedLong:stored - 1]];
+}
+
+- (void)findMockRegionCrossingsFromLocation:(CLLocation *)oldLocation toLocation:(CLLocation *)newLocation entered:(NSMutableArray *)enteredRegions exited:(NSMutableArray *)exitedRegions {
+    if (!self.mockMonitoredRegions) return;
+    if (![self mockRegionIndexIsCurrent]) {
+        // someone changed mockMonitoredRegions directly
+        [self rebuildMockRegionIndex];
+    }
+    LBMockRegionCrossings crossings = { _mockRegionsByHandle, enteredRegions, exitedRegions };
+    LBGeoRegionIndexCrossings(&_mockRegionIndex,
+                              oldLocation.coordinate.latitude, oldLocation.coordinate.longitude,
+                              newLocation.coordinate.latitude, newLocation.coordinate.longitude,
+                              collectMockRegionCrossing, &crossings);
+}
+
+- (void)sendMockRegionCrossingsEntered:(NSArray *)enteredRegions exited:(NSArray *)exitedRegions {
+    if (![enteredRegions count] && ![exitedRegions count]) return;
+    if ([self.delegate respondsToSelector:@selector(locationManager:didEnterRegions:exitRegions:)]) {
+        [self.delegate locationManager:self didEnterRegions:enteredRegions exitRegions:exitedRegions];
+        return;
+    }
+    for (CLRegion *region in exitedRegions) {
+        if ([self.delegate respondsToSelector:@selector(locationManager:didExitRegion:)]) {
+            [self.delegate locationManager:self didExitRegion:region];
+        }
+    }
+    for (CLRegion *region in enteredRegions) {
+        if ([self.delegate respondsToSelector:@selector(locationManager:didEnterRegion:)]) {
+            [self.delegate locationManager:self didEnterRegion:region];
         }
     }
 }
 
 - (void)mockTimerPing {
+    // a trace replay sends its own updates
+    if (_traceReplay) return;
     if (self.anyLocationUpdatesActive || self.anySignificantLocationChangeUpdatesActive) {
         if (!self.mockLastSentLocation || (self.mockLastSentLocation != self.mockLocation)) {
             self.mockLastSentLocation = self.mockLocation;
@@ -110,6 +238,162 @@
     }
 }
 
+#pragma mark trace replay
+
+- (BOOL)startReplayingTraceAtPath:(NSString *)path speed:(double)speed {
+    if (_advancingReplay) return NO; // not from inside a delivery
+    [self stopReplayingTrace];
+    if (speed > 0) _replaySpeed = speed;
+    _traceReplay = malloc(sizeof(LBTraceReplay));
+    if (!_traceReplay) return NO;
+    if (!LBTraceReaderOpenFile(&_traceReader, [path fileSystemRepresentation])) {
+        free(_traceReplay);
+        _traceReplay = NULL;
+        return NO;
+    }
+    LBTraceReplayInit(_traceReplay, &_traceReader, _replaySpeed);
+    _traceReplay->sampleInterval = _replaySampleInterval;
+    if (!LBTraceReplayStart(_traceReplay, [self replayNow])) {
+        [self stopReplayingTrace];
+        return NO;
+    }
+    // the first fix goes out on the first tick
+    _replayTimer = [LBTimer scheduledTimerWithTimeInterval:LB_TRACE_REPLAY_TICK target:self selector:@selector(replayTimerPing) userInfo:nil repeats:YES];
+    return YES;
+}
+
+- (void)stopReplayingTrace {
+    // leaves the mock location wherever the replay got to
+    [_replayTimer invalidate];
+    _replayTimer = nil;
+    if (_advancingReplay) {
+        _replayStopRequested = YES;
+        return;
+    }
+    if (!_traceReplay) return;
+    LBTraceReplayDestroy(_traceReplay);
+    LBTraceReaderClose(&_traceReader);
+    free(_traceReplay);
+    _traceReplay = NULL;
+}
+
+- (BOOL)replayingTrace {
+    return _traceReplay != NULL;
+}
+
+- (void)setReplaySpeed:(double)replaySpeed {
+    if (replaySpeed <= 0) return;
+    _replaySpeed = replaySpeed;
+    if (_traceReplay) LBTraceReplaySetSpeed(_traceReplay, replaySpeed, [self replayNow]);
+}
+
+- (void)setReplaySampleInterval:(NSTimeInterval)replaySampleInterval {
+    if (replaySampleInterval <= 0) return;
+    _replaySampleInterval = replaySampleInterval;
+    if (_traceReplay) _traceReplay->sampleInterval = replaySampleInterval;
+}
+
+- (NSTimeInterval)replayNow {
+    return self.replayClock ? self.replayClock() : [LBUtils monotonicTime];
+}
+
+- (void)replayTimerPing {
+    [self driveReplayAdvancing:YES];
+}
+
+// every call into the replay that can deliver fixes goes through here. the
+// delegate can stop the replay (or set mockLocation to nil) from a delivery,
+// which is put off until the replay returns so it isn't freed out from under
+// itself, and it can disallow deferred updates, which is put off the same way
+// since the replay isn't reentrant. advance NO just disallows them.
+- (void)driveReplayAdvancing:(BOOL)advance {
+    if (!_traceReplay) return;
+    if (_advancingReplay) {
+        if (!advance) _replayDisallowRequested = YES;
+        return;
+    }
+    _advancingReplay = YES;
+    _replayDisallowRequested = !advance;
+    if (advance) {
+        _traceReplay->distanceFilter = self.distanceFilter;
+        LBTraceReplayAdvance(_traceReplay, [self replayNow], deliverTracePoints, (__bridge void *)self);
+    }
+    while (_replayDisallowRequested && !_replayStopRequested) {
+        _replayDisallowRequested = NO;
+        _cancelingDeferredUpdates = YES;
+        LBTraceReplayDisallowDeferredUpdates(_traceReplay, deliverTracePoints, (__bridge void *)self);
+        _cancelingDeferredUpdates = NO;
+    }
+    _replayDisallowRequested = NO;
+    _advancingReplay = NO;
+    if (_replayStopRequested) {
+        // the delegate stopped it during delivery
+        _replayStopRequested = NO;
+        [self stopReplayingTrace];
+        return;
+    }
+    if (LBTraceReplayFinished(_traceReplay)) {
+        [self stopReplayingTrace];
+        if ([self.delegate respondsToSelector:@selector(locationManagerDidFinishReplayingTrace:)]) {
+            [self.delegate locationManagerDidFinishReplayingTrace:self];
+        }
+    }
+}
+
+- (CLLocation *)locationForTracePoint:(const LBTracePoint *)point {
+    CLLocationCoordinate2D coordinate = CLLocationCoordinate2DMake(point->latitude, point->longitude);
+    BOOL hasAltitude = !isnan(point->altitude);
+    return [[CLLocation alloc] initWithCoordinate:coordinate
+                                         altitude:(hasAltitude ? point->altitude : 0.0)
+                               horizontalAccuracy:10.0
+                                 verticalAccuracy:(hasAltitude ? 10.0 : -1.0)
+                                           course:point->course
+                                            speed:point->speed
+                                        timestamp:[NSDate dateWithTimeIntervalSince1970:point->timestamp]];
+}
+
+- (void)deliverTracePoints:(const LBTracePoint *)points count:(size_t)count finishedDeferring:(BOOL)finishedDeferring {
+    CLLocation *previousLocation = _mockLocation;
+    if (count && !_mockLocation) {
+        [self beginMockMode];
+        previousLocation = self.realManager.location;
+    }
+    CLLocation *batchStartLocation = previousLocation;
+    NSMutableArray *locations = [NSMutableArray arrayWithCapacity:count];
+    NSMutableArray *enteredRegions = [NSMutableArray array];
+    NSMutableArray *exitedRegions = [NSMutableArray array];
+    for (size_t i = 0; i < count; i++) {
+        CLLocation *location = [self locationForTracePoint:&points[i]];
+        if (previousLocation) {
+            [self findMockRegionCrossingsFromLocation:previousLocation toLocation:location entered:enteredRegions exited:exitedRegions];
+        }
+        [locations addObject:location];
+        previousLocation = location;
+    }
+    if (count) {
+        _mockLocation = [locations lastObject];
+        self.mockLastSentLocation = _mockLocation;
+    }
+    // the whole batch at once, like the real manager does with deferred or
+    // backed up updates
+    if ([locations count] && (self.anyLocationUpdatesActive || self.anySignificantLocationChangeUpdatesActive)) {
+        if ([self.delegate respondsToSelector:@selector(locationManager:didUpdateLocations:)]) {
+            [self.delegate locationManager:self didUpdateLocations:locations];
+        } else if ([self.delegate respondsToSelector:@selector(locationManager:didUpdateToLocation:fromLocation:)]) {
+            CLLocation *oldLocation = batchStartLocation;
+            for (CLLocation *location in locations) {
+                [self.delegate locationManager:self didUpdateToLocation:location fromLocation:oldLocation];
+                oldLocation = location;
+            }
+        }
+    }
+    // then the crossings along the way
+    [self sendMockRegionCrossingsEntered:enteredRegions exited:exitedRegions];
+    if (finishedDeferring && [self.delegate respondsToSelector:@selector(locationManager:didFinishDeferredUpdatesWithError:)]) {
+        NSError *error = _cancelingDeferredUpdates ? [NSError errorWithDomain:kCLErrorDomain code:kCLErrorDeferredCanceled userInfo:nil] : nil;
+        [self.delegate locationManager:self didFinishDeferredUpdatesWithError:error];
+    }
+}
 
 #pragma mark property proxies
 
@@ -244,11 +528,20 @@
 
 - (void)allowDeferredLocationUpdatesUntilTraveled:(CLLocationDistance)distance timeout:(NSTimeInterval)timeout {
     // ios 6+
+    if (_traceReplay) {
+        // the timeout runs in trace time
+        LBTraceReplayAllowDeferredUpdates(_traceReplay, distance, timeout);
+        return;
+    }
     [self.realManager allowDeferredLocationUpdatesUntilTraveled:distance timeout:timeout];
 }
 
 - (void)disallowDeferredLocationUpdates {
     // ios 6+
+    if (_traceReplay) {
+        [self driveReplayAdvancing:NO];
+        return;
+    }
     [self.realManager disallowDeferredLocationUpdates];
 }
 
@@ -259,7 +552,14 @@
 - (void)startMonitoringForRegion:(CLRegion *)region {
     if (self.mockLocation) {
         if (![self.mockMonitoredRegions containsObject:region]) {
+            // if the array was changed directly, the next lookup rebuilds
+            // the index anyway
+            BOOL indexCurrent = [self mockRegionIndexIsCurrent];
             [self.mockMonitoredRegions addObject:region];
+            if (indexCurrent) {
+                [self indexMockRegion:region];
+                [_mockRegionsIndexed addObject:region];
+            }
         }
     }
     [self.realManager startMonitoringForRegion:region];
@@ -295,7 +595,14 @@
 
 - (void)stopMonitoringForRegion:(CLRegion *)region {
     if (self.mockLocation) {
-        [self.mockMonitoredRegions removeObject:region];
+        NSUInteger index = [self.mockMonitoredRegions indexOfObject:region];
+        if (index != NSNotFound) {
+            if ([self mockRegionIndexIsCurrent]) {
+                [self unindexMockRegion:[self.mockMonitoredRegions objectAtIndex:index]];
+                [_mockRegionsIndexed removeObjectAtIndex:index];
+            }
+            [self.mockMonitoredRegions removeObjectAtIndex:index];
+        }
     }
     [self.realManager stopMonitoringForRegion:region];
 }
@@ -403,8 +710,11 @@
 #pragma mark dealloc
 
 - (void)dealloc {
-    // just need to stop any active timer
+    // stop any active timers and free the region index
     [self.mockTimer invalidate];
+    [self stopReplayingTrace];
+    LBGeoRegionIndexDestroy(&_mockRegionIndex);
+    CFRelease(_mockRegionHandles);
 }
 
 // restore deprecation warnings
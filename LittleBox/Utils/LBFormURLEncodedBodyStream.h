@@ -0,0 +1,54 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ An NSInputStream that produces an application/x-www-form-urlencoded body from
+ a dictionary of string keys and values, encoding as it's read. Use it as a
+ request's HTTPBodyStream when values are large (e.g. a big base64 blob), so
+ the encoded body never exists in memory all at once:
+ 
+   [LBUtils addStreamingPostBodyParams:params toRequest:request];
+ 
+ contentLength is the exact length of the encoded body, worked out up front in
+ a pass that encodes without keeping anything, and it's what goes in the
+ Content-Length header. Reading then converts and encodes a fixed size chunk at
+ a time straight from the strings, so memory use stays the same however big the
+ body is.
+ 
+ Pairs are encoded exactly as LBUtils urlEncodedParamStringForDict: does them
+ (pairs that aren't strings are skipped there too), so the same dictionary can
+ be given to LBOAuth1Signer.
+ 
+ A stream can only be read once. If the connection needs to send the body
+ again (a redirect or an auth challenge), hand it a copy from
+ connection:needNewBodyStream:.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+@interface LBFormURLEncodedBodyStream : NSInputStream <NSCopying>
+
+// nil if its buffers can't be allocated
++ (LBFormURLEncodedBodyStream *)streamWithParams:(NSDictionary *)params;
+- (id)initWithParams:(NSDictionary *)params;
+
+@property (nonatomic, readonly) unsigned long long contentLength;
+
+@end
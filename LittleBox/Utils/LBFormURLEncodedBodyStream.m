@@ -0,0 +1,253 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#import "LBFormURLEncodedBodyStream.h"
+#import "LBPercentEncoding.h"
+
+// UTF-16 units converted per chunk. each encodes to at most 9 bytes (3 UTF-8
+// bytes, each escaped), and a surrogate pair to 12 from 2 units.
+#define LB_FORM_STREAM_CHUNK_UNITS 4096
+#define LB_FORM_STREAM_RAW_CAPACITY (LB_FORM_STREAM_CHUNK_UNITS * 3)
+#define LB_FORM_STREAM_ENCODED_CAPACITY (LB_FORM_STREAM_RAW_CAPACITY * 3)
+
+// converts as many whole characters as fit from *position on, returning the
+// number of UTF-8 bytes written.
+static size_t copyUTF8Chunk(CFStringRef string, CFIndex length, CFIndex *position, uint8_t *buffer) {
+    CFIndex remaining = length - *position;
+    CFIndex count = remaining < LB_FORM_STREAM_CHUNK_UNITS ? remaining : LB_FORM_STREAM_CHUNK_UNITS;
+    CFIndex used = 0;
+    CFIndex converted = CFStringGetBytes(string, CFRangeMake(*position, count), kCFStringEncodingUTF8, 0, false, buffer, LB_FORM_STREAM_RAW_CAPACITY, &used);
+    if (converted == 0 && count > 0) {
+        // the chunk ended between the halves of a surrogate pair, or the string
+        // has a lone surrogate, which becomes "?" as it would elsewhere.
+        count = remaining < 2 ? remaining : 2;
+        converted = CFStringGetBytes(string, CFRangeMake(*position, count), kCFStringEncodingUTF8, '?', false, buffer, LB_FORM_STREAM_RAW_CAPACITY, &used);
+    }
+    *position += converted;
+    return (size_t)used;
+}
+
+// which part of the body comes next
+typedef enum {
+    LBFormStreamPartSeparator = 0,
+    LBFormStreamPartKey,
+    LBFormStreamPartEquals,
+    LBFormStreamPartValue
+} LBFormStreamPart;
+
+@interface LBFormURLEncodedBodyStream () {
+    NSStreamStatus _status;
+    // where reading is up to: the pair, the part of it, and the position in
+    // the string for that part.
+    NSUInteger _pairIndex;
+    LBFormStreamPart _part;
+    CFIndex _position;
+    // encoded bytes not yet read out
+    uint8_t *_raw;
+    uint8_t *_encoded;
+    size_t _encodedOffset;
+    size_t _encodedLength;
+}
+@property (nonatomic, strong) NSDictionary *params;
+// key, value, key, value..., in the order they're written
+@property (nonatomic, strong) NSArray *parts;
+@property (nonatomic, readwrite) unsigned long long contentLength;
+@property (nonatomic, weak) id<NSStreamDelegate> streamDelegate;
+@end
+
+@implementation LBFormURLEncodedBodyStream
+
++ (LBFormURLEncodedBodyStream *)streamWithParams:(NSDictionary *)params {
+    return [[LBFormURLEncodedBodyStream alloc] initWithParams:params];
+}
+
+- (id)initWithParams:(NSDictionary *)params {
+    // NSInputStream's designated initializers all need a source, so skip them
+    if ((self = [super init])) {
+        self.params = [params copy];
+        NSMutableArray *parts = [NSMutableArray arrayWithCapacity:[params count] * 2];
+        for (id key in self.params) {
+            id value = [self.params objectForKey:key];
+            if ([key isKindOfClass:[NSString class]] && [value isKindOfClass:[NSString class]]) {
+                [parts addObject:key];
+                [parts addObject:value];
+            }
+        }
+        self.parts = parts;
+        _status = NSStreamStatusNotOpen;
+        _raw = malloc(LB_FORM_STREAM_RAW_CAPACITY);
+        _encoded = malloc(LB_FORM_STREAM_ENCODED_CAPACITY);
+        if (!_raw || !_encoded) return nil; // dealloc frees whichever we got
+        self.contentLength = [self measureContentLength];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_raw);
+    free(_encoded);
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    return [[LBFormURLEncodedBodyStream alloc] initWithParams:self.params];
+}
+
+- (unsigned long long)measureContentLength {
+    unsigned long long total = 0;
+    NSUInteger count = [self.parts count];
+    for (NSUInteger i = 0; i < count; i++) {
+        CFStringRef string = (__bridge CFStringRef)[self.parts objectAtIndex:i];
+        CFIndex length = CFStringGetLength(string);
+        CFIndex position = 0;
+        while (position < length) {
+            size_t rawLength = copyUTF8Chunk(string, length, &position, _raw);
+            total += LBPercentEncodedLength(_raw, rawLength);
+        }
+        // "=" after a key, "&" after a value unless it's the last
+        if (i % 2 == 0) total += 1;
+        else if (i + 1 < count) total += 1;
+    }
+    return total;
+}
+
+#pragma mark producing
+
+// refills _encoded with the next piece of the body. returns NO at the end.
+- (BOOL)produce {
+    _encodedOffset = 0;
+    _encodedLength = 0;
+    NSUInteger pairCount = [self.parts count] / 2;
+    while (_encodedLength == 0) {
+        if (_pairIndex >= pairCount) return NO;
+        switch (_part) {
+            case LBFormStreamPartSeparator:
+                if (_pairIndex > 0) _encoded[_encodedLength++] = '&';
+                _part = LBFormStreamPartKey;
+                _position = 0;
+                break;
+            case LBFormStreamPartEquals:
+                _encoded[_encodedLength++] = '=';
+                _part = LBFormStreamPartValue;
+                _position = 0;
+                break;
+            case LBFormStreamPartKey:
+            case LBFormStreamPartValue: {
+                NSUInteger index = _pairIndex * 2 + (_part == LBFormStreamPartValue ? 1 : 0);
+                CFStringRef string = (__bridge CFStringRef)[self.parts objectAtIndex:index];
+                CFIndex length = CFStringGetLength(string);
+                if (_position < length) {
+                    size_t rawLength = copyUTF8Chunk(string, length, &_position, _raw);
+                    _encodedLength = LBPercentEncode(_raw, rawLength, (char *)_encoded);
+                }
+                if (_position >= length) {
+                    if (_part == LBFormStreamPartKey) {
+                        _part = LBFormStreamPartEquals;
+                    } else {
+                        _part = LBFormStreamPartSeparator;
+                        _pairIndex++;
+                    }
+                }
+                break;
+            }
+        }
+    }
+    return YES;
+}
+
+#pragma mark NSInputStream
+
+- (void)open {
+    if (_status == NSStreamStatusNotOpen) _status = NSStreamStatusOpen;
+}
+
+- (void)close {
+    _status = NSStreamStatusClosed;
+}
+
+- (NSStreamStatus)streamStatus {
+    return _status;
+}
+
+- (NSError *)streamError {
+    return nil;
+}
+
+- (NSInteger)read:(uint8_t *)buffer maxLength:(NSUInteger)maxLength {
+    if (_status == NSStreamStatusNotOpen || _status == NSStreamStatusClosed) return -1;
+    if (_status == NSStreamStatusAtEnd) return 0;
+    _status = NSStreamStatusReading;
+    NSUInteger total = 0;
+    while (total < maxLength) {
+        if (_encodedOffset == _encodedLength && ![self produce]) {
+            _status = NSStreamStatusAtEnd;
+            break;
+        }
+        size_t available = _encodedLength - _encodedOffset;
+        size_t take = available < maxLength - total ? available : maxLength - total;
+        memcpy(buffer + total, _encoded + _encodedOffset, take);
+        _encodedOffset += take;
+        total += take;
+    }
+    if (_status == NSStreamStatusReading) _status = NSStreamStatusOpen;
+    return (NSInteger)total;
+}
+
+- (BOOL)getBuffer:(uint8_t **)buffer length:(NSUInteger *)length {
+    return NO;
+}
+
+- (BOOL)hasBytesAvailable {
+    return _status != NSStreamStatusAtEnd && _status != NSStreamStatusClosed;
+}
+
+- (id<NSStreamDelegate>)delegate {
+    return self.streamDelegate;
+}
+
+- (void)setDelegate:(id<NSStreamDelegate>)delegate {
+    self.streamDelegate = delegate;
+}
+
+- (id)propertyForKey:(NSString *)key {
+    return nil;
+}
+
+- (BOOL)setProperty:(id)property forKey:(NSString *)key {
+    return NO;
+}
+
+// the body is always ready, so there's nothing to schedule
+- (void)scheduleInRunLoop:(NSRunLoop *)runLoop forMode:(NSString *)mode {
+}
+
+- (void)removeFromRunLoop:(NSRunLoop *)runLoop forMode:(NSString *)mode {
+}
+
+// NSURLConnection drives body streams through CFReadStream, which calls these
+// on toll-free bridged subclasses. without them a custom subclass crashes.
+- (void)_scheduleInCFRunLoop:(CFRunLoopRef)runLoop forMode:(CFStringRef)mode {
+}
+
+- (void)_unscheduleFromCFRunLoop:(CFRunLoopRef)runLoop forMode:(CFStringRef)mode {
+}
+
+- (BOOL)_setCFClientFlags:(CFOptionFlags)flags callback:(CFReadStreamClientCallBack)callback context:(CFStreamClientContext *)context {
+    return NO;
+}
+
+@end
@@ -0,0 +1,337 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#include "LBGeoRegionIndex.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LB_DEGREES (M_PI / 180.0)
+// the grid is widened by this much (in degrees) around every region, so
+// rounding in the bounding box math can never leave out a cell
+#define LB_GEO_MARGIN 1e-7
+
+#pragma mark - geometry
+
+static inline double haversine(double latitude1, double cosLatitude1, double latitude2, double longitude1, double longitude2) {
+    double sinLatitude = sin((latitude2 - latitude1) * LB_DEGREES / 2);
+    double sinLongitude = sin((longitude2 - longitude1) * LB_DEGREES / 2);
+    return sinLatitude * sinLatitude + cosLatitude1 * cos(latitude2 * LB_DEGREES) * sinLongitude * sinLongitude;
+}
+
+double LBGeoDistance(double latitude1, double longitude1, double latitude2, double longitude2) {
+    double h = haversine(latitude1, cos(latitude1 * LB_DEGREES), latitude2, longitude1, longitude2);
+    return 2 * LB_GEO_EARTH_RADIUS * asin(sqrt(h < 1.0 ? h : 1.0));
+}
+
+// containment with the point's cosine already worked out, as it's the same for
+// every region a query tests
+static inline bool regionContains(const LBGeoRegion *region, double latitude, double cosLatitude, double longitude) {
+    double sinLatitude = sin((latitude - region->latitude) * LB_DEGREES / 2);
+    double sinLongitude = sin((longitude - region->longitude) * LB_DEGREES / 2);
+    double h = sinLatitude * sinLatitude + region->cosLatitude * cosLatitude * sinLongitude * sinLongitude;
+    return h <= region->maxHaversine;
+}
+
+#pragma mark - grid
+
+static inline int32_t floorMod(int32_t value, int32_t modulus) {
+    int32_t result = value % modulus;
+    return result < 0 ? result + modulus : result;
+}
+
+static inline int32_t rowForLatitude(const LBGeoRegionIndex *index, double latitude) {
+    int32_t row = (int32_t)floor((latitude + 90.0) / index->cellDegrees);
+    return row < 0 ? 0 : (row >= index->rows ? index->rows - 1 : row);
+}
+
+static inline int32_t colForLongitude(const LBGeoRegionIndex *index, double longitude) {
+    return floorMod((int32_t)floor((longitude + 180.0) / index->cellDegrees), index->cols);
+}
+
+static inline uint64_t cellKey(int32_t row, int32_t col) {
+    return ((uint64_t)(uint32_t)row << 32) | (uint32_t)col;
+}
+
+static inline size_t cellSlot(uint64_t key, size_t capacity) {
+    // fibonacci hashing spreads neighbouring cells across the table
+    return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 20) & (capacity - 1);
+}
+
+// the cell's slot, or the empty slot where it would go. cells are never
+// deleted, only emptied, so probing never has to skip tombstones.
+static LBGeoCell *findCell(const LBGeoRegionIndex *index, uint64_t key) {
+    size_t slot = cellSlot(key, index->cellCapacity);
+    while (index->cells[slot].handles && index->cells[slot].key != key) {
+        slot = (slot + 1) & (index->cellCapacity - 1);
+    }
+    return &index->cells[slot];
+}
+
+static bool growCells(LBGeoRegionIndex *index) {
+    size_t capacity = index->cellCapacity * 2;
+    LBGeoCell *cells = calloc(capacity, sizeof(LBGeoCell));
+    if (!cells) return false;
+    LBGeoCell *old = index->cells;
+    size_t oldCapacity = index->cellCapacity;
+    index->cells = cells;
+    index->cellCapacity = capacity;
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (old[i].handles) *findCell(index, old[i].key) = old[i];
+    }
+    free(old);
+    return true;
+}
+
+static bool addToCell(LBGeoRegionIndex *index, int32_t row, int32_t col, uint32_t handle) {
+    uint64_t key = cellKey(row, col);
+    LBGeoCell *cell = findCell(index, key);
+    if (!cell->handles) {
+        if ((index->cellCount + 1) * 10 > index->cellCapacity * 7) {
+            if (!growCells(index)) return false;
+            cell = findCell(index, key);
+        }
+        cell->handles = malloc(4 * sizeof(uint32_t));
+        if (!cell->handles) return false;
+        cell->key = key;
+        cell->count = 0;
+        cell->capacity = 4;
+        index->cellCount++;
+    }
+    if (cell->count == cell->capacity) {
+        uint32_t *handles = realloc(cell->handles, 2 * cell->capacity * sizeof(uint32_t));
+        if (!handles) return false;
+        cell->handles = handles;
+        cell->capacity *= 2;
+    }
+    cell->handles[cell->count++] = handle;
+    return true;
+}
+
+static void removeFromList(uint32_t *handles, size_t *count, uint32_t handle) {
+    for (size_t i = 0; i < *count; i++) {
+        if (handles[i] == handle) {
+            handles[i] = handles[--*count];
+            return;
+        }
+    }
+}
+
+static void removeFromCell(LBGeoRegionIndex *index, int32_t row, int32_t col, uint32_t handle) {
+    LBGeoCell *cell = findCell(index, cellKey(row, col));
+    if (!cell->handles) return;
+    size_t count = cell->count;
+    removeFromList(cell->handles, &count, handle);
+    cell->count = (uint32_t)count;
+}
+
+// files a region under its cells, or on the big list. on failure the region
+// is left filed nowhere.
+static bool fileRegion(LBGeoRegionIndex *index, size_t handle) {
+    LBGeoRegion *region = &index->regions[handle];
+    double angle = region->radius / LB_GEO_EARTH_RADIUS; // radians
+    double latitudeSpan = angle / LB_DEGREES + LB_GEO_MARGIN;
+    double cosLatitude = region->cosLatitude;
+    // the widest a circle gets in longitude is asin(sin(angle) / cos(latitude))
+    bool big = angle >= M_PI / 2 || sin(angle) >= cosLatitude;
+    if (!big) {
+        double longitudeSpan = asin(sin(angle) / cosLatitude) / LB_DEGREES + LB_GEO_MARGIN;
+        int32_t rowMin = rowForLatitude(index, region->latitude - latitudeSpan);
+        int32_t rowMax = rowForLatitude(index, region->latitude + latitudeSpan);
+        int32_t colMin = (int32_t)floor((region->longitude - longitudeSpan + 180.0) / index->cellDegrees);
+        int32_t colMax = (int32_t)floor((region->longitude + longitudeSpan + 180.0) / index->cellDegrees);
+        int64_t cells = (int64_t)(rowMax - rowMin + 1) * (colMax - colMin + 1);
+        if (colMax - colMin + 1 >= index->cols || cells > LB_GEO_REGION_MAX_CELLS) {
+            big = true;
+        } else {
+            region->rowMin = rowMin;
+            region->rowMax = rowMax;
+            region->colMin = colMin;
+            region->colMax = colMax;
+            for (int32_t row = rowMin; row <= rowMax; row++) {
+                for (int32_t col = colMin; col <= colMax; col++) {
+                    if (!addToCell(index, row, floorMod(col, index->cols), (uint32_t)handle)) {
+                        // undo the part that made it in
+                        region->rowMax = row;
+                        region->colMax = col - 1;
+                        for (int32_t r = rowMin; r <= row; r++) {
+                            for (int32_t c = colMin; c <= (r == row ? col - 1 : colMax); c++) {
+                                removeFromCell(index, r, floorMod(c, index->cols), (uint32_t)handle);
+                            }
+                        }
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+    }
+    region->rowMin = 1;
+    region->rowMax = 0;
+    if (index->bigCount == index->bigCapacity) {
+        size_t capacity = index->bigCapacity ? index->bigCapacity * 2 : 8;
+        uint32_t *bigRegions = realloc(index->bigRegions, capacity * sizeof(uint32_t));
+        if (!bigRegions) return false;
+        index->bigRegions = bigRegions;
+        index->bigCapacity = capacity;
+    }
+    index->bigRegions[index->bigCount++] = (uint32_t)handle;
+    return true;
+}
+
+static void unfileRegion(LBGeoRegionIndex *index, size_t handle) {
+    LBGeoRegion *region = &index->regions[handle];
+    if (region->rowMin > region->rowMax) {
+        removeFromList(index->bigRegions, &index->bigCount, (uint32_t)handle);
+        return;
+    }
+    for (int32_t row = region->rowMin; row <= region->rowMax; row++) {
+        for (int32_t col = region->colMin; col <= region->colMax; col++) {
+            removeFromCell(index, row, floorMod(col, index->cols), (uint32_t)handle);
+        }
+    }
+}
+
+#pragma mark - index
+
+bool LBGeoRegionIndexInit(LBGeoRegionIndex *index, double cellDegrees) {
+    memset(index, 0, sizeof(*index));
+    index->cellDegrees = cellDegrees > 0 ? cellDegrees : LBGeoRegionIndexDefaultCellDegrees;
+    index->rows = (int32_t)ceil(180.0 / index->cellDegrees);
+    index->cols = (int32_t)ceil(360.0 / index->cellDegrees);
+    index->cellCapacity = 64;
+    index->cells = calloc(index->cellCapacity, sizeof(LBGeoCell));
+    return index->cells != NULL;
+}
+
+void LBGeoRegionIndexDestroy(LBGeoRegionIndex *index) {
+    for (size_t i = 0; i < index->cellCapacity; i++) {
+        free(index->cells[i].handles);
+    }
+    free(index->cells);
+    free(index->regions);
+    free(index->freeHandles);
+    free(index->bigRegions);
+    memset(index, 0, sizeof(*index));
+}
+
+size_t LBGeoRegionIndexAdd(LBGeoRegionIndex *index, double latitude, double longitude, double radius) {
+    if (!(latitude >= -90.0 && latitude <= 90.0) || !(radius >= 0.0) || !isfinite(longitude)) return LBGeoRegionNoHandle;
+    size_t handle;
+    if (index->freeCount) {
+        handle = index->freeHandles[index->freeCount - 1];
+    } else {
+        if (index->regionLimit == index->regionCapacity) {
+            size_t capacity = index->regionCapacity ? index->regionCapacity * 2 : 16;
+            if (capacity > UINT32_MAX) return LBGeoRegionNoHandle;
+            LBGeoRegion *regions = realloc(index->regions, capacity * sizeof(LBGeoRegion));
+            if (!regions) return LBGeoRegionNoHandle;
+            index->regions = regions;
+            size_t *freeHandles = realloc(index->freeHandles, capacity * sizeof(size_t));
+            if (!freeHandles) return LBGeoRegionNoHandle;
+            index->freeHandles = freeHandles;
+            index->regionCapacity = capacity;
+        }
+        handle = index->regionLimit;
+    }
+    LBGeoRegion *region = &index->regions[handle];
+    memset(region, 0, sizeof(*region));
+    region->latitude = latitude;
+    region->longitude = longitude;
+    region->radius = radius;
+    region->cosLatitude = cos(latitude * LB_DEGREES);
+    double halfAngle = radius / LB_GEO_EARTH_RADIUS / 2;
+    region->maxHaversine = halfAngle >= M_PI / 2 ? 1.0 : sin(halfAngle) * sin(halfAngle);
+    if (!fileRegion(index, handle)) return LBGeoRegionNoHandle;
+    region->inUse = true;
+    if (index->freeCount && index->freeHandles[index->freeCount - 1] == handle) {
+        index->freeCount--;
+    } else {
+        index->regionLimit++;
+    }
+    index->count++;
+    return handle;
+}
+
+void LBGeoRegionIndexRemove(LBGeoRegionIndex *index, size_t handle) {
+    if (handle >= index->regionLimit || !index->regions[handle].inUse) return;
+    unfileRegion(index, handle);
+    index->regions[handle].inUse = false;
+    index->freeHandles[index->freeCount++] = handle;
+    index->count--;
+}
+
+size_t LBGeoRegionIndexCount(const LBGeoRegionIndex *index) {
+    return index->count;
+}
+
+bool LBGeoRegionIndexContains(const LBGeoRegionIndex *index, size_t handle, double latitude, double longitude) {
+    if (handle >= index->regionLimit || !index->regions[handle].inUse) return false;
+    return regionContains(&index->regions[handle], latitude, cos(latitude * LB_DEGREES), longitude);
+}
+
+#pragma mark - crossings
+
+typedef struct {
+    double oldLatitude, oldCos, oldLongitude;
+    double newLatitude, newCos, newLongitude;
+    LBGeoRegionCrossingFunction crossed;
+    void *context;
+    size_t crossings;
+} LBGeoCrossingQuery;
+
+static void testRegions(LBGeoRegionIndex *index, const uint32_t *handles, size_t count, LBGeoCrossingQuery *query) {
+    for (size_t i = 0; i < count; i++) {
+        LBGeoRegion *region = &index->regions[handles[i]];
+        if (region->stamp == index->stamp) continue;
+        region->stamp = index->stamp;
+        bool wasInside = regionContains(region, query->oldLatitude, query->oldCos, query->oldLongitude);
+        bool isInside = regionContains(region, query->newLatitude, query->newCos, query->newLongitude);
+        if (wasInside != isInside) {
+            query->crossings++;
+            if (query->crossed) query->crossed(handles[i], isInside, query->context);
+        }
+    }
+}
+
+static void testCell(LBGeoRegionIndex *index, double latitude, double longitude, LBGeoCrossingQuery *query) {
+    LBGeoCell *cell = findCell(index, cellKey(rowForLatitude(index, latitude), colForLongitude(index, longitude)));
+    if (cell->handles) testRegions(index, cell->handles, cell->count, query);
+}
+
+size_t LBGeoRegionIndexCrossings(LBGeoRegionIndex *index,
+                                 double oldLatitude, double oldLongitude,
+                                 double newLatitude, double newLongitude,
+                                 LBGeoRegionCrossingFunction crossed, void *context) {
+    if (!index->count) return 0;
+    if (++index->stamp == 0) {
+        // wrapped around, so old stamps could collide with new ones
+        for (size_t i = 0; i < index->regionLimit; i++) index->regions[i].stamp = 0;
+        index->stamp = 1;
+    }
+    LBGeoCrossingQuery query = {
+        oldLatitude, cos(oldLatitude * LB_DEGREES), oldLongitude,
+        newLatitude, cos(newLatitude * LB_DEGREES), newLongitude,
+        crossed, context, 0
+    };
+    // a region that contains either point is filed under that point's cell
+    testCell(index, oldLatitude, oldLongitude, &query);
+    testCell(index, newLatitude, newLongitude, &query);
+    testRegions(index, index->bigRegions, index->bigCount, &query);
+    return query.crossings;
+}
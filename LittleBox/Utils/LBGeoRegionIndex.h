@@ -0,0 +1,138 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ A spatial index of circular geographic regions (center latitude/longitude in
+ degrees, radius in meters) that answers "which regions did moving from here to
+ there enter or exit?" without testing every region. It's what
+ LBCLLocationManagerProxy checks mock region crossings with. It's plain C with
+ no CoreLocation dependency, so it can be built and exercised anywhere.
+ 
+ The globe is divided into a grid of square cells cellDegrees on a side, and
+ each region is filed under every cell its bounding box touches. A region can
+ only contain a point if it's filed under the point's cell, so a move only tests
+ the regions filed under the old and new cells, each region once. Regions so big
+ that they'd be filed under more than LB_GEO_REGION_MAX_CELLS cells (or that
+ reach a pole) are instead kept on a short list that every query tests.
+ 
+ Containment is a great circle (haversine) distance on a spherical earth of
+ LB_GEO_EARTH_RADIUS meters, compared without any inverse trig. It agrees with
+ CoreLocation's own containment to well under a meter at region sizes
+ CoreLocation monitors, but points right on a boundary may go either way.
+ 
+ Each region gets a handle (reused after removal) when it's added. The index
+ allocates as it grows and is not thread-safe; callers supply locking.
+ 
+ Typical use:
+ 
+   LBGeoRegionIndex index;
+   LBGeoRegionIndexInit(&index, LBGeoRegionIndexDefaultCellDegrees);
+   size_t handle = LBGeoRegionIndexAdd(&index, 37.7793, -122.4193, 200.0);
+   LBGeoRegionIndexCrossings(&index, oldLat, oldLon, newLat, newLon, myCrossingFunction, myContext);
+   LBGeoRegionIndexDestroy(&index);
+ 
+ */
+
+#ifndef LBGeoRegionIndex_h
+#define LBGeoRegionIndex_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LB_GEO_EARTH_RADIUS 6371008.8
+#define LB_GEO_REGION_MAX_CELLS 64
+#define LBGeoRegionIndexDefaultCellDegrees 0.01 // about 1.1km north to south
+#define LBGeoRegionNoHandle ((size_t)-1)
+
+typedef struct {
+    double latitude;
+    double longitude;
+    double radius;
+    // precomputed for containment tests
+    double cosLatitude;
+    double maxHaversine;
+    // the cells it's filed under, or rowMin > rowMax if it's on the big list
+    int32_t rowMin, rowMax, colMin, colMax;
+    uint32_t stamp; // last query that tested it, so no query tests it twice
+    bool inUse;
+} LBGeoRegion;
+
+typedef struct {
+    uint64_t key;
+    uint32_t *handles;
+    uint32_t count;
+    uint32_t capacity;
+} LBGeoCell;
+
+typedef struct {
+    double cellDegrees;
+    int32_t rows;
+    int32_t cols;
+    LBGeoRegion *regions;
+    size_t regionCapacity;
+    size_t regionLimit; // handles below this have been given out at some point
+    size_t count;
+    size_t *freeHandles;
+    size_t freeCount;
+    LBGeoCell *cells; // open addressing, a power of two of them
+    size_t cellCapacity;
+    size_t cellCount;
+    uint32_t *bigRegions;
+    size_t bigCount;
+    size_t bigCapacity;
+    uint32_t stamp;
+} LBGeoRegionIndex;
+
+// called for each region whose containment differs between the old and new
+// points. entered is true if the new point is inside.
+typedef void (*LBGeoRegionCrossingFunction)(size_t handle, bool entered, void *context);
+
+// great circle distance in meters
+double LBGeoDistance(double latitude1, double longitude1, double latitude2, double longitude2);
+
+// returns false if out of memory. cellDegrees <= 0 means the default.
+bool LBGeoRegionIndexInit(LBGeoRegionIndex *index, double cellDegrees);
+void LBGeoRegionIndexDestroy(LBGeoRegionIndex *index);
+
+// returns LBGeoRegionNoHandle if out of memory or the region is invalid
+// (latitude outside -90..90, or a negative radius).
+size_t LBGeoRegionIndexAdd(LBGeoRegionIndex *index, double latitude, double longitude, double radius);
+void LBGeoRegionIndexRemove(LBGeoRegionIndex *index, size_t handle);
+size_t LBGeoRegionIndexCount(const LBGeoRegionIndex *index);
+
+bool LBGeoRegionIndexContains(const LBGeoRegionIndex *index, size_t handle, double latitude, double longitude);
+
+// calls crossed() for every region entered or exited by moving from the old
+// point to the new one, and returns how many there were. the index may not be
+// changed from inside crossed().
+size_t LBGeoRegionIndexCrossings(LBGeoRegionIndex *index,
+                                 double oldLatitude, double oldLongitude,
+                                 double newLatitude, double newLongitude,
+                                 LBGeoRegionCrossingFunction crossed, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
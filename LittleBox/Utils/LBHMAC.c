@@ -0,0 +1,487 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#include "LBHMAC.h"
+#include <string.h>
+
+#if (defined(__aarch64__) || defined(__arm64__)) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2))
+#define LB_HASH_ARM 1
+#include <arm_neon.h>
+#elif (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define LB_HASH_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+typedef void (*LBHashBlockFunction)(uint32_t *state, const uint8_t *data, size_t blocks);
+
+static const uint32_t kSHA1InitialState[5] = {
+    0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+};
+
+static const uint32_t kSHA256InitialState[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+static const uint32_t kSHA256RoundConstants[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+static inline uint32_t rotateLeft(uint32_t value, unsigned bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static inline uint32_t rotateRight(uint32_t value, unsigned bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+static inline uint32_t loadBigEndian(const uint8_t *bytes) {
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+static inline void storeBigEndian(uint8_t *bytes, uint32_t value) {
+    bytes[0] = (uint8_t)(value >> 24);
+    bytes[1] = (uint8_t)(value >> 16);
+    bytes[2] = (uint8_t)(value >> 8);
+    bytes[3] = (uint8_t)value;
+}
+
+#pragma mark - scalar
+
+static void sha1BlocksScalar(uint32_t *state, const uint8_t *data, size_t blocks) {
+    while (blocks--) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) w[i] = loadBigEndian(data + 4 * i);
+        for (int i = 16; i < 80; i++) w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+#define LB_SHA1_ROUND(f, k) do { \
+            uint32_t temp = rotateLeft(a, 5) + (f) + e + (k) + w[i]; \
+            e = d; \
+            d = c; \
+            c = rotateLeft(b, 30); \
+            b = a; \
+            a = temp; \
+        } while (0)
+        int i = 0;
+        for (; i < 20; i++) LB_SHA1_ROUND((b & c) | (~b & d), 0x5A827999);
+        for (; i < 40; i++) LB_SHA1_ROUND(b ^ c ^ d, 0x6ED9EBA1);
+        for (; i < 60; i++) LB_SHA1_ROUND((b & c) | (b & d) | (c & d), 0x8F1BBCDC);
+        for (; i < 80; i++) LB_SHA1_ROUND(b ^ c ^ d, 0xCA62C1D6);
+#undef LB_SHA1_ROUND
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        data += LB_HASH_BLOCK_LENGTH;
+    }
+}
+
+static void sha256BlocksScalar(uint32_t *state, const uint8_t *data, size_t blocks) {
+    while (blocks--) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) w[i] = loadBigEndian(data + 4 * i);
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+            uint32_t choice = (e & f) ^ (~e & g);
+            uint32_t temp1 = h + s1 + choice + kSHA256RoundConstants[i] + w[i];
+            uint32_t s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+            uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t temp2 = s0 + majority;
+            h = g;
+            g = f;
+            f = e;
+            e = d + temp1;
+            d = c;
+            c = b;
+            b = a;
+            a = temp1 + temp2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+        data += LB_HASH_BLOCK_LENGTH;
+    }
+}
+
+#pragma mark - ARMv8 crypto extensions
+
+#if LB_HASH_ARM
+
+// each step below is four rounds. the message schedule runs a few rounds
+// ahead in four rotating registers. steps are macros with literal round
+// numbers so the conditions fold away and the registers stay registers.
+
+static inline uint32x4_t loadWordsARM(const uint8_t *data) {
+    return vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data)));
+}
+
+#define LB_SHA1_ARM_STEP(q, e, next, round) do { \
+    next = vsha1h_u32(vgetq_lane_u32(abcd, 0)); \
+    abcd = round(abcd, e, t[(q) & 1]); \
+    if ((q) + 2 < 20) t[(q) & 1] = vaddq_u32(w[((q) + 2) & 3], vdupq_n_u32(roundConstants[((q) + 2) / 5])); \
+    if ((q) >= 1 && (q) <= 16) w[((q) + 3) & 3] = vsha1su1q_u32(w[((q) + 3) & 3], w[((q) + 2) & 3]); \
+    if ((q) <= 15) w[(q) & 3] = vsha1su0q_u32(w[(q) & 3], w[((q) + 1) & 3], w[((q) + 2) & 3]); \
+} while (0)
+
+static void sha1BlocksARM(uint32_t *state, const uint8_t *data, size_t blocks) {
+    static const uint32_t roundConstants[4] = { 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6 };
+    uint32x4_t abcd = vld1q_u32(state);
+    uint32_t e0 = state[4];
+    while (blocks--) {
+        uint32x4_t savedABCD = abcd;
+        uint32_t savedE = e0;
+        uint32_t e1;
+        uint32x4_t w[4], t[2];
+        for (int i = 0; i < 4; i++) w[i] = loadWordsARM(data + 16 * i);
+        t[0] = vaddq_u32(w[0], vdupq_n_u32(roundConstants[0]));
+        t[1] = vaddq_u32(w[1], vdupq_n_u32(roundConstants[0]));
+        LB_SHA1_ARM_STEP(0, e0, e1, vsha1cq_u32);
+        LB_SHA1_ARM_STEP(1, e1, e0, vsha1cq_u32);
+        LB_SHA1_ARM_STEP(2, e0, e1, vsha1cq_u32);
+        LB_SHA1_ARM_STEP(3, e1, e0, vsha1cq_u32);
+        LB_SHA1_ARM_STEP(4, e0, e1, vsha1cq_u32);
+        LB_SHA1_ARM_STEP(5, e1, e0, vsha1pq_u32);
+        LB_SHA1_ARM_STEP(6, e0, e1, vsha1pq_u32);
+        LB_SHA1_ARM_STEP(7, e1, e0, vsha1pq_u32);
+        LB_SHA1_ARM_STEP(8, e0, e1, vsha1pq_u32);
+        LB_SHA1_ARM_STEP(9, e1, e0, vsha1pq_u32);
+        LB_SHA1_ARM_STEP(10, e0, e1, vsha1mq_u32);
+        LB_SHA1_ARM_STEP(11, e1, e0, vsha1mq_u32);
+        LB_SHA1_ARM_STEP(12, e0, e1, vsha1mq_u32);
+        LB_SHA1_ARM_STEP(13, e1, e0, vsha1mq_u32);
+        LB_SHA1_ARM_STEP(14, e0, e1, vsha1mq_u32);
+        LB_SHA1_ARM_STEP(15, e1, e0, vsha1pq_u32);
+        LB_SHA1_ARM_STEP(16, e0, e1, vsha1pq_u32);
+        LB_SHA1_ARM_STEP(17, e1, e0, vsha1pq_u32);
+        LB_SHA1_ARM_STEP(18, e0, e1, vsha1pq_u32);
+        LB_SHA1_ARM_STEP(19, e1, e0, vsha1pq_u32);
+        abcd = vaddq_u32(abcd, savedABCD);
+        e0 += savedE;
+        data += LB_HASH_BLOCK_LENGTH;
+    }
+    vst1q_u32(state, abcd);
+    state[4] = e0;
+}
+
+#define LB_SHA256_ARM_STEP(q) do { \
+    if ((q) < 12) w[(q) & 3] = vsha256su0q_u32(w[(q) & 3], w[((q) + 1) & 3]); \
+    uint32x4_t previous = state0; \
+    if ((q) < 15) t[((q) + 1) & 1] = vaddq_u32(w[((q) + 1) & 3], vld1q_u32(kSHA256RoundConstants + 4 * ((q) + 1))); \
+    state0 = vsha256hq_u32(state0, state1, t[(q) & 1]); \
+    state1 = vsha256h2q_u32(state1, previous, t[(q) & 1]); \
+    if ((q) < 12) w[(q) & 3] = vsha256su1q_u32(w[(q) & 3], w[((q) + 2) & 3], w[((q) + 3) & 3]); \
+} while (0)
+
+static void sha256BlocksARM(uint32_t *state, const uint8_t *data, size_t blocks) {
+    uint32x4_t state0 = vld1q_u32(state);
+    uint32x4_t state1 = vld1q_u32(state + 4);
+    while (blocks--) {
+        uint32x4_t saved0 = state0;
+        uint32x4_t saved1 = state1;
+        uint32x4_t w[4], t[2];
+        for (int i = 0; i < 4; i++) w[i] = loadWordsARM(data + 16 * i);
+        t[0] = vaddq_u32(w[0], vld1q_u32(kSHA256RoundConstants));
+        LB_SHA256_ARM_STEP(0);
+        LB_SHA256_ARM_STEP(1);
+        LB_SHA256_ARM_STEP(2);
+        LB_SHA256_ARM_STEP(3);
+        LB_SHA256_ARM_STEP(4);
+        LB_SHA256_ARM_STEP(5);
+        LB_SHA256_ARM_STEP(6);
+        LB_SHA256_ARM_STEP(7);
+        LB_SHA256_ARM_STEP(8);
+        LB_SHA256_ARM_STEP(9);
+        LB_SHA256_ARM_STEP(10);
+        LB_SHA256_ARM_STEP(11);
+        LB_SHA256_ARM_STEP(12);
+        LB_SHA256_ARM_STEP(13);
+        LB_SHA256_ARM_STEP(14);
+        LB_SHA256_ARM_STEP(15);
+        state0 = vaddq_u32(state0, saved0);
+        state1 = vaddq_u32(state1, saved1);
+        data += LB_HASH_BLOCK_LENGTH;
+    }
+    vst1q_u32(state, state0);
+    vst1q_u32(state + 4, state1);
+}
+
+#endif
+
+#pragma mark - SHA-NI
+
+#if LB_HASH_X86
+
+// same shape as the ARM versions: four rounds per step, the message schedule
+// kept a few rounds ahead in four rotating registers.
+
+#define LB_TARGET_SHANI __attribute__((target("sha,sse4.1")))
+
+#define LB_SHA1_SHANI_STEP(q, e, next) do { \
+    e = _mm_sha1nexte_epu32(e, w[(q) & 3]); \
+    next = abcd; \
+    if ((q) >= 3 && (q) <= 18) w[((q) + 1) & 3] = _mm_sha1msg2_epu32(w[((q) + 1) & 3], w[(q) & 3]); \
+    abcd = _mm_sha1rnds4_epu32(abcd, e, (q) / 5); \
+    if ((q) <= 16) w[((q) + 3) & 3] = _mm_sha1msg1_epu32(w[((q) + 3) & 3], w[(q) & 3]); \
+    if ((q) >= 2 && (q) <= 17) w[((q) + 2) & 3] = _mm_xor_si128(w[((q) + 2) & 3], w[(q) & 3]); \
+} while (0)
+
+LB_TARGET_SHANI static void sha1BlocksSHANI(uint32_t *state, const uint8_t *data, size_t blocks) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090A0B0C0D0E0FULL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+    __m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+    while (blocks--) {
+        __m128i savedABCD = abcd;
+        __m128i savedE = e0;
+        __m128i e1;
+        __m128i w[4];
+        for (int i = 0; i < 4; i++) {
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * i)), byteSwap);
+        }
+        e0 = _mm_add_epi32(e0, w[0]);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        LB_SHA1_SHANI_STEP(1, e1, e0);
+        LB_SHA1_SHANI_STEP(2, e0, e1);
+        LB_SHA1_SHANI_STEP(3, e1, e0);
+        LB_SHA1_SHANI_STEP(4, e0, e1);
+        LB_SHA1_SHANI_STEP(5, e1, e0);
+        LB_SHA1_SHANI_STEP(6, e0, e1);
+        LB_SHA1_SHANI_STEP(7, e1, e0);
+        LB_SHA1_SHANI_STEP(8, e0, e1);
+        LB_SHA1_SHANI_STEP(9, e1, e0);
+        LB_SHA1_SHANI_STEP(10, e0, e1);
+        LB_SHA1_SHANI_STEP(11, e1, e0);
+        LB_SHA1_SHANI_STEP(12, e0, e1);
+        LB_SHA1_SHANI_STEP(13, e1, e0);
+        LB_SHA1_SHANI_STEP(14, e0, e1);
+        LB_SHA1_SHANI_STEP(15, e1, e0);
+        LB_SHA1_SHANI_STEP(16, e0, e1);
+        LB_SHA1_SHANI_STEP(17, e1, e0);
+        LB_SHA1_SHANI_STEP(18, e0, e1);
+        LB_SHA1_SHANI_STEP(19, e1, e0);
+        e0 = _mm_sha1nexte_epu32(e0, savedE);
+        abcd = _mm_add_epi32(abcd, savedABCD);
+        data += LB_HASH_BLOCK_LENGTH;
+    }
+    _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+#define LB_SHA256_SHANI_STEP(q) do { \
+    __m128i message = _mm_add_epi32(w[(q) & 3], _mm_loadu_si128((const __m128i *)(kSHA256RoundConstants + 4 * (q)))); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, message); \
+    if ((q) >= 3 && (q) <= 14) { \
+        __m128i shifted = _mm_alignr_epi8(w[(q) & 3], w[((q) + 3) & 3], 4); \
+        w[((q) + 1) & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(w[((q) + 1) & 3], shifted), w[(q) & 3]); \
+    } \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(message, 0x0E)); \
+    if ((q) >= 1 && (q) <= 12) w[((q) + 3) & 3] = _mm_sha256msg1_epu32(w[((q) + 3) & 3], w[(q) & 3]); \
+} while (0)
+
+LB_TARGET_SHANI static void sha256BlocksSHANI(uint32_t *state, const uint8_t *data, size_t blocks) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+    // the instructions want the state as ABEF and CDGH
+    __m128i cdab = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0xB1);
+    __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(state + 4)), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(cdab, efgh, 8);
+    __m128i state1 = _mm_blend_epi16(efgh, cdab, 0xF0);
+    while (blocks--) {
+        __m128i saved0 = state0;
+        __m128i saved1 = state1;
+        __m128i w[4];
+        for (int i = 0; i < 4; i++) {
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * i)), byteSwap);
+        }
+        LB_SHA256_SHANI_STEP(0);
+        LB_SHA256_SHANI_STEP(1);
+        LB_SHA256_SHANI_STEP(2);
+        LB_SHA256_SHANI_STEP(3);
+        LB_SHA256_SHANI_STEP(4);
+        LB_SHA256_SHANI_STEP(5);
+        LB_SHA256_SHANI_STEP(6);
+        LB_SHA256_SHANI_STEP(7);
+        LB_SHA256_SHANI_STEP(8);
+        LB_SHA256_SHANI_STEP(9);
+        LB_SHA256_SHANI_STEP(10);
+        LB_SHA256_SHANI_STEP(11);
+        LB_SHA256_SHANI_STEP(12);
+        LB_SHA256_SHANI_STEP(13);
+        LB_SHA256_SHANI_STEP(14);
+        LB_SHA256_SHANI_STEP(15);
+        state0 = _mm_add_epi32(state0, saved0);
+        state1 = _mm_add_epi32(state1, saved1);
+        data += LB_HASH_BLOCK_LENGTH;
+    }
+    // and back to ABCD EFGH
+    __m128i feba = _mm_shuffle_epi32(state0, 0x1B);
+    __m128i dchg = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128((__m128i *)state, _mm_blend_epi16(feba, dchg, 0xF0));
+    _mm_storeu_si128((__m128i *)(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+}
+
+static int hasSHANI(void) {
+    // racing threads all compute the same answer, so no locking needed
+    static volatile int supported = -1;
+    if (supported < 0) {
+        unsigned int eax, ebx, ecx, edx;
+        int sse41 = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1u << 19)) && (ecx & (1u << 9));
+        int sha = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29));
+        supported = sse41 && sha;
+    }
+    return supported;
+}
+
+#endif
+
+#pragma mark - block dispatch
+
+static LBHashBlockFunction blockFunction(LBHashAlgorithm algorithm) {
+#if LB_HASH_ARM
+    return algorithm == LBHashSHA256 ? sha256BlocksARM : sha1BlocksARM;
+#elif LB_HASH_X86
+    if (hasSHANI()) return algorithm == LBHashSHA256 ? sha256BlocksSHANI : sha1BlocksSHANI;
+#endif
+    return algorithm == LBHashSHA256 ? sha256BlocksScalar : sha1BlocksScalar;
+}
+
+#pragma mark - hashing
+
+size_t LBHashDigestLength(LBHashAlgorithm algorithm) {
+    return algorithm == LBHashSHA256 ? LB_SHA256_DIGEST_LENGTH : LB_SHA1_DIGEST_LENGTH;
+}
+
+void LBHashInit(LBHashContext *context, LBHashAlgorithm algorithm) {
+    context->algorithm = algorithm;
+    if (algorithm == LBHashSHA256) {
+        memcpy(context->state, kSHA256InitialState, sizeof(kSHA256InitialState));
+    } else {
+        memcpy(context->state, kSHA1InitialState, sizeof(kSHA1InitialState));
+    }
+    context->length = 0;
+    context->bufferLength = 0;
+}
+
+void LBHashUpdate(LBHashContext *context, const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    LBHashBlockFunction blocks = blockFunction(context->algorithm);
+    context->length += length;
+    if (context->bufferLength) {
+        size_t take = LB_HASH_BLOCK_LENGTH - context->bufferLength;
+        if (take > length) take = length;
+        memcpy(context->buffer + context->bufferLength, bytes, take);
+        context->bufferLength += take;
+        bytes += take;
+        length -= take;
+        if (context->bufferLength < LB_HASH_BLOCK_LENGTH) return;
+        blocks(context->state, context->buffer, 1);
+        context->bufferLength = 0;
+    }
+    // whole blocks straight from the input
+    size_t wholeBlocks = length / LB_HASH_BLOCK_LENGTH;
+    if (wholeBlocks) {
+        blocks(context->state, bytes, wholeBlocks);
+        bytes += wholeBlocks * LB_HASH_BLOCK_LENGTH;
+        length -= wholeBlocks * LB_HASH_BLOCK_LENGTH;
+    }
+    if (length) {
+        memcpy(context->buffer, bytes, length);
+        context->bufferLength = length;
+    }
+}
+
+void LBHashFinal(LBHashContext *context, uint8_t *digest) {
+    // a 1 bit, zeros, then the length in bits in the last 8 bytes of a block
+    uint64_t bitLength = context->length * 8;
+    uint8_t padding[2 * LB_HASH_BLOCK_LENGTH] = { 0x80 };
+    size_t paddingLength = (context->bufferLength < 56 ? 56 : 120) - context->bufferLength;
+    LBHashUpdate(context, padding, paddingLength);
+    uint8_t lengthBytes[8];
+    storeBigEndian(lengthBytes, (uint32_t)(bitLength >> 32));
+    storeBigEndian(lengthBytes + 4, (uint32_t)bitLength);
+    LBHashUpdate(context, lengthBytes, 8);
+    size_t words = LBHashDigestLength(context->algorithm) / 4;
+    for (size_t i = 0; i < words; i++) {
+        storeBigEndian(digest + 4 * i, context->state[i]);
+    }
+}
+
+void LBHash(LBHashAlgorithm algorithm, const void *data, size_t length, uint8_t *digest) {
+    LBHashContext context;
+    LBHashInit(&context, algorithm);
+    LBHashUpdate(&context, data, length);
+    LBHashFinal(&context, digest);
+}
+
+#pragma mark - HMAC
+
+void LBHMACInit(LBHMACContext *context, LBHashAlgorithm algorithm, const void *key, size_t keyLength) {
+    // keys longer than a block are hashed first, shorter ones zero padded
+    uint8_t block[LB_HASH_BLOCK_LENGTH] = { 0 };
+    if (keyLength > LB_HASH_BLOCK_LENGTH) {
+        LBHash(algorithm, key, keyLength, block);
+    } else if (keyLength) {
+        memcpy(block, key, keyLength);
+    }
+    uint8_t pad[LB_HASH_BLOCK_LENGTH];
+    for (int i = 0; i < LB_HASH_BLOCK_LENGTH; i++) pad[i] = block[i] ^ 0x36;
+    LBHashInit(&context->inner, algorithm);
+    LBHashUpdate(&context->inner, pad, LB_HASH_BLOCK_LENGTH);
+    for (int i = 0; i < LB_HASH_BLOCK_LENGTH; i++) pad[i] = block[i] ^ 0x5C;
+    LBHashInit(&context->outer, algorithm);
+    LBHashUpdate(&context->outer, pad, LB_HASH_BLOCK_LENGTH);
+    memset(block, 0, sizeof(block));
+    memset(pad, 0, sizeof(pad));
+}
+
+void LBHMACUpdate(LBHMACContext *context, const void *data, size_t length) {
+    LBHashUpdate(&context->inner, data, length);
+}
+
+void LBHMACFinal(LBHMACContext *context, uint8_t *mac) {
+    uint8_t innerDigest[LB_HASH_MAX_DIGEST_LENGTH];
+    LBHashFinal(&context->inner, innerDigest);
+    LBHashUpdate(&context->outer, innerDigest, LBHashDigestLength(context->outer.algorithm));
+    LBHashFinal(&context->outer, mac);
+}
+
+void LBHMAC(LBHashAlgorithm algorithm, const void *key, size_t keyLength, const void *data, size_t length, uint8_t *mac) {
+    LBHMACContext context;
+    LBHMACInit(&context, algorithm, key, keyLength);
+    LBHMACUpdate(&context, data, length);
+    LBHMACFinal(&context, mac);
+}
@@ -0,0 +1,94 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ SHA-1 and SHA-256, and HMAC (RFC 2104) over them, in plain C. This is what
+ signs OAuth requests (see LBOAuth1Signer), with no dependency on CommonCrypto,
+ so the same code builds anywhere.
+ 
+ The block functions use the CPU's SHA instructions where there are any: the
+ ARMv8 crypto extensions on 64-bit ARM, or SHA-NI on Intel and AMD (checked at
+ runtime, so this covers the simulator). Everything else gets a portable scalar
+ version.
+ 
+ Both hashes and HMAC take input incrementally, in pieces of any size:
+ 
+   LBHMACContext hmac;
+   LBHMACInit(&hmac, LBHashSHA1, key, keyLength);
+   LBHMACUpdate(&hmac, part1, part1Length);
+   LBHMACUpdate(&hmac, part2, part2Length);
+   LBHMACFinal(&hmac, mac); // LBHashDigestLength(LBHashSHA1) bytes
+ 
+ Contexts are plain structs with no pointers, so they can be copied. When you
+ sign many messages with one key, key a context once and start each message
+ from a copy of it; that skips hashing the key and the two padded key blocks
+ every time.
+ 
+ */
+
+#ifndef LBHMAC_h
+#define LBHMAC_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    LBHashSHA1 = 0,
+    LBHashSHA256 = 1
+} LBHashAlgorithm;
+
+#define LB_SHA1_DIGEST_LENGTH 20
+#define LB_SHA256_DIGEST_LENGTH 32
+#define LB_HASH_MAX_DIGEST_LENGTH 32
+#define LB_HASH_BLOCK_LENGTH 64
+
+typedef struct {
+    LBHashAlgorithm algorithm;
+    uint32_t state[8];
+    uint64_t length; // total bytes hashed so far
+    uint8_t buffer[LB_HASH_BLOCK_LENGTH];
+    size_t bufferLength;
+} LBHashContext;
+
+size_t LBHashDigestLength(LBHashAlgorithm algorithm);
+
+void LBHashInit(LBHashContext *context, LBHashAlgorithm algorithm);
+void LBHashUpdate(LBHashContext *context, const void *data, size_t length);
+void LBHashFinal(LBHashContext *context, uint8_t *digest);
+void LBHash(LBHashAlgorithm algorithm, const void *data, size_t length, uint8_t *digest);
+
+typedef struct {
+    LBHashContext inner;
+    LBHashContext outer;
+} LBHMACContext;
+
+void LBHMACInit(LBHMACContext *context, LBHashAlgorithm algorithm, const void *key, size_t keyLength);
+void LBHMACUpdate(LBHMACContext *context, const void *data, size_t length);
+void LBHMACFinal(LBHMACContext *context, uint8_t *mac);
+void LBHMAC(LBHashAlgorithm algorithm, const void *key, size_t keyLength, const void *data, size_t length, uint8_t *mac);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
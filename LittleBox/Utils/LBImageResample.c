@@ -0,0 +1,421 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#include "LBImageResample.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__aarch64__) || defined(__arm64__) || defined(__ARM_NEON)
+#define LB_RESAMPLE_NEON 1
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define LB_RESAMPLE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#define LB_WEIGHT_BITS 14
+#define LB_WEIGHT_ONE (1 << LB_WEIGHT_BITS)
+#define LB_WEIGHT_HALF (1 << (LB_WEIGHT_BITS - 1))
+// output rows per band, see LBImageResample
+#define LB_BAND_ROWS 16
+
+// for each output pixel along one axis: the first input pixel it draws on,
+// how many, and their weights (maxCount slots per output, in fixed point,
+// summing to exactly LB_WEIGHT_ONE).
+typedef struct {
+    size_t *starts;
+    size_t *counts;
+    int16_t *weights;
+    size_t maxCount;
+} LBResampleWeights;
+
+static inline uint8_t clampToByte(int32_t value) {
+    return value < 0 ? 0 : (value > 255 ? 255 : (uint8_t)value);
+}
+
+LBPixelRect LBImageSquareCropRect(size_t width, size_t height) {
+    LBPixelRect rect;
+    if (width > height) {
+        rect.width = rect.height = height;
+        rect.x = (width - height) / 2;
+        rect.y = 0;
+    } else {
+        rect.width = rect.height = width;
+        rect.x = 0;
+        rect.y = (height - width) / 3;
+    }
+    return rect;
+}
+
+#pragma mark - weights
+
+static double lanczos3(double x) {
+    if (x == 0.0) return 1.0;
+    if (x <= -3.0 || x >= 3.0) return 0.0;
+    double px = M_PI * x;
+    return 3.0 * sin(px) * sin(px / 3.0) / (px * px);
+}
+
+static double box(double x) {
+    return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+}
+
+static void freeWeights(LBResampleWeights *weights) {
+    free(weights->starts);
+    free(weights->counts);
+    free(weights->weights);
+}
+
+static bool computeWeights(LBResampleWeights *weights, size_t inSize, size_t outSize, LBResampleFilter filter) {
+    double (*kernel)(double) = filter == LBResampleBox ? box : lanczos3;
+    double scale = (double)inSize / outSize;
+    // when shrinking, the filter is stretched to cover every input pixel
+    double filterScale = scale > 1.0 ? scale : 1.0;
+    double support = (filter == LBResampleBox ? 0.5 : 3.0) * filterScale;
+    size_t maxCount = (size_t)ceil(support) * 2 + 1;
+    weights->maxCount = maxCount;
+    weights->starts = malloc(outSize * sizeof(size_t));
+    weights->counts = malloc(outSize * sizeof(size_t));
+    weights->weights = calloc(outSize * maxCount, sizeof(int16_t));
+    double *exact = malloc(maxCount * sizeof(double));
+    if (!weights->starts || !weights->counts || !weights->weights || !exact) {
+        free(exact);
+        freeWeights(weights);
+        return false;
+    }
+    for (size_t out = 0; out < outSize; out++) {
+        double center = (out + 0.5) * scale;
+        double low = center - support + 0.5;
+        double high = center + support + 0.5;
+        size_t start = low > 0.0 ? (size_t)low : 0;
+        size_t end = high < (double)inSize ? (size_t)high : inSize;
+        if (end <= start) end = start + 1;
+        if (end - start > maxCount) end = start + maxCount;
+        size_t count = end - start;
+        double total = 0.0;
+        for (size_t i = 0; i < count; i++) {
+            exact[i] = kernel((start + i - center + 0.5) / filterScale);
+            total += exact[i];
+        }
+        // to fixed point, putting the rounding error on the biggest weight so
+        // that flat areas stay exactly flat.
+        int16_t *fixed = weights->weights + out * maxCount;
+        int32_t sum = 0;
+        size_t biggest = 0;
+        for (size_t i = 0; i < count; i++) {
+            fixed[i] = (int16_t)lround(total != 0.0 ? exact[i] / total * LB_WEIGHT_ONE : 0.0);
+            sum += fixed[i];
+            if (fixed[i] > fixed[biggest]) biggest = i;
+        }
+        fixed[biggest] = (int16_t)(fixed[biggest] + LB_WEIGHT_ONE - sum);
+        weights->starts[out] = start;
+        weights->counts[out] = count;
+    }
+    free(exact);
+    return true;
+}
+
+#pragma mark - scalar
+
+#if !LB_RESAMPLE_SSE2 && !LB_RESAMPLE_NEON
+// the SIMD versions do whole rows themselves, so this is only the fallback
+static void horizontalRowScalar(const uint8_t *input, uint8_t *output, size_t outWidth, const LBResampleWeights *weights) {
+    for (size_t x = 0; x < outWidth; x++) {
+        const uint8_t *pixel = input + weights->starts[x] * 4;
+        const int16_t *w = weights->weights + x * weights->maxCount;
+        int32_t a0 = LB_WEIGHT_HALF, a1 = LB_WEIGHT_HALF, a2 = LB_WEIGHT_HALF, a3 = LB_WEIGHT_HALF;
+        for (size_t i = 0; i < weights->counts[x]; i++) {
+            a0 += pixel[4 * i] * w[i];
+            a1 += pixel[4 * i + 1] * w[i];
+            a2 += pixel[4 * i + 2] * w[i];
+            a3 += pixel[4 * i + 3] * w[i];
+        }
+        output[4 * x] = clampToByte(a0 >> LB_WEIGHT_BITS);
+        output[4 * x + 1] = clampToByte(a1 >> LB_WEIGHT_BITS);
+        output[4 * x + 2] = clampToByte(a2 >> LB_WEIGHT_BITS);
+        output[4 * x + 3] = clampToByte(a3 >> LB_WEIGHT_BITS);
+    }
+}
+#endif
+
+// from byte offset `from` on, so the SIMD versions can hand over their tails
+static void verticalRowScalar(const uint8_t *firstRow, size_t stride, const int16_t *weights, size_t count, uint8_t *output, size_t from, size_t bytes) {
+    for (size_t i = from; i < bytes; i++) {
+        int32_t sum = LB_WEIGHT_HALF;
+        for (size_t k = 0; k < count; k++) {
+            sum += firstRow[k * stride + i] * weights[k];
+        }
+        output[i] = clampToByte(sum >> LB_WEIGHT_BITS);
+    }
+}
+
+#pragma mark - SSE2
+
+#if LB_RESAMPLE_SSE2
+
+// weights go to _mm_madd_epi16 in pairs, multiplying two pixels at once
+static inline __m128i weightPair(int16_t first, int16_t second) {
+    return _mm_set1_epi32((int32_t)((uint32_t)(uint16_t)first | ((uint32_t)(uint16_t)second << 16)));
+}
+
+static void horizontalRowSSE2(const uint8_t *input, uint8_t *output, size_t outWidth, const LBResampleWeights *weights) {
+    const __m128i zero = _mm_setzero_si128();
+    for (size_t x = 0; x < outWidth; x++) {
+        const uint8_t *pixel = input + weights->starts[x] * 4;
+        const int16_t *w = weights->weights + x * weights->maxCount;
+        size_t count = weights->counts[x];
+        __m128i sum = _mm_set1_epi32(LB_WEIGHT_HALF);
+        size_t i = 0;
+        for (; i + 1 < count; i += 2) {
+            // two pixels, channels interleaved: p0c0 p1c0 p0c1 p1c1 ...
+            __m128i pair = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(pixel + 4 * i)), zero);
+            pair = _mm_unpacklo_epi16(pair, _mm_srli_si128(pair, 8));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pair, weightPair(w[i], w[i + 1])));
+        }
+        if (i < count) {
+            int32_t last;
+            memcpy(&last, pixel + 4 * i, 4);
+            __m128i single = _mm_unpacklo_epi8(_mm_cvtsi32_si128(last), zero);
+            single = _mm_unpacklo_epi16(single, zero);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(single, weightPair(w[i], 0)));
+        }
+        sum = _mm_srai_epi32(sum, LB_WEIGHT_BITS);
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(sum, sum), zero);
+        int32_t result = _mm_cvtsi128_si32(packed);
+        memcpy(output + 4 * x, &result, 4);
+    }
+}
+
+static void verticalRowSSE2(const uint8_t *firstRow, size_t stride, const int16_t *weights, size_t count, uint8_t *output, size_t bytes) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        __m128i low = _mm_set1_epi32(LB_WEIGHT_HALF);
+        __m128i high = low;
+        size_t k = 0;
+        for (; k + 1 < count; k += 2) {
+            __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(firstRow + k * stride + i)), zero);
+            __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(firstRow + (k + 1) * stride + i)), zero);
+            __m128i w = weightPair(weights[k], weights[k + 1]);
+            low = _mm_add_epi32(low, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+            high = _mm_add_epi32(high, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+        }
+        if (k < count) {
+            __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(firstRow + k * stride + i)), zero);
+            __m128i w = weightPair(weights[k], 0);
+            low = _mm_add_epi32(low, _mm_madd_epi16(_mm_unpacklo_epi16(a, zero), w));
+            high = _mm_add_epi32(high, _mm_madd_epi16(_mm_unpackhi_epi16(a, zero), w));
+        }
+        low = _mm_srai_epi32(low, LB_WEIGHT_BITS);
+        high = _mm_srai_epi32(high, LB_WEIGHT_BITS);
+        _mm_storel_epi64((__m128i *)(output + i), _mm_packus_epi16(_mm_packs_epi32(low, high), zero));
+    }
+    verticalRowScalar(firstRow, stride, weights, count, output, i, bytes);
+}
+
+#endif
+
+#pragma mark - NEON
+
+#if LB_RESAMPLE_NEON
+
+static void horizontalRowNEON(const uint8_t *input, uint8_t *output, size_t outWidth, const LBResampleWeights *weights) {
+    for (size_t x = 0; x < outWidth; x++) {
+        const uint8_t *pixel = input + weights->starts[x] * 4;
+        const int16_t *w = weights->weights + x * weights->maxCount;
+        int32x4_t sum = vdupq_n_s32(LB_WEIGHT_HALF);
+        for (size_t i = 0; i < weights->counts[x]; i++) {
+            uint32_t bytes;
+            memcpy(&bytes, pixel + 4 * i, 4);
+            int16x4_t channels = vreinterpret_s16_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(bytes)))));
+            sum = vmlal_n_s16(sum, channels, w[i]);
+        }
+        int16x4_t narrowed = vqmovn_s32(vshrq_n_s32(sum, LB_WEIGHT_BITS));
+        uint8x8_t packed = vqmovun_s16(vcombine_s16(narrowed, narrowed));
+        uint32_t result = vget_lane_u32(vreinterpret_u32_u8(packed), 0);
+        memcpy(output + 4 * x, &result, 4);
+    }
+}
+
+static void verticalRowNEON(const uint8_t *firstRow, size_t stride, const int16_t *weights, size_t count, uint8_t *output, size_t bytes) {
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        int32x4_t low = vdupq_n_s32(LB_WEIGHT_HALF);
+        int32x4_t high = low;
+        for (size_t k = 0; k < count; k++) {
+            int16x8_t row = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(firstRow + k * stride + i)));
+            low = vmlal_n_s16(low, vget_low_s16(row), weights[k]);
+            high = vmlal_n_s16(high, vget_high_s16(row), weights[k]);
+        }
+        int16x8_t narrowed = vcombine_s16(vqmovn_s32(vshrq_n_s32(low, LB_WEIGHT_BITS)), vqmovn_s32(vshrq_n_s32(high, LB_WEIGHT_BITS)));
+        vst1_u8(output + i, vqmovun_s16(narrowed));
+    }
+    verticalRowScalar(firstRow, stride, weights, count, output, i, bytes);
+}
+
+#endif
+
+#pragma mark - dispatch
+
+static void horizontalRow(const uint8_t *input, uint8_t *output, size_t outWidth, const LBResampleWeights *weights) {
+#if LB_RESAMPLE_SSE2
+    horizontalRowSSE2(input, output, outWidth, weights);
+#elif LB_RESAMPLE_NEON
+    horizontalRowNEON(input, output, outWidth, weights);
+#else
+    horizontalRowScalar(input, output, outWidth, weights);
+#endif
+}
+
+static void verticalRow(const uint8_t *firstRow, size_t stride, const int16_t *weights, size_t count, uint8_t *output, size_t bytes) {
+#if LB_RESAMPLE_SSE2
+    verticalRowSSE2(firstRow, stride, weights, count, output, bytes);
+#elif LB_RESAMPLE_NEON
+    verticalRowNEON(firstRow, stride, weights, count, output, bytes);
+#else
+    verticalRowScalar(firstRow, stride, weights, count, output, 0, bytes);
+#endif
+}
+
+#pragma mark - integer pre-shrink
+
+// averages factorX x factorY blocks (smaller along the right and bottom edges
+// when the size isn't a multiple).
+static bool boxReduce(const uint8_t *input, size_t width, size_t height, size_t bytesPerRow,
+                      size_t factorX, size_t factorY, uint8_t *output, size_t outWidth, size_t outHeight) {
+    uint32_t *sums = malloc(outWidth * 4 * sizeof(uint32_t));
+    if (!sums) return false;
+    for (size_t outY = 0; outY < outHeight; outY++) {
+        size_t y0 = outY * factorY;
+        size_t y1 = y0 + factorY < height ? y0 + factorY : height;
+        memset(sums, 0, outWidth * 4 * sizeof(uint32_t));
+        for (size_t y = y0; y < y1; y++) {
+            const uint8_t *row = input + y * bytesPerRow;
+            for (size_t outX = 0; outX < outWidth; outX++) {
+                size_t x0 = outX * factorX;
+                size_t x1 = x0 + factorX < width ? x0 + factorX : width;
+                uint32_t *sum = sums + outX * 4;
+                for (size_t x = x0; x < x1; x++) {
+                    sum[0] += row[4 * x];
+                    sum[1] += row[4 * x + 1];
+                    sum[2] += row[4 * x + 2];
+                    sum[3] += row[4 * x + 3];
+                }
+            }
+        }
+        uint8_t *out = output + outY * outWidth * 4;
+        for (size_t outX = 0; outX < outWidth; outX++) {
+            size_t x0 = outX * factorX;
+            size_t x1 = x0 + factorX < width ? x0 + factorX : width;
+            uint32_t area = (uint32_t)((x1 - x0) * (y1 - y0));
+            for (int c = 0; c < 4; c++) {
+                out[outX * 4 + c] = (uint8_t)((sums[outX * 4 + c] + area / 2) / area);
+            }
+        }
+    }
+    free(sums);
+    return true;
+}
+
+#pragma mark -
+
+bool LBImageResample(const uint8_t *source, size_t sourceWidth, size_t sourceHeight, size_t sourceBytesPerRow,
+                     LBPixelRect crop,
+                     uint8_t *destination, size_t destinationWidth, size_t destinationHeight, size_t destinationBytesPerRow,
+                     LBResampleFilter filter) {
+    if (!source || !destination || !crop.width || !crop.height || !destinationWidth || !destinationHeight) return false;
+    if (crop.x > sourceWidth || crop.width > sourceWidth - crop.x) return false;
+    if (crop.y > sourceHeight || crop.height > sourceHeight - crop.y) return false;
+    if (sourceBytesPerRow < sourceWidth * 4 || destinationBytesPerRow < destinationWidth * 4) return false;
+
+    const uint8_t *input = source + crop.y * sourceBytesPerRow + crop.x * 4;
+    size_t inWidth = crop.width;
+    size_t inHeight = crop.height;
+    size_t inBytesPerRow = sourceBytesPerRow;
+
+    // shrink by whole factors first, leaving the filter at least 2x to do
+    uint8_t *reduced = NULL;
+    size_t factorX = inWidth / destinationWidth / 2;
+    size_t factorY = inHeight / destinationHeight / 2;
+    if (factorX > 1 || factorY > 1) {
+        if (factorX < 1) factorX = 1;
+        if (factorY < 1) factorY = 1;
+        size_t reducedWidth = (inWidth + factorX - 1) / factorX;
+        size_t reducedHeight = (inHeight + factorY - 1) / factorY;
+        reduced = malloc(reducedWidth * reducedHeight * 4);
+        if (!reduced || !boxReduce(input, inWidth, inHeight, inBytesPerRow, factorX, factorY, reduced, reducedWidth, reducedHeight)) {
+            free(reduced);
+            return false;
+        }
+        input = reduced;
+        inWidth = reducedWidth;
+        inHeight = reducedHeight;
+        inBytesPerRow = reducedWidth * 4;
+    }
+
+    LBResampleWeights horizontal, vertical;
+    if (!computeWeights(&horizontal, inWidth, destinationWidth, filter)) {
+        free(reduced);
+        return false;
+    }
+    if (!computeWeights(&vertical, inHeight, destinationHeight, filter)) {
+        freeWeights(&horizontal);
+        free(reduced);
+        return false;
+    }
+
+    // the most source rows any band of output rows needs
+    size_t bandCapacity = 0;
+    for (size_t y0 = 0; y0 < destinationHeight; y0 += LB_BAND_ROWS) {
+        size_t y1 = y0 + LB_BAND_ROWS < destinationHeight ? y0 + LB_BAND_ROWS : destinationHeight;
+        size_t end = 0;
+        for (size_t y = y0; y < y1; y++) {
+            size_t rowEnd = vertical.starts[y] + vertical.counts[y];
+            if (rowEnd > end) end = rowEnd;
+        }
+        if (end - vertical.starts[y0] > bandCapacity) bandCapacity = end - vertical.starts[y0];
+    }
+    size_t bandBytesPerRow = destinationWidth * 4;
+    uint8_t *band = malloc(bandCapacity * bandBytesPerRow);
+    bool ok = band != NULL;
+
+    for (size_t y0 = 0; ok && y0 < destinationHeight; y0 += LB_BAND_ROWS) {
+        size_t y1 = y0 + LB_BAND_ROWS < destinationHeight ? y0 + LB_BAND_ROWS : destinationHeight;
+        size_t first = vertical.starts[y0];
+        size_t end = 0;
+        for (size_t y = y0; y < y1; y++) {
+            size_t rowEnd = vertical.starts[y] + vertical.counts[y];
+            if (rowEnd > end) end = rowEnd;
+        }
+        for (size_t row = first; row < end; row++) {
+            horizontalRow(input + row * inBytesPerRow, band + (row - first) * bandBytesPerRow, destinationWidth, &horizontal);
+        }
+        for (size_t y = y0; y < y1; y++) {
+            verticalRow(band + (vertical.starts[y] - first) * bandBytesPerRow, bandBytesPerRow,
+                        vertical.weights + y * vertical.maxCount, vertical.counts[y],
+                        destination + y * destinationBytesPerRow, bandBytesPerRow);
+        }
+    }
+
+    free(band);
+    freeWeights(&horizontal);
+    freeWeights(&vertical);
+    free(reduced);
+    return ok;
+}
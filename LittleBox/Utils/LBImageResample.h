@@ -0,0 +1,84 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ Cropping and resampling of raw 32-bit pixel buffers (RGBA, BGRA, or any other
+ layout of four 8-bit channels) in plain C, behind LBUtils
+ squareCroppedImageFromImage:withSize:.
+ 
+ Resampling is separable: a horizontal pass then a vertical one, with filter
+ weights worked out once per output row and column in 14-bit fixed point. The
+ output is done in bands of rows, and only the source rows a band needs are
+ resampled horizontally into a small intermediate buffer, which stays in cache
+ instead of round-tripping a whole intermediate image through memory.
+ 
+ When shrinking by a large ratio, the crop is first box-averaged down by an
+ integer factor (leaving at least 2x for the filter proper to do), which is
+ much cheaper per source pixel and looks the same.
+ 
+ Both passes are vectorized with SSE2 on Intel and NEON on ARM, with a scalar
+ version for everything else. All three give identical results.
+ 
+ Channels are filtered independently, so premultiplied (or opaque) pixels come
+ out right whatever the channel order. Lanczos rings a little at hard edges,
+ so with transparent images, use premultiplied input, or the box filter.
+ 
+ */
+
+#ifndef LBImageResample_h
+#define LBImageResample_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+} LBPixelRect;
+
+typedef enum {
+    LBResampleLanczos3 = 0,
+    LBResampleBox
+} LBResampleFilter;
+
+// the largest square in a width x height image, as avatars are cropped:
+// centered across a landscape image, and a third of the way down a portrait
+// one, which tends to keep people's faces in.
+LBPixelRect LBImageSquareCropRect(size_t width, size_t height);
+
+// resamples the crop rect of source into the whole of destination. both are 4
+// bytes per pixel, rows bytesPerRow apart. returns false if the arguments
+// don't make sense or memory runs out.
+bool LBImageResample(const uint8_t *source, size_t sourceWidth, size_t sourceHeight, size_t sourceBytesPerRow,
+                     LBPixelRect crop,
+                     uint8_t *destination, size_t destinationWidth, size_t destinationHeight, size_t destinationBytesPerRow,
+                     LBResampleFilter filter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ Signs requests for OAuth 1.0a (RFC 5849) web services with HMAC-SHA1, for one
+ consumer and (optionally) one token. This is what LBUtils
+ addOauth1HeaderToRequest: uses under the hood, but if you sign a lot of
+ requests with the same credentials, make a signer once and keep it:
+ 
+   LBOAuth1Signer *signer = [[LBOAuth1Signer alloc] initWithConsumerKey:key consumerSecret:secret
+                                                                  token:token tokenSecret:tokenSecret];
+   ...
+   [signer signRequest:request withPostBodyParams:params];
+ 
+ Everything that doesn't change between requests is done up front: the HMAC key
+ schedule (so each signature starts from the ready keyed state instead of
+ hashing the key again), and the percent encoding of the consumer key and token.
+ 
+ Per request, the parameters (the oauth ones, the URL query and the post body)
+ are percent encoded into one buffer, sorted by encoded name and then value as
+ the spec says, and fed straight into the HMAC in chunks. The signature base
+ string is never built as a string.
+ 
+ Repeated query parameters are all signed, as the spec requires, and the base
+ string URI is normalized (lower case scheme and host, no default port, no
+ query or fragment). The signer never changes after init, so one can be used
+ from several threads at once.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+@interface LBOAuth1Signer : NSObject
+
+// token and tokenSecret may be nil, e.g. when asking for a request token
+- (id)initWithConsumerKey:(NSString *)consumerKey consumerSecret:(NSString *)consumerSecret token:(NSString *)token tokenSecret:(NSString *)tokenSecret;
+
+@property (nonatomic, readonly, copy) NSString *consumerKey;
+@property (nonatomic, readonly, copy) NSString *token;
+// whether to send oauth_version="1.0", which the spec makes optional. YES by
+// default. set it before you start using the signer.
+@property (nonatomic, assign) BOOL includesVersion;
+
+// sets the Authorization header, using the request's method and URL. pass the
+// same post body params you send (see LBUtils addPostBodyParams:toRequest:).
+- (void)signRequest:(NSMutableURLRequest *)request withPostBodyParams:(NSDictionary *)postBodyParams;
+- (void)signRequest:(NSMutableURLRequest *)request withPostBodyParams:(NSDictionary *)postBodyParams callback:(NSString *)callback verifier:(NSString *)verifier;
+
+// the same with everything given explicitly, e.g. to check against known
+// signatures. nil timestamp and nonce mean now and a fresh GUID. both return
+// nil if memory runs out, and signRequest: then leaves the request unsigned.
+- (NSString *)authorizationHeaderForMethod:(NSString *)method URL:(NSURL *)url postBodyParams:(NSDictionary *)postBodyParams callback:(NSString *)callback verifier:(NSString *)verifier timestamp:(NSString *)timestamp nonce:(NSString *)nonce;
+- (NSString *)signatureForMethod:(NSString *)method URL:(NSURL *)url postBodyParams:(NSDictionary *)postBodyParams callback:(NSString *)callback verifier:(NSString *)verifier timestamp:(NSString *)timestamp nonce:(NSString *)nonce;
+
+@end
@@ -0,0 +1,388 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#import "LBOAuth1Signer.h"
+#import "LBBase64.h"
+#import "LBHMAC.h"
+#import "LBPercentEncoding.h"
+#import "LBStringBytes.h"
+#import "LBUtils.h"
+
+#pragma mark - parameter lists
+
+// one parameter, percent encoded. offsets into the list's arena while it's
+// being built (it moves as it grows), pointers once it's sorted.
+typedef struct {
+    size_t keyOffset;
+    size_t keyLength;
+    size_t valueOffset;
+    size_t valueLength;
+    const char *key;
+    const char *value;
+} LBOAuthParam;
+
+typedef struct {
+    LBOAuthParam *params;
+    size_t count;
+    size_t capacity;
+    char *arena;
+    size_t arenaLength;
+    size_t arenaCapacity;
+    // form decoding happens here before encoding into the arena
+    uint8_t *scratch;
+    size_t scratchCapacity;
+    // an allocation failed. adding does nothing from then on, and there's no
+    // signature.
+    bool failed;
+} LBOAuthParamList;
+
+static void paramListInit(LBOAuthParamList *list, size_t capacity, size_t arenaCapacity) {
+    list->count = 0;
+    list->capacity = capacity > 0 ? capacity : 1;
+    list->params = malloc(list->capacity * sizeof(LBOAuthParam));
+    list->arenaLength = 0;
+    list->arenaCapacity = arenaCapacity > 0 ? arenaCapacity : 1;
+    list->arena = malloc(list->arenaCapacity);
+    list->scratch = NULL;
+    list->scratchCapacity = 0;
+    list->failed = !list->params || !list->arena;
+}
+
+static void paramListFree(LBOAuthParamList *list) {
+    free(list->params);
+    free(list->arena);
+    free(list->scratch);
+}
+
+static bool paramListReserve(LBOAuthParamList *list, size_t arenaLength) {
+    if (list->failed) return false;
+    if (list->count == list->capacity) {
+        LBOAuthParam *params = realloc(list->params, list->capacity * 2 * sizeof(LBOAuthParam));
+        if (!params) {
+            list->failed = true;
+            return false;
+        }
+        list->params = params;
+        list->capacity *= 2;
+    }
+    if (list->arenaCapacity - list->arenaLength < arenaLength) {
+        size_t capacity = list->arenaCapacity;
+        while (capacity - list->arenaLength < arenaLength) capacity *= 2;
+        char *arena = realloc(list->arena, capacity);
+        if (!arena) {
+            list->failed = true;
+            return false;
+        }
+        list->arena = arena;
+        list->arenaCapacity = capacity;
+    }
+    return true;
+}
+
+// appends bytes to the arena, percent encoding them if encode is set
+static size_t paramListStore(LBOAuthParamList *list, const char *bytes, size_t length, bool encode) {
+    char *destination = list->arena + list->arenaLength;
+    size_t stored = length;
+    if (encode) {
+        stored = LBPercentEncode((const uint8_t *)bytes, length, destination);
+    } else if (length) {
+        memcpy(destination, bytes, length);
+    }
+    list->arenaLength += stored;
+    return stored;
+}
+
+static void paramListAdd(LBOAuthParamList *list, const char *key, size_t keyLength, const char *value, size_t valueLength, bool encode) {
+    if (!paramListReserve(list, encode ? 3 * (keyLength + valueLength) : keyLength + valueLength)) return;
+    LBOAuthParam *param = &list->params[list->count++];
+    param->keyOffset = list->arenaLength;
+    param->keyLength = paramListStore(list, key, keyLength, encode);
+    param->valueOffset = list->arenaLength;
+    param->valueLength = paramListStore(list, value, valueLength, encode);
+}
+
+// for a field of a query string: decoded as a form would be (+ is a space),
+// then encoded again the one true way, so "a+b", "a%20b" and "a b" all sign
+// the same.
+static void paramListAddFormField(LBOAuthParamList *list, const char *key, size_t keyLength, const char *value, size_t valueLength) {
+    if (list->failed) return;
+    size_t needed = keyLength + valueLength;
+    if (list->scratchCapacity < needed) {
+        uint8_t *scratch = realloc(list->scratch, needed);
+        if (!scratch) {
+            list->failed = true;
+            return;
+        }
+        list->scratch = scratch;
+        list->scratchCapacity = needed;
+    }
+    size_t decodedKeyLength = LBPercentDecode(key, keyLength, list->scratch, true);
+    size_t decodedValueLength = LBPercentDecode(value, valueLength, list->scratch + decodedKeyLength, true);
+    paramListAdd(list, (const char *)list->scratch, decodedKeyLength, (const char *)list->scratch + decodedKeyLength, decodedValueLength, true);
+}
+
+static int compareBytes(const char *a, size_t aLength, const char *b, size_t bLength) {
+    int order = memcmp(a, b, aLength < bLength ? aLength : bLength);
+    if (order) return order;
+    return (aLength > bLength) - (aLength < bLength);
+}
+
+static int compareParams(const void *a, const void *b) {
+    const LBOAuthParam *x = a;
+    const LBOAuthParam *y = b;
+    int order = compareBytes(x->key, x->keyLength, y->key, y->keyLength);
+    if (order) return order;
+    return compareBytes(x->value, x->valueLength, y->value, y->valueLength);
+}
+
+// by name then value, comparing bytes of the encoded forms (RFC 5849 3.4.1.3.2)
+static void paramListSort(LBOAuthParamList *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        list->params[i].key = list->arena + list->params[i].keyOffset;
+        list->params[i].value = list->arena + list->params[i].valueOffset;
+    }
+    qsort(list->params, list->count, sizeof(LBOAuthParam), compareParams);
+}
+
+#pragma mark - signature base string
+
+// buffers small writes into bigger HMAC updates
+typedef struct {
+    LBHMACContext hmac;
+    size_t length;
+    char buffer[256];
+} LBSignatureWriter;
+
+static void writerFlush(LBSignatureWriter *writer) {
+    if (writer->length) LBHMACUpdate(&writer->hmac, writer->buffer, writer->length);
+    writer->length = 0;
+}
+
+static void writerAppend(LBSignatureWriter *writer, const char *bytes, size_t length) {
+    if (sizeof(writer->buffer) - writer->length < length) {
+        writerFlush(writer);
+        if (length > sizeof(writer->buffer)) {
+            LBHMACUpdate(&writer->hmac, bytes, length);
+            return;
+        }
+    }
+    memcpy(writer->buffer + writer->length, bytes, length);
+    writer->length += length;
+}
+
+static void writerAppendEncoded(LBSignatureWriter *writer, const char *bytes, size_t length) {
+    while (length) {
+        size_t room = (sizeof(writer->buffer) - writer->length) / 3;
+        if (room == 0) {
+            writerFlush(writer);
+            continue;
+        }
+        size_t chunk = length < room ? length : room;
+        writer->length += LBPercentEncode((const uint8_t *)bytes, chunk, writer->buffer + writer->length);
+        bytes += chunk;
+        length -= chunk;
+    }
+}
+
+// method & uri & normalized params, each encoded. the params are encoded
+// already, so they get encoded twice, as the spec has it. (RFC 5849 3.4.1)
+static void writeBaseString(LBSignatureWriter *writer, const char *method, size_t methodLength, const char *uri, size_t uriLength, const LBOAuthParamList *list) {
+    writerAppendEncoded(writer, method, methodLength);
+    writerAppend(writer, "&", 1);
+    writerAppendEncoded(writer, uri, uriLength);
+    writerAppend(writer, "&", 1);
+    for (size_t i = 0; i < list->count; i++) {
+        const LBOAuthParam *param = &list->params[i];
+        if (i > 0) writerAppend(writer, "%26", 3);
+        writerAppendEncoded(writer, param->key, param->keyLength);
+        writerAppend(writer, "%3D", 3);
+        writerAppendEncoded(writer, param->value, param->valueLength);
+    }
+    writerFlush(writer);
+}
+
+#pragma mark -
+
+static void paramListAddString(LBOAuthParamList *list, const char *key, NSString *value) {
+    size_t valueLength;
+    const char *valueBytes = LBUTF8BytesOfString(value, &valueLength);
+    paramListAdd(list, key, strlen(key), valueBytes, valueLength, true);
+}
+
+// scheme://host[:port]/path, lower case scheme and host, no default port
+// (RFC 5849 3.4.1.2). the path stays percent encoded as it is in the URL.
+static NSString *baseStringURI(NSURL *url) {
+    NSString *scheme = [[url scheme] lowercaseString];
+    NSString *host = [[url host] lowercaseString];
+    NSNumber *port = [url port];
+    NSString *path = CFBridgingRelease(CFURLCopyPath((__bridge CFURLRef)[url absoluteURL]));
+    if (![path length]) path = @"/";
+    BOOL defaultPort = !port
+        || ([scheme isEqualToString:@"http"] && [port intValue] == 80)
+        || ([scheme isEqualToString:@"https"] && [port intValue] == 443);
+    if (defaultPort) {
+        return [NSString stringWithFormat:@"%@://%@%@", scheme, (host ? host : @""), path];
+    }
+    return [NSString stringWithFormat:@"%@://%@:%@%@", scheme, (host ? host : @""), port, path];
+}
+
+@interface LBOAuth1Signer () {
+    // keyed with the consumer and token secrets, ready for a message
+    LBHMACContext _keyedHMAC;
+}
+@property (nonatomic, readwrite, copy) NSString *consumerKey;
+@property (nonatomic, readwrite, copy) NSString *token;
+@property (nonatomic, strong) NSString *encodedConsumerKey;
+@property (nonatomic, strong) NSString *encodedToken;
+@property (nonatomic, strong) NSData *encodedConsumerKeyBytes;
+@property (nonatomic, strong) NSData *encodedTokenBytes;
+@end
+
+@implementation LBOAuth1Signer
+
+- (id)initWithConsumerKey:(NSString *)consumerKey consumerSecret:(NSString *)consumerSecret token:(NSString *)token tokenSecret:(NSString *)tokenSecret {
+    if ((self = [super init])) {
+        self.consumerKey = consumerKey ? consumerKey : @"";
+        self.token = [token length] ? token : nil;
+        self.includesVersion = YES;
+        self.encodedConsumerKey = [LBUtils URLEncodedStringFromString:self.consumerKey];
+        self.encodedConsumerKeyBytes = [self.encodedConsumerKey dataUsingEncoding:NSASCIIStringEncoding];
+        if (self.token) {
+            self.encodedToken = [LBUtils URLEncodedStringFromString:self.token];
+            self.encodedTokenBytes = [self.encodedToken dataUsingEncoding:NSASCIIStringEncoding];
+        }
+        NSString *key = [NSString stringWithFormat:@"%@&%@",
+                         [LBUtils URLEncodedStringFromString:(consumerSecret ? consumerSecret : @"")],
+                         [LBUtils URLEncodedStringFromString:(tokenSecret ? tokenSecret : @"")]];
+        NSData *keyData = [key dataUsingEncoding:NSASCIIStringEncoding];
+        LBHMACInit(&_keyedHMAC, LBHashSHA1, [keyData bytes], [keyData length]);
+    }
+    return self;
+}
+
+#pragma mark signing
+
+- (BOOL)getSignatureDigest:(uint8_t *)digest method:(NSString *)method URL:(NSURL *)url postBodyParams:(NSDictionary *)postBodyParams callback:(NSString *)callback verifier:(NSString *)verifier timestamp:(NSString *)timestamp nonce:(NSString *)nonce {
+    LBOAuthParamList list;
+    paramListInit(&list, 8 + [postBodyParams count], 512);
+
+    // the constant oauth params are encoded already
+    paramListAdd(&list, "oauth_consumer_key", 18, [self.encodedConsumerKeyBytes bytes], [self.encodedConsumerKeyBytes length], false);
+    paramListAdd(&list, "oauth_signature_method", 22, "HMAC-SHA1", 9, false);
+    if (self.encodedTokenBytes) {
+        paramListAdd(&list, "oauth_token", 11, [self.encodedTokenBytes bytes], [self.encodedTokenBytes length], false);
+    }
+    if (self.includesVersion) {
+        paramListAdd(&list, "oauth_version", 13, "1.0", 3, false);
+    }
+    paramListAddString(&list, "oauth_timestamp", timestamp);
+    paramListAddString(&list, "oauth_nonce", nonce);
+    if ([callback length]) paramListAddString(&list, "oauth_callback", callback);
+    if ([verifier length]) paramListAddString(&list, "oauth_verifier", verifier);
+
+    // every field of the query, repeats and all
+    NSString *query = CFBridgingRelease(CFURLCopyQueryString((__bridge CFURLRef)[url absoluteURL], NULL));
+    if (query) {
+        size_t queryLength;
+        const char *queryBytes = LBUTF8BytesOfString(query, &queryLength);
+        size_t position = 0;
+        LBFormField field;
+        while (LBFormScanNextField(queryBytes, queryLength, &position, &field)) {
+            paramListAddFormField(&list, queryBytes + field.keyOffset, field.keyLength, queryBytes + field.valueOffset, field.valueLength);
+        }
+    }
+
+    // only string pairs, as those are all that go in the body
+    for (id key in postBodyParams) {
+        id value = [postBodyParams objectForKey:key];
+        if (![key isKindOfClass:[NSString class]] || ![value isKindOfClass:[NSString class]]) continue;
+        size_t keyLength, valueLength;
+        const char *keyBytes = LBUTF8BytesOfString(key, &keyLength);
+        const char *valueBytes = LBUTF8BytesOfString(value, &valueLength);
+        paramListAdd(&list, keyBytes, keyLength, valueBytes, valueLength, true);
+    }
+
+    if (list.failed) {
+        paramListFree(&list);
+        return NO;
+    }
+    paramListSort(&list);
+
+    LBSignatureWriter writer;
+    writer.hmac = _keyedHMAC;
+    writer.length = 0;
+    size_t methodLength, uriLength;
+    const char *methodBytes = LBUTF8BytesOfString([method uppercaseString], &methodLength);
+    const char *uriBytes = LBUTF8BytesOfString(baseStringURI(url), &uriLength);
+    writeBaseString(&writer, methodBytes, methodLength, uriBytes, uriLength, &list);
+    LBHMACFinal(&writer.hmac, digest);
+
+    paramListFree(&list);
+    return YES;
+}
+
+- (NSString *)signatureForMethod:(NSString *)method URL:(NSURL *)url postBodyParams:(NSDictionary *)postBodyParams callback:(NSString *)callback verifier:(NSString *)verifier timestamp:(NSString *)timestamp nonce:(NSString *)nonce {
+    if (!timestamp) timestamp = [NSString stringWithFormat:@"%lld", (long long)[[NSDate date] timeIntervalSince1970]];
+    if (!nonce) nonce = [LBUtils generateGUID];
+    uint8_t digest[LB_SHA1_DIGEST_LENGTH];
+    if (![self getSignatureDigest:digest method:(method ? method : @"GET") URL:url postBodyParams:postBodyParams callback:callback verifier:verifier timestamp:timestamp nonce:nonce]) return nil;
+    char base64[28]; // base64 of 20 bytes
+    size_t length = LBBase64Encode(digest, sizeof(digest), base64, LBBase64Standard);
+    return [[NSString alloc] initWithBytes:base64 length:length encoding:NSASCIIStringEncoding];
+}
+
+- (NSString *)authorizationHeaderForMethod:(NSString *)method URL:(NSURL *)url postBodyParams:(NSDictionary *)postBodyParams callback:(NSString *)callback verifier:(NSString *)verifier timestamp:(NSString *)timestamp nonce:(NSString *)nonce {
+    if (!timestamp) timestamp = [NSString stringWithFormat:@"%lld", (long long)[[NSDate date] timeIntervalSince1970]];
+    if (!nonce) nonce = [LBUtils generateGUID];
+    NSString *signature = [self signatureForMethod:method URL:url postBodyParams:postBodyParams callback:callback verifier:verifier timestamp:timestamp nonce:nonce];
+    if (!signature) return nil;
+
+    // same layout as it's always been
+    NSMutableString *header = [NSMutableString stringWithCapacity:320];
+    [header appendString:@"OAuth realm=\"\", "];
+    if ([callback length]) {
+        [header appendFormat:@"oauth_callback=\"%@\", ", [LBUtils URLEncodedStringFromString:callback]];
+    }
+    [header appendFormat:@"oauth_consumer_key=\"%@\", ", self.encodedConsumerKey];
+    if (self.encodedToken) {
+        [header appendFormat:@"oauth_token=\"%@\", ", self.encodedToken];
+    }
+    if ([verifier length]) {
+        [header appendFormat:@"oauth_verifier=\"%@\", ", [LBUtils URLEncodedStringFromString:verifier]];
+    }
+    [header appendFormat:@"oauth_signature_method=\"HMAC-SHA1\", oauth_signature=\"%@\", oauth_timestamp=\"%@\", oauth_nonce=\"%@\"",
+     [LBUtils URLEncodedStringFromString:signature],
+     [LBUtils URLEncodedStringFromString:timestamp],
+     [LBUtils URLEncodedStringFromString:nonce]];
+    if (self.includesVersion) {
+        [header appendString:@", oauth_version=\"1.0\""];
+    }
+    return header;
+}
+
+- (void)signRequest:(NSMutableURLRequest *)request withPostBodyParams:(NSDictionary *)postBodyParams {
+    [self signRequest:request withPostBodyParams:postBodyParams callback:nil verifier:nil];
+}
+
+- (void)signRequest:(NSMutableURLRequest *)request withPostBodyParams:(NSDictionary *)postBodyParams callback:(NSString *)callback verifier:(NSString *)verifier {
+    NSString *header = [self authorizationHeaderForMethod:[request HTTPMethod] URL:[request URL] postBodyParams:postBodyParams
+                                                 callback:callback verifier:verifier timestamp:nil nonce:nil];
+    [request setValue:header forHTTPHeaderField:@"Authorization"];
+}
+
+@end
@@ -0,0 +1,121 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#include "LBPercentEncoding.h"
+#include <string.h>
+
+#define LB_UNRESERVED 0x01
+#define LB_HEX_DIGIT 0x02
+#define LB_HEX_VALUE(class) ((class) >> 4)
+
+// per-byte class: bit 0 for unreserved characters, bit 1 for hex digits, whose
+// value is in the high nibble.
+static const uint8_t kClassTable[256] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x00,
+    0x03, 0x13, 0x23, 0x33, 0x43, 0x53, 0x63, 0x73, 0x83, 0x93, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0xA3, 0xB3, 0xC3, 0xD3, 0xE3, 0xF3, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0xA3, 0xB3, 0xC3, 0xD3, 0xE3, 0xF3, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static const char kHexDigits[16] = "0123456789ABCDEF";
+
+size_t LBPercentEncodedLength(const uint8_t *input, size_t length) {
+    size_t escaped = 0;
+    for (size_t i = 0; i < length; i++) {
+        escaped += !(kClassTable[input[i]] & LB_UNRESERVED);
+    }
+    return length + escaped * 2;
+}
+
+size_t LBPercentEncode(const uint8_t *input, size_t length, char *output) {
+    char *out = output;
+    size_t i = 0;
+    while (i < length) {
+        // copy runs of unreserved bytes in one go, they're the common case
+        size_t run = i;
+        while (run < length && (kClassTable[input[run]] & LB_UNRESERVED)) run++;
+        if (run > i) {
+            memcpy(out, input + i, run - i);
+            out += run - i;
+            i = run;
+            if (i == length) break;
+        }
+        uint8_t byte = input[i++];
+        out[0] = '%';
+        out[1] = kHexDigits[byte >> 4];
+        out[2] = kHexDigits[byte & 0x0F];
+        out += 3;
+    }
+    return (size_t)(out - output);
+}
+
+bool LBPercentNeedsDecoding(const char *input, size_t length, bool plusAsSpace) {
+    if (memchr(input, '%', length)) return true;
+    return plusAsSpace && memchr(input, '+', length);
+}
+
+size_t LBPercentDecode(const char *input, size_t length, uint8_t *output, bool plusAsSpace) {
+    const uint8_t *in = (const uint8_t *)input;
+    uint8_t *out = output;
+    size_t i = 0;
+    while (i < length) {
+        uint8_t byte = in[i];
+        if (byte == '%' && i + 2 < length && (kClassTable[in[i + 1]] & LB_HEX_DIGIT) && (kClassTable[in[i + 2]] & LB_HEX_DIGIT)) {
+            *out++ = (uint8_t)((LB_HEX_VALUE(kClassTable[in[i + 1]]) << 4) | LB_HEX_VALUE(kClassTable[in[i + 2]]));
+            i += 3;
+        } else {
+            *out++ = (plusAsSpace && byte == '+') ? ' ' : byte;
+            i++;
+        }
+    }
+    return (size_t)(out - output);
+}
+
+bool LBFormScanNextField(const char *input, size_t length, size_t *position, LBFormField *field) {
+    size_t start = *position;
+    while (start < length) {
+        const char *ampersand = memchr(input + start, '&', length - start);
+        size_t end = ampersand ? (size_t)(ampersand - input) : length;
+        const char *equals = memchr(input + start, '=', end - start);
+        size_t keyEnd = equals ? (size_t)(equals - input) : end;
+        if (keyEnd > start) {
+            field->keyOffset = start;
+            field->keyLength = keyEnd - start;
+            field->hasValue = (equals != NULL);
+            field->valueOffset = equals ? keyEnd + 1 : end;
+            field->valueLength = end - field->valueOffset;
+            *position = end + 1;
+            return true;
+        }
+        start = end + 1;
+    }
+    *position = length;
+    return false;
+}
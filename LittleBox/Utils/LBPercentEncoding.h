@@ -0,0 +1,84 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ Percent encoding and decoding (RFC 3986) over UTF-8 byte buffers, behind the
+ URL encoding methods of LBUtils(string) and the OAuth helpers.
+ 
+ Encoding leaves only the unreserved characters (A-Z a-z 0-9 - . _ ~) as they
+ are and escapes every other byte as %XX with upper case hex. That's the set
+ OAuth 1.0a signatures require, and it's safe for both query strings and
+ application/x-www-form-urlencoded bodies.
+ 
+ Each byte is classified with a single lookup in a 256-entry table, and nothing
+ here allocates: size the output with LBPercentEncodedLength (or use the worst
+ case of 3 bytes out per byte in), then encode in one pass.
+ 
+ Decoding turns %XX back into bytes, and optionally + into a space as form
+ encoding does. A % that isn't followed by two hex digits is copied through as
+ is. Decoded output is never longer than the input.
+ 
+ LBFormScanNextField walks the fields of a query string or form encoded body
+ in place, giving byte ranges for each key and value without copying or
+ decoding anything, so callers can decode only what they actually use.
+ 
+ */
+
+#ifndef LBPercentEncoding_h
+#define LBPercentEncoding_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the exact encoded length, or length itself when nothing needs escaping.
+size_t LBPercentEncodedLength(const uint8_t *input, size_t length);
+
+// returns the number of bytes written.
+size_t LBPercentEncode(const uint8_t *input, size_t length, char *output);
+
+// true if decoding would change anything, i.e. there's a % (or a + when
+// plusAsSpace is set).
+bool LBPercentNeedsDecoding(const char *input, size_t length, bool plusAsSpace);
+
+// returns the number of bytes written. output may be the same as input.
+size_t LBPercentDecode(const char *input, size_t length, uint8_t *output, bool plusAsSpace);
+
+// one key=value field, as offsets into the scanned buffer. still encoded.
+typedef struct {
+    size_t keyOffset;
+    size_t keyLength;
+    size_t valueOffset;
+    size_t valueLength;
+    bool hasValue; // false for a bare "key" with no "="
+} LBFormField;
+
+// finds the next field at or after *position, skipping empty ones and ones
+// with an empty key, and moves *position past it. false when there are none.
+bool LBFormScanNextField(const char *input, size_t length, size_t *position, LBFormField *field);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
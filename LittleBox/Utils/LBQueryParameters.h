@@ -0,0 +1,78 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ An ordered multimap of the key/value pairs in a query string or an
+ application/x-www-form-urlencoded body, e.g. the response to an OAuth token
+ request.
+ 
+ Parsing is a single pass over the UTF-8 bytes (see LBFormScanNextField in
+ LBPercentEncoding.h) that records where each key and value is, and nothing
+ more. Input given as NSData is used in place, not copied. Values are decoded
+ (+ as space, then %XX escapes) only when you ask for them, and cached; keys are
+ decoded the first time you look something up by key, unless decodingKeys is
+ NO, which keeps them exactly as written (what the LBUtils wrappers have always
+ returned).
+ 
+ Unlike an NSDictionary, repeated keys are all kept, in order:
+ 
+   LBQueryParameters *params = [LBQueryParameters parametersWithQueryString:@"tag=a&tag=b&x=1"];
+   [params objectForKey:@"tag"];       // @"a", the first one
+   params[@"x"];                       // @"1"
+   [params allObjectsForKey:@"tag"];   // @[@"a", @"b"]
+   [params dictionary];                // tag = a, x = 1
+ 
+ -dictionary decodes every value up front; -lazyDictionary is an NSDictionary
+ that still decodes each value only when it's looked up.
+ 
+ Fields with an empty key are skipped, and a key with no "=" has the value @"".
+ Safe to use from multiple threads.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+@interface LBQueryParameters : NSObject
+
++ (LBQueryParameters *)parametersWithQueryString:(NSString *)queryString;
++ (LBQueryParameters *)parametersWithData:(NSData *)data;
+- (id)initWithData:(NSData *)data;
++ (LBQueryParameters *)parametersWithQueryString:(NSString *)queryString decodingKeys:(BOOL)decodesKeys;
++ (LBQueryParameters *)parametersWithData:(NSData *)data decodingKeys:(BOOL)decodesKeys;
+- (id)initWithData:(NSData *)data decodingKeys:(BOOL)decodesKeys;
+
+// the number of pairs, counting repeated keys each time
+- (NSUInteger)count;
+- (NSString *)keyAtIndex:(NSUInteger)index;
+- (NSString *)objectAtIndex:(NSUInteger)index;
+
+// the first value for key, or nil
+- (NSString *)objectForKey:(NSString *)key;
+- (NSString *)objectForKeyedSubscript:(NSString *)key;
+// every value for key, in order. empty if there are none.
+- (NSArray *)allObjectsForKey:(NSString *)key;
+// distinct keys in order of first appearance
+- (NSArray *)allKeys;
+
+// keys to their first value, which is what LBUtils dictFromQueryString: returns
+- (NSMutableDictionary *)dictionary;
+// the same, decoding values as they're looked up
+- (NSDictionary *)lazyDictionary;
+
+@end
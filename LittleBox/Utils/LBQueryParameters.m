@@ -0,0 +1,256 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#import "LBQueryParameters.h"
+#import "LBPercentEncoding.h"
+
+@interface LBQueryParameters () {
+    const char *_bytes;
+    size_t _length;
+    LBFormField *_fields;
+    NSUInteger _count;
+    BOOL _decodesKeys;
+    // lazily decoded values, one slot per field. nil until first asked for.
+    __strong NSString **_values;
+}
+// whatever _bytes points into: an NSData, or an NSString's own storage
+@property (nonatomic, strong) id owner;
+- (id)initWithBytes:(const char *)bytes length:(size_t)length owner:(id)owner decodingKeys:(BOOL)decodesKeys;
+// decoded key -> NSArray of NSNumber field indexes, built on first lookup
+@property (nonatomic, strong) NSDictionary *index;
+@property (nonatomic, strong) NSArray *orderedKeys;
+@end
+
+// what -lazyDictionary returns: an immutable dictionary over the parameters,
+// so a value is still only decoded when it's looked up
+@interface LBQueryParametersDictionary : NSDictionary {
+    LBQueryParameters *_parameters;
+}
+- (id)initWithParameters:(LBQueryParameters *)parameters;
+@end
+
+@implementation LBQueryParametersDictionary
+
+- (id)initWithParameters:(LBQueryParameters *)parameters {
+    if ((self = [super init])) {
+        _parameters = parameters;
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+    return [[_parameters allKeys] count];
+}
+
+- (id)objectForKey:(id)key {
+    if (![key isKindOfClass:[NSString class]]) return nil;
+    return [_parameters objectForKey:key];
+}
+
+- (NSEnumerator *)keyEnumerator {
+    return [[_parameters allKeys] objectEnumerator];
+}
+
+@end
+
+@implementation LBQueryParameters
+
++ (LBQueryParameters *)parametersWithQueryString:(NSString *)queryString {
+    return [self parametersWithQueryString:queryString decodingKeys:YES];
+}
+
++ (LBQueryParameters *)parametersWithQueryString:(NSString *)queryString decodingKeys:(BOOL)decodesKeys {
+    if (!queryString) return nil;
+    // an immutable string's storage can't change, so when it's already UTF-8
+    // we parse it in place and just keep the string around.
+    NSString *immutable = [queryString copy];
+    const char *bytes = CFStringGetCStringPtr((__bridge CFStringRef)immutable, kCFStringEncodingUTF8);
+    if (bytes) {
+        // CF only hands out its own storage when it's all ASCII, so the byte
+        // count is the character count. (not strlen, which would stop at an
+        // embedded NUL.)
+        return [[LBQueryParameters alloc] initWithBytes:bytes length:(size_t)CFStringGetLength((__bridge CFStringRef)immutable) owner:immutable decodingKeys:decodesKeys];
+    }
+    return [[LBQueryParameters alloc] initWithData:[immutable dataUsingEncoding:NSUTF8StringEncoding] decodingKeys:decodesKeys];
+}
+
++ (LBQueryParameters *)parametersWithData:(NSData *)data {
+    return [self parametersWithData:data decodingKeys:YES];
+}
+
++ (LBQueryParameters *)parametersWithData:(NSData *)data decodingKeys:(BOOL)decodesKeys {
+    if (!data) return nil;
+    return [[LBQueryParameters alloc] initWithData:data decodingKeys:decodesKeys];
+}
+
+- (id)initWithData:(NSData *)data {
+    return [self initWithData:data decodingKeys:YES];
+}
+
+- (id)initWithData:(NSData *)data decodingKeys:(BOOL)decodesKeys {
+    // immutable data is as good as a copy. (copy is a no-op for it, but
+    // mutable data does get copied so it can't change under us.)
+    NSData *immutable = [data copy];
+    return [self initWithBytes:(const char *)[immutable bytes] length:[immutable length] owner:immutable decodingKeys:decodesKeys];
+}
+
+- (id)initWithBytes:(const char *)bytes length:(size_t)length owner:(id)owner decodingKeys:(BOOL)decodesKeys {
+    if ((self = [super init])) {
+        self.owner = owner;
+        _decodesKeys = decodesKeys;
+        _bytes = bytes;
+        _length = length;
+        NSUInteger capacity = 8;
+        _fields = malloc(capacity * sizeof(LBFormField));
+        if (!_fields) return nil;
+        size_t position = 0;
+        LBFormField field;
+        while (LBFormScanNextField(bytes, length, &position, &field)) {
+            if (_count == capacity) {
+                LBFormField *fields = realloc(_fields, capacity * 2 * sizeof(LBFormField));
+                if (!fields) return nil; // dealloc frees what we have
+                _fields = fields;
+                capacity *= 2;
+            }
+            _fields[_count++] = field;
+        }
+        _values = (__strong NSString **)calloc(MAX(_count, (NSUInteger)1), sizeof(NSString *));
+        if (!_values) return nil;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_values) {
+        for (NSUInteger i = 0; i < _count; i++) {
+            _values[i] = nil;
+        }
+    }
+    free(_values);
+    free(_fields);
+}
+
+#pragma mark decoding
+
+- (NSString *)decodeOffset:(size_t)offset length:(size_t)length {
+    if (!length) return @"";
+    const char *bytes = _bytes + offset;
+    if (!LBPercentNeedsDecoding(bytes, length, true)) {
+        return [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+    }
+    uint8_t *buffer = malloc(length);
+    if (!buffer) return nil;
+    size_t decodedLength = LBPercentDecode(bytes, length, buffer, true);
+    NSString *result = [[NSString alloc] initWithBytesNoCopy:buffer length:decodedLength encoding:NSUTF8StringEncoding freeWhenDone:YES];
+    if (!result) free(buffer);
+    return result;
+}
+
+- (NSString *)keyAtIndex:(NSUInteger)index {
+    if (index >= _count) return nil;
+    if (!_decodesKeys) {
+        return [[NSString alloc] initWithBytes:_bytes + _fields[index].keyOffset length:_fields[index].keyLength encoding:NSUTF8StringEncoding];
+    }
+    return [self decodeOffset:_fields[index].keyOffset length:_fields[index].keyLength];
+}
+
+- (NSString *)objectAtIndex:(NSUInteger)index {
+    if (index >= _count) return nil;
+    @synchronized(self) {
+        if (!_values[index]) {
+            // invalid UTF-8 decodes to nil, treat it as empty like a missing value
+            NSString *value = [self decodeOffset:_fields[index].valueOffset length:_fields[index].valueLength];
+            _values[index] = value ? value : @"";
+        }
+        return _values[index];
+    }
+}
+
+- (void)buildIndexIfNeeded {
+    @synchronized(self) {
+        if (self.index) return;
+        NSMutableDictionary *index = [NSMutableDictionary dictionary];
+        NSMutableArray *orderedKeys = [NSMutableArray array];
+        for (NSUInteger i = 0; i < _count; i++) {
+            NSString *key = [self keyAtIndex:i];
+            if (!key) continue;
+            NSMutableArray *indexes = [index objectForKey:key];
+            if (!indexes) {
+                indexes = [NSMutableArray array];
+                [index setObject:indexes forKey:key];
+                [orderedKeys addObject:key];
+            }
+            [indexes addObject:[NSNumber numberWithUnsignedInteger:i]];
+        }
+        self.orderedKeys = orderedKeys;
+        self.index = index;
+    }
+}
+
+#pragma mark access
+
+- (NSUInteger)count {
+    return _count;
+}
+
+- (NSString *)objectForKey:(NSString *)key {
+    if (!key) return nil;
+    [self buildIndexIfNeeded];
+    NSArray *indexes = [self.index objectForKey:key];
+    if (![indexes count]) return nil;
+    return [self objectAtIndex:[[indexes objectAtIndex:0] unsignedIntegerValue]];
+}
+
+- (NSString *)objectForKeyedSubscript:(NSString *)key {
+    return [self objectForKey:key];
+}
+
+- (NSArray *)allObjectsForKey:(NSString *)key {
+    if (!key) return [NSArray array];
+    [self buildIndexIfNeeded];
+    NSArray *indexes = [self.index objectForKey:key];
+    NSMutableArray *values = [NSMutableArray arrayWithCapacity:[indexes count]];
+    for (NSNumber *i in indexes) {
+        [values addObject:[self objectAtIndex:[i unsignedIntegerValue]]];
+    }
+    return values;
+}
+
+- (NSArray *)allKeys {
+    [self buildIndexIfNeeded];
+    return self.orderedKeys;
+}
+
+- (NSMutableDictionary *)dictionary {
+    [self buildIndexIfNeeded];
+    NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity:[self.orderedKeys count]];
+    for (NSString *key in self.orderedKeys) {
+        [dictionary setObject:[self objectForKey:key] forKey:key];
+    }
+    return dictionary;
+}
+
+- (NSDictionary *)lazyDictionary {
+    return [[LBQueryParametersDictionary alloc] initWithParameters:self];
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p; %@>", NSStringFromClass([self class]), self, [self dictionary]];
+}
+
+@end
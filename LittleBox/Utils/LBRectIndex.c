@@ -0,0 +1,193 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#include "LBRectIndex.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define LB_RECT_INDEX_DEFAULT_CAPACITY 64
+
+static const LBRectIndexBox emptyBox = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+
+static inline bool boxIsEmpty(LBRectIndexBox box) {
+    return box.minX > box.maxX;
+}
+
+static inline LBRectIndexBox boxUnion(LBRectIndexBox a, LBRectIndexBox b) {
+    LBRectIndexBox box;
+    box.minX = a.minX < b.minX ? a.minX : b.minX;
+    box.minY = a.minY < b.minY ? a.minY : b.minY;
+    box.maxX = a.maxX > b.maxX ? a.maxX : b.maxX;
+    box.maxY = a.maxY > b.maxY ? a.maxY : b.maxY;
+    return box;
+}
+
+static inline bool boxesTouch(LBRectIndexBox a, LBRectIndexBox b) {
+    return a.minX <= b.maxX && b.minX <= a.maxX && a.minY <= b.maxY && b.minY <= a.maxY;
+}
+
+static LBRectIndexBox boxFromRect(LBIndexRect rect) {
+    LBRectIndexBox box;
+    box.minX = rect.width < 0 ? rect.x + rect.width : rect.x;
+    box.maxX = rect.width < 0 ? rect.x : rect.x + rect.width;
+    box.minY = rect.height < 0 ? rect.y + rect.height : rect.y;
+    box.maxY = rect.height < 0 ? rect.y : rect.y + rect.height;
+    return box;
+}
+
+static LBIndexRect rectFromBox(LBRectIndexBox box) {
+    return LBRectIndexMakeRect(box.minX, box.minY, box.maxX - box.minX, box.maxY - box.minY);
+}
+
+static size_t roundUpToPowerOfTwo(size_t n) {
+    size_t power = 1;
+    while (power < n) power <<= 1;
+    return power;
+}
+
+bool LBRectIndexInit(LBRectIndex *index, size_t capacity) {
+    index->capacity = roundUpToPowerOfTwo(capacity ? capacity : LB_RECT_INDEX_DEFAULT_CAPACITY);
+    index->nodes = malloc(2 * index->capacity * sizeof(LBRectIndexBox));
+    index->freeHandles = malloc(index->capacity * sizeof(size_t));
+    index->freeCount = 0;
+    index->handleLimit = 0;
+    index->count = 0;
+    if (!index->nodes || !index->freeHandles) {
+        LBRectIndexDestroy(index);
+        return false;
+    }
+    for (size_t i = 0; i < 2 * index->capacity; i++) {
+        index->nodes[i] = emptyBox;
+    }
+    return true;
+}
+
+void LBRectIndexDestroy(LBRectIndex *index) {
+    free(index->nodes);
+    free(index->freeHandles);
+    index->nodes = NULL;
+    index->freeHandles = NULL;
+    index->capacity = 0;
+    index->freeCount = 0;
+    index->handleLimit = 0;
+    index->count = 0;
+}
+
+// doubles the leaves and rebuilds every inner node, O(n)
+static bool grow(LBRectIndex *index) {
+    size_t capacity = index->capacity * 2;
+    LBRectIndexBox *nodes = malloc(2 * capacity * sizeof(LBRectIndexBox));
+    size_t *freeHandles = realloc(index->freeHandles, capacity * sizeof(size_t));
+    if (!nodes || !freeHandles) {
+        free(nodes);
+        if (freeHandles) index->freeHandles = freeHandles;
+        return false;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        nodes[capacity + i] = i < index->capacity ? index->nodes[index->capacity + i] : emptyBox;
+    }
+    for (size_t i = capacity - 1; i >= 1; i--) {
+        nodes[i] = boxUnion(nodes[2 * i], nodes[2 * i + 1]);
+    }
+    nodes[0] = emptyBox;
+    free(index->nodes);
+    index->nodes = nodes;
+    index->freeHandles = freeHandles;
+    index->capacity = capacity;
+    return true;
+}
+
+static void setLeaf(LBRectIndex *index, size_t handle, LBRectIndexBox box) {
+    size_t node = index->capacity + handle;
+    index->nodes[node] = box;
+    for (node >>= 1; node >= 1; node >>= 1) {
+        LBRectIndexBox updated = boxUnion(index->nodes[2 * node], index->nodes[2 * node + 1]);
+        LBRectIndexBox old = index->nodes[node];
+        // nothing further up can change either
+        if (updated.minX == old.minX && updated.minY == old.minY && updated.maxX == old.maxX && updated.maxY == old.maxY) break;
+        index->nodes[node] = updated;
+    }
+}
+
+static bool handleInUse(const LBRectIndex *index, size_t handle) {
+    return handle < index->handleLimit && !boxIsEmpty(index->nodes[index->capacity + handle]);
+}
+
+size_t LBRectIndexInsert(LBRectIndex *index, LBIndexRect rect) {
+    size_t handle;
+    if (index->freeCount) {
+        handle = index->freeHandles[--index->freeCount];
+    } else {
+        if (index->handleLimit == index->capacity && !grow(index)) return LBRectIndexNoHandle;
+        handle = index->handleLimit++;
+    }
+    setLeaf(index, handle, boxFromRect(rect));
+    index->count++;
+    return handle;
+}
+
+void LBRectIndexUpdate(LBRectIndex *index, size_t handle, LBIndexRect rect) {
+    if (!handleInUse(index, handle)) return;
+    setLeaf(index, handle, boxFromRect(rect));
+}
+
+void LBRectIndexRemove(LBRectIndex *index, size_t handle) {
+    if (!handleInUse(index, handle)) return;
+    setLeaf(index, handle, emptyBox);
+    index->freeHandles[index->freeCount++] = handle;
+    index->count--;
+}
+
+bool LBRectIndexGet(const LBRectIndex *index, size_t handle, LBIndexRect *rect) {
+    if (!handleInUse(index, handle)) return false;
+    if (rect) *rect = rectFromBox(index->nodes[index->capacity + handle]);
+    return true;
+}
+
+size_t LBRectIndexCount(const LBRectIndex *index) {
+    return index->count;
+}
+
+bool LBRectIndexBounds(const LBRectIndex *index, LBIndexRect *bounds) {
+    if (!index->count) return false;
+    if (bounds) *bounds = rectFromBox(index->nodes[1]);
+    return true;
+}
+
+size_t LBRectIndexQuery(const LBRectIndex *index, LBIndexRect area, LBRectIndexVisitFunction visit, void *context) {
+    if (!index->count) return 0;
+    LBRectIndexBox target = boxFromRect(area);
+    // depth first, left to right, so leaves come out in handle order. the
+    // tree is never more than 64 levels deep.
+    size_t stack[64];
+    size_t depth = 0;
+    size_t visited = 0;
+    stack[depth++] = 1;
+    while (depth) {
+        size_t node = stack[--depth];
+        if (!boxesTouch(index->nodes[node], target)) continue;
+        if (node >= index->capacity) {
+            visited++;
+            if (visit && !visit(node - index->capacity, rectFromBox(index->nodes[node]), context)) break;
+        } else {
+            stack[depth++] = 2 * node + 1;
+            stack[depth++] = 2 * node;
+        }
+    }
+    return visited;
+}
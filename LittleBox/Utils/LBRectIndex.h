@@ -0,0 +1,127 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ An index of rectangles that keeps the bounding box of all of them up to date
+ as they're added, moved and removed, and finds the ones overlapping a given
+ area. It's what LBUtils setCorrectContentSizeOnScrollView:ensureScrollable:
+ keeps per scroll view, one rect per subview. It's plain C with no
+ dependencies, so it can be built and exercised anywhere.
+ 
+ Each rect gets a handle (a small integer, reused after removal) when it's
+ inserted. Internally the handles are the leaves of a complete binary tree
+ whose inner nodes hold the bounding box of everything below them, so:
+ 
+ - the overall bounds are always sitting at the root, O(1).
+ - inserting, moving or removing a rect refreshes its leaf's ancestors,
+   O(log n).
+ - an overlap query walks down only into nodes whose boxes overlap the area.
+   The tree groups rects by handle, not by position, so this prunes well when
+   rects near each other were inserted near each other in time (as subviews
+   laid out top to bottom are), and degrades towards a linear scan when not.
+ 
+ The index grows as needed (which is the only time it allocates) and is not
+ thread-safe; callers supply locking.
+ 
+ Typical use:
+ 
+   LBRectIndex index;
+   LBRectIndexInit(&index, 0);
+   size_t handle = LBRectIndexInsert(&index, LBRectIndexMakeRect(0, 0, 320, 44));
+   LBRectIndexUpdate(&index, handle, LBRectIndexMakeRect(0, 44, 320, 44));
+   LBIndexRect bounds;
+   if (LBRectIndexBounds(&index, &bounds)) { ... }
+   LBRectIndexQuery(&index, visibleRect, myVisitFunction, myContext);
+   LBRectIndexDestroy(&index);
+ 
+ */
+
+#ifndef LBRectIndex_h
+#define LBRectIndex_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LBRectIndexNoHandle ((size_t)-1)
+
+typedef struct {
+    double x;
+    double y;
+    double width;
+    double height;
+} LBIndexRect;
+
+// a node's bounding box. an empty node has min > max on both axes, which
+// makes it drop out of unions and overlap tests without special cases.
+typedef struct {
+    double minX;
+    double minY;
+    double maxX;
+    double maxY;
+} LBRectIndexBox;
+
+typedef struct {
+    LBRectIndexBox *nodes; // 2 * capacity, node 1 is the root, leaves from capacity on
+    size_t capacity; // leaves, a power of two
+    size_t *freeHandles; // removed handles, reused last in first out
+    size_t freeCount;
+    size_t handleLimit; // handles below this have been given out at some point
+    size_t count;
+} LBRectIndex;
+
+// called for each rect that overlaps the query area. return false to stop.
+typedef bool (*LBRectIndexVisitFunction)(size_t handle, LBIndexRect rect, void *context);
+
+static inline LBIndexRect LBRectIndexMakeRect(double x, double y, double width, double height) {
+    LBIndexRect rect = { x, y, width, height };
+    return rect;
+}
+
+// capacity is a hint, 0 for a small default. returns false if out of memory.
+bool LBRectIndexInit(LBRectIndex *index, size_t capacity);
+void LBRectIndexDestroy(LBRectIndex *index);
+
+// rects with negative sizes are normalized, as CGRectStandardize does. returns
+// LBRectIndexNoHandle if out of memory.
+size_t LBRectIndexInsert(LBRectIndex *index, LBIndexRect rect);
+void LBRectIndexUpdate(LBRectIndex *index, size_t handle, LBIndexRect rect);
+void LBRectIndexRemove(LBRectIndex *index, size_t handle);
+
+// the (normalized) rect for a handle. false if the handle isn't in use.
+bool LBRectIndexGet(const LBRectIndex *index, size_t handle, LBIndexRect *rect);
+
+size_t LBRectIndexCount(const LBRectIndex *index);
+
+// the smallest rect containing every rect in the index. false if it's empty.
+bool LBRectIndexBounds(const LBRectIndex *index, LBIndexRect *bounds);
+
+// visits every rect that overlaps or touches area, in handle order. returns
+// the number visited.
+size_t LBRectIndexQuery(const LBRectIndex *index, LBIndexRect area, LBRectIndexVisitFunction visit, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+// Borrows a string's UTF-8 bytes for the byte level C helpers (percent
+// encoding, query parsing, OAuth signing), without copying when the string is
+// stored that way. The length comes from the string, not strlen, so a string
+// with an embedded NUL keeps all its bytes. The bytes live as long as the
+// string, or the current autorelease pool. nil, or a string that can't be
+// converted, gives "" and a length of 0.
+
+#import <Foundation/Foundation.h>
+
+const char *LBUTF8BytesOfString(NSString *string, size_t *length);
@@ -0,0 +1,36 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#import "LBStringBytes.h"
+
+const char *LBUTF8BytesOfString(NSString *string, size_t *length) {
+    *length = 0;
+    if (!string) return "";
+    const char *bytes = CFStringGetCStringPtr((__bridge CFStringRef)string, kCFStringEncodingUTF8);
+    if (bytes) {
+        // CF only hands out its own storage when it's all ASCII, so the byte
+        // count is the character count
+        *length = (size_t)CFStringGetLength((__bridge CFStringRef)string);
+        return bytes;
+    }
+    // autoreleasing, so the bytes outlive this function
+    __autoreleasing NSData *data = [string dataUsingEncoding:NSUTF8StringEncoding];
+    if (!data) return "";
+    *length = [data length];
+    return *length ? (const char *)[data bytes] : "";
+}
@@ -29,6 +29,38 @@
  Warning: do not return values from your target selector method. ARC will not
  know the retain/release status of the return value and a memory leak may ensue.
  
+ Wheel timers
+ 
+ Each regular LBTimer is its own NSTimer with its own runloop registration,
+ which gets expensive once there are thousands of them (per-cell refreshes,
+ per-request timeouts). The scheduledWheelTimer... constructors instead put the
+ timer on a single shared hierarchical timing wheel (see LBTimingWheel.h) that
+ is driven by one dispatch timer source on the main queue. Scheduling and
+ invalidating a wheel timer are O(1) no matter how many are pending, and all
+ the timers that come due within one tolerance window fire in a single wakeup.
+ 
+ Wheel timers have 1 ms resolution and always fire on the main thread (in all
+ runloop modes, since that's how the main queue is serviced), regardless of
+ the thread that created them. They never fire early, and fire at most
+ +wheelTolerance late, plus whatever the main thread is busy with. Like
+ NSTimer, a repeating wheel timer keeps to its original schedule, skipping
+ fire times it missed rather than drifting. The zeroing weak target and
+ automatic invalidation work the same as for regular LBTimers.
+ 
+ Dispatch timers
+ 
+ Regular LBTimers are added to the current thread's runloop, so one created on
+ a GCD worker thread (which has no running runloop) silently never fires. The
+ scheduledDispatchTimer... constructors back the timer with a dispatch timer
+ source instead, which fires on whatever queue you give it with no runloop
+ involved. leeway is how late the system may fire it to save power, the same
+ as the leeway of dispatch_source_set_timer.
+ 
+ Dispatch timers can also be suspended and resumed. While suspended the timer
+ doesn't fire; if any fire times passed in the meantime it fires once right
+ after -resume, then carries on with its original schedule. A suspended timer
+ can be invalidated directly.
+ 
  TODO: implement (or proxy) the full NSTimer interface and constructors
  
  */
@@ -45,6 +77,26 @@
 + (LBTimer*)scheduledTimerWithTimeInterval:(NSTimeInterval)seconds target:(id)target selector:(SEL)aSelector userInfo:(id)userInfo repeats:(BOOL)repeats forMode:(NSString*)runLoopMode;
 - (id)initWithScheduledTimerWithTimeInterval:(NSTimeInterval)seconds target:(id)target selector:(SEL)aSelector userInfo:(id)userInfo repeats:(BOOL)repeats forMode:(NSString*)runLoopMode;
 
+// timers on the shared timing wheel, see above. self.timer is nil for these.
++ (LBTimer*)scheduledWheelTimerWithTimeInterval:(NSTimeInterval)seconds target:(id)target selector:(SEL)aSelector userInfo:(id)userInfo repeats:(BOOL)repeats;
+- (id)initWithScheduledWheelTimerWithTimeInterval:(NSTimeInterval)seconds target:(id)target selector:(SEL)aSelector userInfo:(id)userInfo repeats:(BOOL)repeats;
+
+// timers on a dispatch timer source targeting queue, see above. self.timer
+// is nil for these.
++ (LBTimer*)scheduledDispatchTimerWithTimeInterval:(NSTimeInterval)seconds leeway:(NSTimeInterval)leeway queue:(dispatch_queue_t)queue target:(id)target selector:(SEL)aSelector userInfo:(id)userInfo repeats:(BOOL)repeats;
+- (id)initWithScheduledDispatchTimerWithTimeInterval:(NSTimeInterval)seconds leeway:(NSTimeInterval)leeway queue:(dispatch_queue_t)queue target:(id)target selector:(SEL)aSelector userInfo:(id)userInfo repeats:(BOOL)repeats;
+
+// only dispatch timers can be suspended, for others these do nothing.
+// suspending twice takes two resumes.
+- (void)suspend;
+- (void)resume;
+- (BOOL)isSuspended;
+
+// how late a wheel timer may fire so that it can share a wakeup with others.
+// applies to all wheel timers from their next wakeup on. defaults to 10 ms.
++ (void)setWheelTolerance:(NSTimeInterval)tolerance;
++ (NSTimeInterval)wheelTolerance;
+
 - (void)fire;
 - (void)invalidate;
 - (BOOL)isValid;
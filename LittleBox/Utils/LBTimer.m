@@ -17,6 +17,97 @@
  */
 
 #import "LBTimer.h"
+#import "LBTimingWheel.h"
+#import "LBUtils.h"
+#import <pthread.h>
+
+// the shared wheel works in 1 ms ticks counted from when it was created.
+#define LB_WHEEL_TICKS_PER_SECOND 1000.0
+
+typedef enum {
+    LBTimerBackendRunLoop,
+    LBTimerBackendWheel,
+    LBTimerBackendDispatch
+} LBTimerBackend;
+
+@interface LBTimer () {
+    LBTimingWheelEntry _wheelEntry;
+    uint64_t _wheelInterval;
+    BOOL _repeats;
+    BOOL _wheelValid;
+    NSUInteger _suspendCount;
+}
+@property (nonatomic, assign) LBTimerBackend backend;
+@property (nonatomic, strong) dispatch_source_t source;
+@property (nonatomic, strong) id storedUserInfo;
+- (void)wheelTimerDidExpire;
+@end
+
+// all wheel state is guarded by _wheelLock. the dispatch source only ever runs
+// on the main queue.
+static LBTimingWheel _wheel;
+static pthread_mutex_t _wheelLock = PTHREAD_MUTEX_INITIALIZER;
+static dispatch_source_t _wheelSource = nil;
+static NSTimeInterval _wheelOrigin = 0;
+static uint64_t _wheelArmedTick = UINT64_MAX;
+static uint64_t _wheelToleranceTicks = 10;
+
+static uint64_t LBWheelNowTick(void) {
+    return (uint64_t)(([LBUtils monotonicTime] - _wheelOrigin) * LB_WHEEL_TICKS_PER_SECOND);
+}
+
+// points the dispatch source at the wheel's next expiry, called with the lock
+// held. the source fires somewhere between half and the full tolerance after
+// the first timer is due, so everything due in that window shares the wakeup.
+static void LBWheelRearm(BOOL force) {
+    uint64_t nextTick;
+    if (!LBTimingWheelNextExpiry(&_wheel, &nextTick)) {
+        if (force && _wheelArmedTick != UINT64_MAX) {
+            dispatch_source_set_timer(_wheelSource, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+            _wheelArmedTick = UINT64_MAX;
+        }
+        return;
+    }
+    uint64_t wakeTick = nextTick + _wheelToleranceTicks / 2;
+    if (!force && wakeTick >= _wheelArmedTick) return;
+    uint64_t nowTick = LBWheelNowTick();
+    int64_t delay = wakeTick > nowTick ? (int64_t)(wakeTick - nowTick) * NSEC_PER_MSEC : 0;
+    uint64_t leeway = (_wheelToleranceTicks - _wheelToleranceTicks / 2) * NSEC_PER_MSEC;
+    dispatch_source_set_timer(_wheelSource, dispatch_time(DISPATCH_TIME_NOW, delay), DISPATCH_TIME_FOREVER, leeway);
+    _wheelArmedTick = wakeTick;
+}
+
+static void LBWheelCollectExpired(LBTimingWheelEntry *entry, void *context) {
+    // hand the reference the wheel held over to the array.
+    [(__bridge NSMutableArray*)context addObject:(__bridge_transfer LBTimer*)entry->context];
+}
+
+static void LBWheelFire(void) {
+    NSMutableArray *expired = [NSMutableArray array];
+    pthread_mutex_lock(&_wheelLock);
+    LBTimingWheelAdvance(&_wheel, LBWheelNowTick(), LBWheelCollectExpired, (__bridge void*)expired);
+    _wheelArmedTick = UINT64_MAX;
+    LBWheelRearm(YES);
+    pthread_mutex_unlock(&_wheelLock);
+    // fire outside the lock, targets are free to schedule and invalidate.
+    for (LBTimer *timer in expired) {
+        [timer wheelTimerDidExpire];
+    }
+}
+
+static void LBWheelSetUp(void) {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        _wheelOrigin = [LBUtils monotonicTime];
+        LBTimingWheelInit(&_wheel, 0);
+        _wheelSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
+        dispatch_source_set_timer(_wheelSource, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        dispatch_source_set_event_handler(_wheelSource, ^{
+            LBWheelFire();
+        });
+        dispatch_resume(_wheelSource);
+    });
+}
 
 @implementation LBTimer
 
@@ -34,6 +125,9 @@
 
 - (id)initWithScheduledTimerWithTimeInterval:(NSTimeInterval)seconds target:(id)target selector:(SEL)aSelector userInfo:(id)userInfo repeats:(BOOL)repeats forMode:(NSString *)runLoopMode {
     if ((self = [super init])) {
+        self.backend = LBTimerBackendRunLoop;
+        self.storedUserInfo = userInfo;
+        _repeats = repeats;
         // create an retain a timer that targets self and fires self's fire
         // method. this creates a retain cycle between self and self.timer, but
         // the cycle will be broken appropriately.
@@ -46,6 +140,171 @@
     return self;
 }
 
+#pragma mark wheel timers
+
++ (LBTimer*)scheduledWheelTimerWithTimeInterval:(NSTimeInterval)seconds target:(id)target selector:(SEL)aSelector userInfo:(id)userInfo repeats:(BOOL)repeats {
+    return [[LBTimer alloc] initWithScheduledWheelTimerWithTimeInterval:seconds target:target selector:aSelector userInfo:userInfo repeats:repeats];
+}
+
+- (id)initWithScheduledWheelTimerWithTimeInterval:(NSTimeInterval)seconds target:(id)target selector:(SEL)aSelector userInfo:(id)userInfo repeats:(BOOL)repeats {
+    if ((self = [super init])) {
+        self.backend = LBTimerBackendWheel;
+        self.storedUserInfo = userInfo;
+        self.selector = aSelector;
+        self.target = target;
+        _repeats = repeats;
+        // like NSTimer, a repeating interval under the resolution is rounded
+        // up to it so we can't spin.
+        NSTimeInterval ticks = ceil(MAX(seconds, 0) * LB_WHEEL_TICKS_PER_SECOND);
+        _wheelInterval = MAX((uint64_t)ticks, (uint64_t)1);
+        LBTimingWheelEntryInit(&_wheelEntry, NULL);
+        LBWheelSetUp();
+        pthread_mutex_lock(&_wheelLock);
+        // the wheel holds a reference while the timer is scheduled, the same
+        // way the runloop retains an NSTimer.
+        _wheelEntry.context = (__bridge_retained void*)self;
+        _wheelValid = YES;
+        LBTimingWheelSchedule(&_wheel, &_wheelEntry, LBWheelNowTick() + (uint64_t)ticks);
+        LBWheelRearm(NO);
+        pthread_mutex_unlock(&_wheelLock);
+    }
+    return self;
+}
+
++ (void)setWheelTolerance:(NSTimeInterval)tolerance {
+    pthread_mutex_lock(&_wheelLock);
+    _wheelToleranceTicks = (uint64_t)(MAX(tolerance, 0) * LB_WHEEL_TICKS_PER_SECOND);
+    pthread_mutex_unlock(&_wheelLock);
+}
+
++ (NSTimeInterval)wheelTolerance {
+    pthread_mutex_lock(&_wheelLock);
+    NSTimeInterval tolerance = _wheelToleranceTicks / LB_WHEEL_TICKS_PER_SECOND;
+    pthread_mutex_unlock(&_wheelLock);
+    return tolerance;
+}
+
+- (void)wheelTimerDidExpire {
+    pthread_mutex_lock(&_wheelLock);
+    if (!_wheelValid) {
+        // invalidated between being collected and now.
+        pthread_mutex_unlock(&_wheelLock);
+        return;
+    }
+    if (_repeats) {
+        // stay on the original schedule, skipping any fire times we've missed
+        // entirely rather than firing several times in a row.
+        uint64_t nowTick = LBWheelNowTick();
+        uint64_t nextTick = _wheelEntry.expires + _wheelInterval;
+        if (nextTick <= nowTick) {
+            nextTick += ((nowTick - nextTick) / _wheelInterval + 1) * _wheelInterval;
+        }
+        _wheelEntry.context = (__bridge_retained void*)self;
+        LBTimingWheelSchedule(&_wheel, &_wheelEntry, nextTick);
+        LBWheelRearm(NO);
+    } else {
+        _wheelValid = NO;
+    }
+    pthread_mutex_unlock(&_wheelLock);
+    [self fire];
+}
+
+- (void)invalidateWheelTimer {
+    void *reference = NULL;
+    pthread_mutex_lock(&_wheelLock);
+    _wheelValid = NO;
+    if (LBTimingWheelEntryIsScheduled(&_wheelEntry)) {
+        LBTimingWheelCancel(&_wheel, &_wheelEntry);
+        reference = _wheelEntry.context;
+        _wheelEntry.context = NULL;
+    }
+    pthread_mutex_unlock(&_wheelLock);
+    // drop the wheel's reference outside the lock, this may well dealloc us.
+    if (reference) CFRelease(reference);
+}
+
+#pragma mark dispatch timers
+
++ (LBTimer*)scheduledDispatchTimerWithTimeInterval:(NSTimeInterval)seconds leeway:(NSTimeInterval)leeway queue:(dispatch_queue_t)queue target:(id)target selector:(SEL)aSelector userInfo:(id)userInfo repeats:(BOOL)repeats {
+    return [[LBTimer alloc] initWithScheduledDispatchTimerWithTimeInterval:seconds leeway:leeway queue:queue target:target selector:aSelector userInfo:userInfo repeats:repeats];
+}
+
+- (id)initWithScheduledDispatchTimerWithTimeInterval:(NSTimeInterval)seconds leeway:(NSTimeInterval)leeway queue:(dispatch_queue_t)queue target:(id)target selector:(SEL)aSelector userInfo:(id)userInfo repeats:(BOOL)repeats {
+    if ((self = [super init])) {
+        self.backend = LBTimerBackendDispatch;
+        self.storedUserInfo = userInfo;
+        self.selector = aSelector;
+        self.target = target;
+        _repeats = repeats;
+        seconds = MAX(seconds, 0);
+        self.source = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+        // like NSTimer, a repeating interval of zero is bumped up a little so
+        // the source can't spin.
+        uint64_t interval = repeats ? (uint64_t)(MAX(seconds, 0.0001) * NSEC_PER_SEC) : DISPATCH_TIME_FOREVER;
+        dispatch_source_set_timer(self.source, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(seconds * NSEC_PER_SEC)), interval, (uint64_t)(MAX(leeway, 0) * NSEC_PER_SEC));
+        // the handler retains self the same way an NSTimer retains its
+        // target, and the same way the cycle is broken by invalidating, which
+        // cancels the source and releases the handler.
+        dispatch_source_set_event_handler(self.source, ^{
+            [self dispatchTimerDidFire];
+        });
+        dispatch_resume(self.source);
+    }
+    return self;
+}
+
+- (void)dispatchTimerDidFire {
+    if (!_repeats) {
+        // fire once, like a non-repeating NSTimer, which is no longer valid by
+        // the time its target runs.
+        [self invalidate];
+        if (!self.target) return;
+    }
+    [self fire];
+}
+
+- (void)suspend {
+    if (self.backend != LBTimerBackendDispatch) return;
+    @synchronized(self) {
+        if (!self.source) return;
+        _suspendCount++;
+        dispatch_suspend(self.source);
+    }
+}
+
+- (void)resume {
+    if (self.backend != LBTimerBackendDispatch) return;
+    @synchronized(self) {
+        if (!self.source || !_suspendCount) return;
+        _suspendCount--;
+        dispatch_resume(self.source);
+    }
+}
+
+- (BOOL)isSuspended {
+    @synchronized(self) {
+        return _suspendCount > 0;
+    }
+}
+
+- (void)invalidateDispatchTimer {
+    dispatch_source_t source = nil;
+    @synchronized(self) {
+        source = self.source;
+        self.source = nil;
+        if (!source) return;
+        dispatch_source_cancel(source);
+        // a suspended source never gets around to cancelling (and is a crash
+        // to release), so balance out any outstanding suspends.
+        while (_suspendCount) {
+            _suspendCount--;
+            dispatch_resume(source);
+        }
+    }
+}
+
+#pragma mark firing
+
 - (void)fire {
     if (!self.target) {
         // target has been deallocated and we now have a nil reference thanks to
@@ -54,7 +313,7 @@
         // both the timer and this object will drop to a zero retain count and
         // be deallocated. (unless some other object is also retaining this
         // LBTimer, which would be odd.)
-        [self.timer invalidate];
+        [self invalidate];
         return;
     }
     // suppress the "performSelector may cause a leak because its selector is
@@ -69,14 +328,33 @@
 // a few convient proxy methods
 
 - (id)userInfo {
-    return self.timer.userInfo;
+    return self.storedUserInfo;
 }
 
 - (BOOL)isValid {
+    if (self.backend == LBTimerBackendWheel) {
+        pthread_mutex_lock(&_wheelLock);
+        BOOL valid = _wheelValid;
+        pthread_mutex_unlock(&_wheelLock);
+        return valid;
+    }
+    if (self.backend == LBTimerBackendDispatch) {
+        @synchronized(self) {
+            return self.source != nil;
+        }
+    }
     return [self.timer isValid];
 }
 
 - (void)invalidate {
+    if (self.backend == LBTimerBackendWheel) {
+        [self invalidateWheelTimer];
+        return;
+    }
+    if (self.backend == LBTimerBackendDispatch) {
+        [self invalidateDispatchTimer];
+        return;
+    }
     [self.timer invalidate];
 }
 
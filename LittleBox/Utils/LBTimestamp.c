@@ -0,0 +1,250 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#include "LBTimestamp.h"
+#include <math.h>
+
+double LBTimestampSecondsFromMillis(int64_t millis) {
+    // both operands are exact, and IEEE division rounds correctly, so this is
+    // the closest double there is to the true number of seconds.
+    return (double)millis / 1000.0;
+}
+
+// the whole computation stays in doubles holding integers well under 2^53, and
+// floors are done by truncating conversions plus a compare rather than by
+// floor(), so the bulk loop vectorizes.
+static inline int64_t millisFromSeconds(double seconds) {
+    // split off the whole seconds, which is exact, then scale the fraction.
+    // fma recovers the rounding error of the scaling, so the decision to round
+    // up is made on the exact product rather than a rounded one. (the
+    // fraction is positive, so that's half away from zero for positive times,
+    // and an exact half can't occur anyway: 1/2000 isn't a binary fraction.)
+    double whole = (double)(int64_t)seconds;
+    whole -= (whole > seconds) ? 1.0 : 0.0;
+    double fraction = seconds - whole;
+    double scaled = fraction * 1000.0;
+    double error = fma(fraction, 1000.0, -scaled);
+    double floorScaled = (double)(int64_t)scaled;
+    double remainder = (scaled - floorScaled) + error;
+    double roundUp = (remainder >= 0.5) ? 1.0 : 0.0;
+    return (int64_t)(whole * 1000.0 + floorScaled + roundUp);
+}
+
+int64_t LBTimestampMillisFromSeconds(double seconds) {
+    return millisFromSeconds(seconds);
+}
+
+void LBTimestampSecondsFromMillisBulk(const int64_t *millis, double *seconds, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        seconds[i] = (double)millis[i] / 1000.0;
+    }
+}
+
+void LBTimestampMillisFromSecondsBulk(const double *seconds, int64_t *millis, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        millis[i] = millisFromSeconds(seconds[i]);
+    }
+}
+
+#pragma mark - ISO 8601
+
+// days between 1970-01-01 and the given proleptic gregorian date, and back.
+// (Howard Hinnant's algorithms, which work in 400 year eras starting in March
+// so the leap day falls at the end of the year.)
+static int64_t daysFromCivil(int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned yearOfEra = (unsigned)(year - era * 400);
+    unsigned dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + (int64_t)dayOfEra - 719468;
+}
+
+static void civilFromDays(int64_t days, int64_t *year, unsigned *month, unsigned *day) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned dayOfEra = (unsigned)(days - era * 146097);
+    unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    unsigned shiftedMonth = (5 * dayOfYear + 2) / 153;
+    *day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+    *month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+    *year = (int64_t)yearOfEra + era * 400 + (*month <= 2);
+}
+
+static unsigned daysInMonth(int64_t year, unsigned month) {
+    static const uint8_t days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if (month == 2 && (year % 4 == 0) && (year % 100 != 0 || year % 400 == 0)) return 29;
+    return days[month - 1];
+}
+
+// reads exactly count digits at *p, advancing it. false if any isn't a digit.
+static inline bool readDigits(const char **p, const char *end, unsigned count, unsigned *value) {
+    if ((size_t)(end - *p) < count) return false;
+    unsigned result = 0;
+    for (unsigned i = 0; i < count; i++) {
+        unsigned digit = (unsigned char)(*p)[i] - '0';
+        if (digit > 9) return false;
+        result = result * 10 + digit;
+    }
+    *p += count;
+    *value = result;
+    return true;
+}
+
+bool LBTimestampParseISO8601(const char *input, size_t length, double *seconds) {
+    const char *p = input;
+    const char *end = input + length;
+    unsigned year, month, day, hour = 0, minute = 0, second = 0;
+
+    if (!readDigits(&p, end, 4, &year) || p == end || *p++ != '-') return false;
+    if (!readDigits(&p, end, 2, &month) || p == end || *p++ != '-') return false;
+    if (!readDigits(&p, end, 2, &day)) return false;
+    if (month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month)) return false;
+
+    uint64_t fraction = 0;
+    uint64_t fractionScale = 1;
+    int offsetMinutes = 0;
+    if (p < end) {
+        if (*p != 'T' && *p != 't' && *p != ' ') return false;
+        p++;
+        if (!readDigits(&p, end, 2, &hour) || p == end || *p++ != ':') return false;
+        if (!readDigits(&p, end, 2, &minute)) return false;
+        if (p < end && *p == ':') {
+            p++;
+            if (!readDigits(&p, end, 2, &second)) return false;
+            if (p < end && (*p == '.' || *p == ',')) {
+                p++;
+                // keep nanoseconds, but allow (and check) any digits after
+                const char *digits = p;
+                while (p < end && (unsigned)((unsigned char)*p - '0') <= 9) {
+                    if (p - digits < 9) {
+                        fraction = fraction * 10 + (unsigned)(*p - '0');
+                        fractionScale *= 10;
+                    }
+                    p++;
+                }
+                if (p == digits) return false;
+            }
+        }
+        if (hour > 23 || minute > 59 || second > 60) return false;
+
+        if (p < end) {
+            if (*p == 'Z' || *p == 'z') {
+                p++;
+            } else if (*p == '+' || *p == '-') {
+                int sign = (*p++ == '-') ? -1 : 1;
+                unsigned offsetHours, offsetMins = 0;
+                if (!readDigits(&p, end, 2, &offsetHours)) return false;
+                if (p < end) {
+                    if (*p == ':') p++;
+                    if (!readDigits(&p, end, 2, &offsetMins)) return false;
+                }
+                if (offsetHours > 23 || offsetMins > 59) return false;
+                offsetMinutes = sign * (int)(offsetHours * 60 + offsetMins);
+            } else {
+                return false;
+            }
+        }
+        if (p != end) return false;
+    }
+
+    int64_t whole = daysFromCivil(year, month, day) * 86400
+                  + (int64_t)hour * 3600 + (int64_t)minute * 60 + second
+                  - (int64_t)offsetMinutes * 60;
+    *seconds = (double)whole + (double)fraction / (double)fractionScale;
+    return true;
+}
+
+size_t LBTimestampParseISO8601Bulk(const char * const *inputs, const size_t *lengths, double *seconds, size_t count) {
+    size_t parsed = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (LBTimestampParseISO8601(inputs[i], lengths[i], &seconds[i])) {
+            parsed++;
+        } else {
+            seconds[i] = NAN;
+        }
+    }
+    return parsed;
+}
+
+static inline char *writeDigits(char *p, unsigned value, unsigned count) {
+    for (unsigned i = count; i > 0; i--) {
+        p[i - 1] = (char)('0' + value % 10);
+        value /= 10;
+    }
+    return p + count;
+}
+
+size_t LBTimestampFormatISO8601(double seconds, int fractionDigits, int offsetMinutes, char *output) {
+    static const uint32_t powersOfTen[10] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+    };
+    if (fractionDigits < 0) fractionDigits = 0;
+    if (fractionDigits > 9) fractionDigits = 9;
+    if (offsetMinutes <= -24 * 60 || offsetMinutes >= 24 * 60) return 0;
+    // years 0000 to 9999, checked loosely here (which also rules out NaN and
+    // infinities) and exactly below.
+    double local = seconds + offsetMinutes * 60.0;
+    if (!(local > -62167219200.0 - 86400.0 && local < 253402300800.0 + 86400.0)) return 0;
+
+    // round the fraction first, so that carrying into the next second is
+    // handled before the fields are split out.
+    double wholeSeconds = floor(local);
+    uint32_t scale = powersOfTen[fractionDigits];
+    uint32_t fraction = (uint32_t)llround((local - wholeSeconds) * scale);
+    int64_t whole = (int64_t)wholeSeconds;
+    if (fraction >= scale) {
+        fraction -= scale;
+        whole++;
+    }
+
+    int64_t days = whole >= 0 ? whole / 86400 : -((-whole + 86399) / 86400);
+    unsigned secondOfDay = (unsigned)(whole - days * 86400);
+    int64_t year;
+    unsigned month, day;
+    civilFromDays(days, &year, &month, &day);
+    if (year < 0 || year > 9999) return 0;
+
+    char *p = output;
+    p = writeDigits(p, (unsigned)year, 4);
+    *p++ = '-';
+    p = writeDigits(p, month, 2);
+    *p++ = '-';
+    p = writeDigits(p, day, 2);
+    *p++ = 'T';
+    p = writeDigits(p, secondOfDay / 3600, 2);
+    *p++ = ':';
+    p = writeDigits(p, secondOfDay / 60 % 60, 2);
+    *p++ = ':';
+    p = writeDigits(p, secondOfDay % 60, 2);
+    if (fractionDigits > 0) {
+        *p++ = '.';
+        p = writeDigits(p, fraction, (unsigned)fractionDigits);
+    }
+    if (offsetMinutes == 0) {
+        *p++ = 'Z';
+    } else {
+        unsigned magnitude = (unsigned)(offsetMinutes < 0 ? -offsetMinutes : offsetMinutes);
+        *p++ = offsetMinutes < 0 ? '-' : '+';
+        p = writeDigits(p, magnitude / 60, 2);
+        *p++ = ':';
+        p = writeDigits(p, magnitude % 60, 2);
+    }
+    return (size_t)(p - output);
+}
@@ -0,0 +1,89 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ Conversions between Unix epoch milliseconds (as our APIs send them) and
+ NSTimeInterval seconds since 1970 (as NSDate takes them), behind the epoch
+ methods of LBUtils(date).
+ 
+ Both directions are exact in the sense that matters: milliseconds to seconds
+ gives the double closest to the true quotient, and seconds to milliseconds
+ rounds the exact value of the double to the nearest millisecond (half away
+ from zero), rather than rounding an already rounded product. So a
+ millisecond value survives the round trip unchanged, for any date within a
+ few hundred thousand years of 1970.
+ 
+ The bulk variants run over plain C arrays in simple branch-free loops that the
+ compiler can vectorize, for when a response carries thousands of timestamps.
+ Results for NaN or infinite seconds are undefined.
+ 
+ There's also an ISO 8601 parser and formatter, which are much cheaper than an
+ NSDateFormatter and work on bytes, so a timestamp can be parsed straight out
+ of a JSON buffer without making a string. The parser takes the RFC 3339
+ profile of ISO 8601 plus the usual loose variants seen in APIs:
+ 
+   2013-03-02                       (midnight UTC)
+   2013-03-02T18:30                 (no offset means UTC)
+   2013-03-02T18:30:05Z             ("t" or a space also separate the date)
+   2013-03-02T18:30:05.123456-08:00 (any number of fraction digits, "." or ",")
+   2013-03-02 18:30:05+0100         (offset as +hh:mm, +hhmm or +hh)
+ 
+ Fields are range checked, including days per month and leap years. A leap
+ second (:60) is accepted and lands on the first second of the next minute.
+ The formatter writes RFC 3339 with 0 to 9 fraction digits (rounded) and either
+ "Z" or a numeric offset, for years 0000 to 9999.
+ 
+ */
+
+#ifndef LBTimestamp_h
+#define LBTimestamp_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+double LBTimestampSecondsFromMillis(int64_t millis);
+int64_t LBTimestampMillisFromSeconds(double seconds);
+
+void LBTimestampSecondsFromMillisBulk(const int64_t *millis, double *seconds, size_t count);
+void LBTimestampMillisFromSecondsBulk(const double *seconds, int64_t *millis, size_t count);
+
+// parses an ISO 8601 timestamp filling the whole of input (no NUL needed) into
+// seconds since 1970. returns false if it's not a valid timestamp.
+bool LBTimestampParseISO8601(const char *input, size_t length, double *seconds);
+
+// parses count timestamps, e.g. pointers into one response buffer. invalid
+// ones come out as NaN. returns the number that parsed.
+size_t LBTimestampParseISO8601Bulk(const char * const *inputs, const size_t *lengths, double *seconds, size_t count);
+
+// formats seconds since 1970 at the given offset from UTC in minutes (0 writes
+// "Z"). output needs LBTimestampISO8601MaxLength chars, no NUL is written.
+// returns the number of chars written, or 0 if the time is out of range.
+#define LBTimestampISO8601MaxLength 35
+size_t LBTimestampFormatISO8601(double seconds, int fractionDigits, int offsetMinutes, char *output);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,263 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#include "LBTimingWheel.h"
+
+#define SLOT_MASK ((uint64_t)(LB_TIMING_WHEEL_SLOTS - 1))
+#define LEVEL_SHIFT(level) ((level) * LB_TIMING_WHEEL_SLOT_BITS)
+#define LEVEL_SPAN(level) ((uint64_t)1 << LEVEL_SHIFT(level))
+#define MAX_DELTA (LEVEL_SPAN(LB_TIMING_WHEEL_LEVELS) - 1)
+
+// marks an entry sitting on the private "expiring" list during an advance, so
+// that cancelling it doesn't touch the occupancy bitmaps.
+#define EXPIRING_LEVEL 0xFF
+
+static void listInit(LBTimingWheelEntry *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static bool listIsEmpty(const LBTimingWheelEntry *head) {
+    return head->next == head;
+}
+
+static void listAppend(LBTimingWheelEntry *head, LBTimingWheelEntry *entry) {
+    entry->prev = head->prev;
+    entry->next = head;
+    head->prev->next = entry;
+    head->prev = entry;
+}
+
+static void listUnlink(LBTimingWheelEntry *entry) {
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->next = NULL;
+    entry->prev = NULL;
+}
+
+// moves every entry from one list head to another (which must be empty).
+static void listTake(LBTimingWheelEntry *to, LBTimingWheelEntry *from) {
+    if (listIsEmpty(from)) {
+        listInit(to);
+        return;
+    }
+    to->next = from->next;
+    to->prev = from->prev;
+    to->next->prev = to;
+    to->prev->next = to;
+    listInit(from);
+}
+
+void LBTimingWheelInit(LBTimingWheel *wheel, uint64_t startTick) {
+    wheel->currentTick = startTick;
+    wheel->count = 0;
+    for (int level = 0; level < LB_TIMING_WHEEL_LEVELS; level++) {
+        wheel->occupied[level] = 0;
+        for (int slot = 0; slot < LB_TIMING_WHEEL_SLOTS; slot++) {
+            listInit(&wheel->slots[level][slot]);
+        }
+    }
+}
+
+void LBTimingWheelEntryInit(LBTimingWheelEntry *entry, void *context) {
+    entry->next = NULL;
+    entry->prev = NULL;
+    entry->expires = 0;
+    entry->level = 0;
+    entry->slot = 0;
+    entry->context = context;
+}
+
+bool LBTimingWheelEntryIsScheduled(const LBTimingWheelEntry *entry) {
+    return entry->next != NULL;
+}
+
+size_t LBTimingWheelCount(const LBTimingWheel *wheel) {
+    return wheel->count;
+}
+
+// files an already-unlinked entry into the slot matching its expiry.
+static void place(LBTimingWheel *wheel, LBTimingWheelEntry *entry) {
+    uint64_t current = wheel->currentTick;
+    uint64_t expires = entry->expires;
+    // anything already due goes in the current tick's slot, a delay of 0
+    if (expires < current) expires = current;
+    uint64_t delta = expires - current;
+    if (delta > MAX_DELTA) {
+        // too far out to represent. park it in the top level at the furthest
+        // reachable slot, it'll be re-filed each time that slot cascades.
+        expires = current + MAX_DELTA;
+        delta = MAX_DELTA;
+    }
+    int level = 0;
+    while (level < LB_TIMING_WHEEL_LEVELS - 1 && delta >= LEVEL_SPAN(level + 1)) {
+        level++;
+    }
+    int slot = (int)((expires >> LEVEL_SHIFT(level)) & SLOT_MASK);
+    entry->level = (uint8_t)level;
+    entry->slot = (uint8_t)slot;
+    listAppend(&wheel->slots[level][slot], entry);
+    wheel->occupied[level] |= ((uint64_t)1 << slot);
+}
+
+static void unplace(LBTimingWheel *wheel, LBTimingWheelEntry *entry) {
+    int level = entry->level;
+    int slot = entry->slot;
+    listUnlink(entry);
+    if (level != EXPIRING_LEVEL && listIsEmpty(&wheel->slots[level][slot])) {
+        wheel->occupied[level] &= ~((uint64_t)1 << slot);
+    }
+}
+
+void LBTimingWheelSchedule(LBTimingWheel *wheel, LBTimingWheelEntry *entry, uint64_t expiresTick) {
+    if (LBTimingWheelEntryIsScheduled(entry)) {
+        unplace(wheel, entry);
+    } else {
+        wheel->count++;
+    }
+    entry->expires = expiresTick;
+    place(wheel, entry);
+}
+
+void LBTimingWheelCancel(LBTimingWheel *wheel, LBTimingWheelEntry *entry) {
+    if (!LBTimingWheelEntryIsScheduled(entry)) return;
+    unplace(wheel, entry);
+    wheel->count--;
+}
+
+// re-files every entry of one slot of a higher level, returns the slot index.
+static int cascade(LBTimingWheel *wheel, int level) {
+    int slot = (int)((wheel->currentTick >> LEVEL_SHIFT(level)) & SLOT_MASK);
+    LBTimingWheelEntry pending;
+    listTake(&pending, &wheel->slots[level][slot]);
+    wheel->occupied[level] &= ~((uint64_t)1 << slot);
+    while (!listIsEmpty(&pending)) {
+        LBTimingWheelEntry *entry = pending.next;
+        listUnlink(entry);
+        place(wheel, entry);
+    }
+    return slot;
+}
+
+// expires everything on a list taken off the wheel, returns how many.
+static size_t expireAll(LBTimingWheel *wheel, LBTimingWheelEntry *expiring, LBTimingWheelExpiredFunction expired, void *context) {
+    size_t expiredCount = 0;
+    for (LBTimingWheelEntry *entry = expiring->next; entry != expiring; entry = entry->next) {
+        entry->level = EXPIRING_LEVEL;
+    }
+    // unlink one at a time, so a callback may cancel or reschedule any
+    // entry, including ones still waiting on this list.
+    while (!listIsEmpty(expiring)) {
+        LBTimingWheelEntry *entry = expiring->next;
+        listUnlink(entry);
+        wheel->count--;
+        expiredCount++;
+        if (expired) expired(entry, context);
+    }
+    return expiredCount;
+}
+
+// for a clock that reads behind the wheel (nowTick < currentTick, e.g. the
+// same reading twice): entries scheduled in the past were filed in the current
+// tick's slot, so expire the ones there that are due by nowTick instead of
+// leaving them until the clock catches up.
+static size_t expireOverdue(LBTimingWheel *wheel, uint64_t nowTick, LBTimingWheelExpiredFunction expired, void *context) {
+    int index = (int)(wheel->currentTick & SLOT_MASK);
+    LBTimingWheelEntry *head = &wheel->slots[0][index];
+    LBTimingWheelEntry expiring;
+    listInit(&expiring);
+    for (LBTimingWheelEntry *entry = head->next; entry != head; ) {
+        LBTimingWheelEntry *next = entry->next;
+        if (entry->expires <= nowTick) {
+            listUnlink(entry);
+            listAppend(&expiring, entry);
+        }
+        entry = next;
+    }
+    if (listIsEmpty(head)) wheel->occupied[0] &= ~((uint64_t)1 << index);
+    return expireAll(wheel, &expiring, expired, context);
+}
+
+size_t LBTimingWheelAdvance(LBTimingWheel *wheel, uint64_t nowTick, LBTimingWheelExpiredFunction expired, void *context) {
+    if (nowTick < wheel->currentTick) {
+        return (wheel->occupied[0] ? expireOverdue(wheel, nowTick, expired, context) : 0);
+    }
+    size_t expiredCount = 0;
+    while (wheel->currentTick <= nowTick) {
+        // skip runs of ticks that would only visit empty slots, so a long
+        // sleep costs nothing per elapsed tick.
+        uint64_t nextTick;
+        if (!LBTimingWheelNextExpiry(wheel, &nextTick) || nextTick > nowTick) {
+            wheel->currentTick = nowTick + 1;
+            break;
+        }
+        wheel->currentTick = nextTick;
+        int index = (int)(wheel->currentTick & SLOT_MASK);
+        if (index == 0) {
+            // at each wrap of a level, pull the next slot of the level above
+            // down, and so on up while those wrap too.
+            for (int level = 1; level < LB_TIMING_WHEEL_LEVELS; level++) {
+                if (cascade(wheel, level) != 0) break;
+            }
+        }
+        LBTimingWheelEntry expiring;
+        listTake(&expiring, &wheel->slots[0][index]);
+        wheel->occupied[0] &= ~((uint64_t)1 << index);
+        wheel->currentTick++;
+        expiredCount += expireAll(wheel, &expiring, expired, context);
+    }
+    return expiredCount;
+}
+
+static uint64_t rotateRight(uint64_t bits, int by) {
+    by &= 63;
+    if (by == 0) return bits;
+    return (bits >> by) | (bits << (64 - by));
+}
+
+static int lowestSetBit(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(bits);
+#else
+    int index = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+bool LBTimingWheelNextExpiry(const LBTimingWheel *wheel, uint64_t *tick) {
+    if (wheel->count == 0) return false;
+    uint64_t best = UINT64_MAX;
+    for (int level = 0; level < LB_TIMING_WHEEL_LEVELS; level++) {
+        if (!wheel->occupied[level]) continue;
+        // the first tick at or after the current one at which this level's
+        // slots are visited. level 0 is visited every tick, higher levels only
+        // when all the levels below wrap around.
+        uint64_t span = LEVEL_SPAN(level);
+        uint64_t base = (wheel->currentTick + span - 1) & ~(span - 1);
+        int baseSlot = (int)((base >> LEVEL_SHIFT(level)) & SLOT_MASK);
+        int offset = lowestSetBit(rotateRight(wheel->occupied[level], baseSlot));
+        uint64_t candidate = base + (uint64_t)offset * span;
+        if (candidate < best) best = candidate;
+    }
+    *tick = best;
+    return true;
+}
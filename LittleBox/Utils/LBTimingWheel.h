@@ -0,0 +1,118 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ A hierarchical timing wheel: the data structure behind LBTimer's shared
+ "wheel" backend (see LBTimer.h). It's plain C with no dependencies, so it can
+ be built and exercised anywhere.
+ 
+ Time is measured in abstract integer ticks. The wheel has four levels of 64
+ slots each. Level 0 holds entries due within the next 64 ticks, one slot per
+ tick; level 1 holds entries due within 64^2 ticks, one slot per 64 ticks; and
+ so on. As time advances, the slots of the higher levels are "cascaded" down
+ into the lower ones. Entries further out than 64^4 ticks wait in the top level
+ and are re-filed until they come within range. This gives O(1) schedule and
+ cancel regardless of how many entries are pending, and advancing costs O(1)
+ per tick plus the (amortized, at most three times per entry) cascades.
+ 
+ Entries are intrusive: the caller embeds an LBTimingWheelEntry in its own
+ storage, so the wheel never allocates. An entry must stay at a fixed address
+ while scheduled. The wheel is not thread-safe; callers supply locking.
+ 
+ Typical use:
+ 
+   LBTimingWheelInit(&wheel, nowTick);
+   LBTimingWheelSchedule(&wheel, &myThing->entry, nowTick + 250);
+   ...
+   uint64_t wakeTick;
+   if (LBTimingWheelNextExpiry(&wheel, &wakeTick)) { sleep until wakeTick }
+   LBTimingWheelAdvance(&wheel, nowTick, myExpiredCallback, myContext);
+ 
+ */
+
+#ifndef LBTimingWheel_h
+#define LBTimingWheel_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LB_TIMING_WHEEL_LEVELS 4
+#define LB_TIMING_WHEEL_SLOT_BITS 6
+#define LB_TIMING_WHEEL_SLOTS (1 << LB_TIMING_WHEEL_SLOT_BITS)
+
+typedef struct LBTimingWheelEntry LBTimingWheelEntry;
+
+struct LBTimingWheelEntry {
+    // list linkage and bookkeeping, owned by the wheel
+    LBTimingWheelEntry *next;
+    LBTimingWheelEntry *prev;
+    uint64_t expires;
+    uint8_t level;
+    uint8_t slot;
+    // for the caller, untouched by the wheel
+    void *context;
+};
+
+typedef struct {
+    uint64_t currentTick; // the next tick that LBTimingWheelAdvance will process
+    uint64_t occupied[LB_TIMING_WHEEL_LEVELS]; // one bit per non-empty slot
+    size_t count;
+    LBTimingWheelEntry slots[LB_TIMING_WHEEL_LEVELS][LB_TIMING_WHEEL_SLOTS]; // list heads
+} LBTimingWheel;
+
+// called for each expired entry. the entry has already been removed from the
+// wheel, so the callback may reschedule it (or anything else).
+typedef void (*LBTimingWheelExpiredFunction)(LBTimingWheelEntry *entry, void *context);
+
+void LBTimingWheelInit(LBTimingWheel *wheel, uint64_t startTick);
+
+// zero an entry before its first use.
+void LBTimingWheelEntryInit(LBTimingWheelEntry *entry, void *context);
+bool LBTimingWheelEntryIsScheduled(const LBTimingWheelEntry *entry);
+
+// schedules (or reschedules) an entry. entries due at or before the current
+// tick fire on the next advance whose nowTick they're due by, even one that's
+// behind the ticks already advanced through.
+void LBTimingWheelSchedule(LBTimingWheel *wheel, LBTimingWheelEntry *entry, uint64_t expiresTick);
+
+// removes an entry if it is scheduled, otherwise does nothing.
+void LBTimingWheelCancel(LBTimingWheel *wheel, LBTimingWheelEntry *entry);
+
+// processes every tick up to and including nowTick, calling expired() for each
+// entry that comes due, in tick order. a nowTick already advanced through
+// still expires anything scheduled since that is due by then. returns the
+// number of expired entries.
+size_t LBTimingWheelAdvance(LBTimingWheel *wheel, uint64_t nowTick, LBTimingWheelExpiredFunction expired, void *context);
+
+// the earliest tick at which an advance can expire anything (or needs to
+// cascade a slot that holds the next entries due). false if the wheel is empty.
+bool LBTimingWheelNextExpiry(const LBTimingWheel *wheel, uint64_t *tick);
+
+size_t LBTimingWheelCount(const LBTimingWheel *wheel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
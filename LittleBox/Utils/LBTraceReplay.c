@@ -0,0 +1,527 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#include "LBTraceReplay.h"
+#include "LBGeoRegionIndex.h"
+#include "LBTimestamp.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LB_TRACE_MAX_FIELDS 16
+
+#pragma mark - scanning
+
+static const char *findBytes(const char *bytes, size_t length, const char *needle, size_t needleLength) {
+    if (needleLength > length) return NULL;
+    const char *end = bytes + length - needleLength + 1;
+    for (const char *p = bytes; p < end; p++) {
+        p = memchr(p, needle[0], end - p);
+        if (!p) return NULL;
+        if (memcmp(p, needle, needleLength) == 0) return p;
+    }
+    return NULL;
+}
+
+static inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static void trim(const char **start, size_t *length) {
+    while (*length && (isSpace(**start) || **start == '"')) { (*start)++; (*length)--; }
+    while (*length && (isSpace((*start)[*length - 1]) || (*start)[*length - 1] == '"')) (*length)--;
+}
+
+// strtod needs a terminated string, and the mapped bytes aren't one
+static bool parseNumber(const char *start, size_t length, double *value) {
+    trim(&start, &length);
+    char buffer[64];
+    if (!length || length >= sizeof(buffer)) return false;
+    memcpy(buffer, start, length);
+    buffer[length] = 0;
+    char *end;
+    *value = strtod(buffer, &end);
+    return end == buffer + length && isfinite(*value);
+}
+
+static bool parseTime(const char *start, size_t length, double *seconds) {
+    trim(&start, &length);
+    if (parseNumber(start, length, seconds)) {
+        // epoch milliseconds, as our APIs send them, are too big to be seconds
+        if (fabs(*seconds) > 1e11) *seconds /= 1000.0;
+        return true;
+    }
+    return LBTimestampParseISO8601(start, length, seconds);
+}
+
+static bool validPoint(const LBTracePoint *point) {
+    return point->latitude >= -90.0 && point->latitude <= 90.0 && point->longitude >= -180.0 && point->longitude <= 180.0;
+}
+
+#pragma mark - gpx
+
+// the value of a name="value" attribute inside a tag
+static bool gpxAttribute(const char *tag, size_t length, const char *name, const char **value, size_t *valueLength) {
+    size_t nameLength = strlen(name);
+    const char *end = tag + length;
+    const char *p = tag;
+    while ((p = findBytes(p, end - p, name, nameLength))) {
+        const char *q = p + nameLength;
+        bool standalone = p > tag && isSpace(p[-1]);
+        p = q;
+        if (!standalone) continue;
+        while (q < end && isSpace(*q)) q++;
+        if (q == end || *q != '=') continue;
+        q++;
+        while (q < end && isSpace(*q)) q++;
+        if (q == end || (*q != '"' && *q != '\'')) continue;
+        const char *close = memchr(q + 1, *q, end - q - 1);
+        if (!close) return false;
+        *value = q + 1;
+        *valueLength = close - q - 1;
+        return true;
+    }
+    return false;
+}
+
+// the text of the first <name>...</name> child in a point's body
+static bool gpxChild(const char *body, size_t length, const char *name, const char **value, size_t *valueLength) {
+    char open[32], close[32];
+    int openLength = snprintf(open, sizeof(open), "<%s>", name);
+    int closeLength = snprintf(close, sizeof(close), "</%s>", name);
+    const char *start = findBytes(body, length, open, openLength);
+    if (!start) return false;
+    start += openLength;
+    const char *end = findBytes(start, body + length - start, close, closeLength);
+    if (!end) return false;
+    *value = start;
+    *valueLength = end - start;
+    return true;
+}
+
+static bool gpxNext(LBTraceReader *reader, LBTracePoint *point) {
+    const char *bytes = reader->bytes;
+    const char *end = bytes + reader->length;
+    const char *p = bytes + reader->position;
+    while ((p = memchr(p, '<', end - p))) {
+        if (end - p < 7 || (memcmp(p + 1, "trkpt", 5) != 0 && memcmp(p + 1, "rtept", 5) != 0) ||
+            !(isSpace(p[6]) || p[6] == '>' || p[6] == '/')) {
+            p++;
+            continue;
+        }
+        const char *tagEnd = memchr(p, '>', end - p);
+        if (!tagEnd) break;
+        const char *body = tagEnd + 1;
+        const char *bodyEnd = body;
+        const char *next = body;
+        if (tagEnd[-1] != '/') {
+            char close[] = "</trkpt>";
+            memcpy(close + 2, p + 1, 5);
+            bodyEnd = findBytes(body, end - body, close, 8);
+            if (!bodyEnd) bodyEnd = end;
+            next = bodyEnd == end ? end : bodyEnd + 8;
+        }
+        reader->position = next - bytes;
+        const char *value;
+        size_t valueLength;
+        LBTracePoint candidate = { NAN, NAN, NAN, NAN, -1.0, -1.0 };
+        if (!gpxAttribute(p, tagEnd - p, "lat", &value, &valueLength) || !parseNumber(value, valueLength, &candidate.latitude) ||
+            !gpxAttribute(p, tagEnd - p, "lon", &value, &valueLength) || !parseNumber(value, valueLength, &candidate.longitude) ||
+            !gpxChild(body, bodyEnd - body, "time", &value, &valueLength) || !parseTime(value, valueLength, &candidate.timestamp) ||
+            !validPoint(&candidate) || candidate.timestamp < reader->lastTimestamp) {
+            p = next;
+            continue;
+        }
+        double number;
+        if (gpxChild(body, bodyEnd - body, "ele", &value, &valueLength) && parseNumber(value, valueLength, &number)) candidate.altitude = number;
+        if (gpxChild(body, bodyEnd - body, "speed", &value, &valueLength) && parseNumber(value, valueLength, &number) && number >= 0) candidate.speed = number;
+        if (gpxChild(body, bodyEnd - body, "course", &value, &valueLength) && parseNumber(value, valueLength, &number) && number >= 0) candidate.course = fmod(number, 360.0);
+        reader->lastTimestamp = candidate.timestamp;
+        *point = candidate;
+        return true;
+    }
+    reader->position = reader->length;
+    return false;
+}
+
+#pragma mark - csv
+
+static bool csvColumnNamed(const char *field, size_t length, const char * const *names) {
+    trim(&field, &length);
+    for (; *names; names++) {
+        if (strlen(*names) == length && strncasecmp(field, *names, length) == 0) return true;
+    }
+    return false;
+}
+
+static bool csvReadHeader(LBTraceReader *reader, const char **fields, const size_t *lengths, size_t count) {
+    static const char * const timeNames[] = { "time", "timestamp", "date", NULL };
+    static const char * const latitudeNames[] = { "lat", "latitude", NULL };
+    static const char * const longitudeNames[] = { "lon", "lng", "long", "longitude", NULL };
+    static const char * const altitudeNames[] = { "ele", "elevation", "alt", "altitude", NULL };
+    static const char * const speedNames[] = { "speed", NULL };
+    static const char * const courseNames[] = { "course", "bearing", "heading", NULL };
+    int timeColumn = -1, latitudeColumn = -1, longitudeColumn = -1, altitudeColumn = -1, speedColumn = -1, courseColumn = -1;
+    for (size_t i = 0; i < count; i++) {
+        if (csvColumnNamed(fields[i], lengths[i], timeNames)) timeColumn = (int)i;
+        else if (csvColumnNamed(fields[i], lengths[i], latitudeNames)) latitudeColumn = (int)i;
+        else if (csvColumnNamed(fields[i], lengths[i], longitudeNames)) longitudeColumn = (int)i;
+        else if (csvColumnNamed(fields[i], lengths[i], altitudeNames)) altitudeColumn = (int)i;
+        else if (csvColumnNamed(fields[i], lengths[i], speedNames)) speedColumn = (int)i;
+        else if (csvColumnNamed(fields[i], lengths[i], courseNames)) courseColumn = (int)i;
+    }
+    if (timeColumn < 0 || latitudeColumn < 0 || longitudeColumn < 0) return false;
+    reader->timeColumn = timeColumn;
+    reader->latitudeColumn = latitudeColumn;
+    reader->longitudeColumn = longitudeColumn;
+    reader->altitudeColumn = altitudeColumn;
+    reader->speedColumn = speedColumn;
+    reader->courseColumn = courseColumn;
+    return true;
+}
+
+static bool csvOptional(const char **fields, const size_t *lengths, size_t count, int column, double *value) {
+    return column >= 0 && (size_t)column < count && parseNumber(fields[column], lengths[column], value);
+}
+
+static bool csvNext(LBTraceReader *reader, LBTracePoint *point) {
+    const char *bytes = reader->bytes;
+    while (reader->position < reader->length) {
+        const char *line = bytes + reader->position;
+        const char *newline = memchr(line, '\n', reader->length - reader->position);
+        size_t lineLength = newline ? (size_t)(newline - line) : reader->length - reader->position;
+        reader->position += lineLength + (newline ? 1 : 0);
+        const char *trimmed = line;
+        size_t trimmedLength = lineLength;
+        trim(&trimmed, &trimmedLength);
+        if (!trimmedLength || *trimmed == '#') continue;
+        const char *fields[LB_TRACE_MAX_FIELDS];
+        size_t lengths[LB_TRACE_MAX_FIELDS];
+        size_t count = 0;
+        const char *field = line;
+        const char *lineEnd = line + lineLength;
+        while (count < LB_TRACE_MAX_FIELDS) {
+            const char *comma = memchr(field, ',', lineEnd - field);
+            fields[count] = field;
+            lengths[count++] = (comma ? comma : lineEnd) - field;
+            if (!comma) break;
+            field = comma + 1;
+        }
+        bool firstLine = !reader->sawHeader;
+        reader->sawHeader = true;
+        LBTracePoint candidate = { NAN, NAN, NAN, NAN, -1.0, -1.0 };
+        if ((size_t)reader->timeColumn >= count || (size_t)reader->latitudeColumn >= count || (size_t)reader->longitudeColumn >= count ||
+            !parseTime(fields[reader->timeColumn], lengths[reader->timeColumn], &candidate.timestamp) ||
+            !parseNumber(fields[reader->latitudeColumn], lengths[reader->latitudeColumn], &candidate.latitude) ||
+            !parseNumber(fields[reader->longitudeColumn], lengths[reader->longitudeColumn], &candidate.longitude) ||
+            !validPoint(&candidate) || candidate.timestamp < reader->lastTimestamp) {
+            // the first line that isn't a point may name the columns
+            if (firstLine) csvReadHeader(reader, fields, lengths, count);
+            continue;
+        }
+        double number;
+        if (csvOptional(fields, lengths, count, reader->altitudeColumn, &number)) candidate.altitude = number;
+        if (csvOptional(fields, lengths, count, reader->speedColumn, &number) && number >= 0) candidate.speed = number;
+        if (csvOptional(fields, lengths, count, reader->courseColumn, &number) && number >= 0) candidate.course = fmod(number, 360.0);
+        reader->lastTimestamp = candidate.timestamp;
+        *point = candidate;
+        return true;
+    }
+    return false;
+}
+
+#pragma mark - reader
+
+bool LBTraceReaderInitWithBytes(LBTraceReader *reader, const char *bytes, size_t length) {
+    memset(reader, 0, sizeof(*reader));
+    reader->bytes = bytes;
+    reader->length = length;
+    LBTraceReaderRewind(reader);
+    size_t i = 0;
+    if (length >= 3 && memcmp(bytes, "\xEF\xBB\xBF", 3) == 0) i = 3;
+    while (i < length && isSpace(bytes[i])) i++;
+    if (i == length) {
+        errno = EINVAL;
+        return false;
+    }
+    reader->format = bytes[i] == '<' ? LBTraceFormatGPX : LBTraceFormatCSV;
+    return true;
+}
+
+bool LBTraceReaderOpenFile(LBTraceReader *reader, const char *path) {
+    memset(reader, 0, sizeof(*reader));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return false;
+    }
+    if (info.st_size <= 0) {
+        close(fd);
+        errno = EINVAL;
+        return false;
+    }
+    size_t length = (size_t)info.st_size;
+    void *mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        errno = error;
+        return false;
+    }
+    // it's read front to back once
+    posix_madvise(mapping, length, POSIX_MADV_SEQUENTIAL);
+    if (!LBTraceReaderInitWithBytes(reader, mapping, length)) {
+        munmap(mapping, length);
+        return false;
+    }
+    reader->mapping = mapping;
+    reader->mappingLength = length;
+    return true;
+}
+
+void LBTraceReaderClose(LBTraceReader *reader) {
+    if (reader->mapping) munmap(reader->mapping, reader->mappingLength);
+    memset(reader, 0, sizeof(*reader));
+}
+
+void LBTraceReaderRewind(LBTraceReader *reader) {
+    reader->position = 0;
+    reader->sawHeader = false;
+    reader->lastTimestamp = -INFINITY;
+    reader->timeColumn = 0;
+    reader->latitudeColumn = 1;
+    reader->longitudeColumn = 2;
+    reader->altitudeColumn = 3;
+    reader->speedColumn = -1;
+    reader->courseColumn = -1;
+}
+
+bool LBTraceReaderNext(LBTraceReader *reader, LBTracePoint *point) {
+    switch (reader->format) {
+        case LBTraceFormatGPX: return gpxNext(reader, point);
+        case LBTraceFormatCSV: return csvNext(reader, point);
+        default: return false;
+    }
+}
+
+#pragma mark - replay
+
+void LBTraceReplayInit(LBTraceReplay *replay, LBTraceReader *reader, double speed) {
+    memset(replay, 0, sizeof(*replay));
+    replay->reader = reader;
+    replay->speed = speed > 0 ? speed : 1.0;
+    replay->sampleInterval = LBTraceReplayDefaultSampleInterval;
+}
+
+void LBTraceReplayDestroy(LBTraceReplay *replay) {
+    free(replay->deferred);
+    memset(replay, 0, sizeof(*replay));
+}
+
+bool LBTraceReplayStart(LBTraceReplay *replay, double now) {
+    if (!LBTraceReaderNext(replay->reader, &replay->before)) {
+        replay->finished = true;
+        return false;
+    }
+    replay->hasAfter = LBTraceReaderNext(replay->reader, &replay->after);
+    replay->started = true;
+    replay->finished = false;
+    replay->clockStart = now;
+    replay->traceStart = replay->before.timestamp;
+    replay->sampleTime = replay->traceStart;
+    replay->hasDelivered = false;
+    if (replay->deferring) replay->deferStart = replay->traceStart;
+    return true;
+}
+
+double LBTraceReplayTraceTime(const LBTraceReplay *replay, double now) {
+    if (!replay->started) return 0.0;
+    return replay->traceStart + (now - replay->clockStart) * replay->speed;
+}
+
+void LBTraceReplaySetSpeed(LBTraceReplay *replay, double speed, double now) {
+    if (speed <= 0) return;
+    if (replay->started) {
+        replay->traceStart = LBTraceReplayTraceTime(replay, now);
+        replay->clockStart = now;
+    }
+    replay->speed = speed;
+}
+
+bool LBTraceReplayFinished(const LBTraceReplay *replay) {
+    return replay->finished;
+}
+
+static double bearing(const LBTracePoint *from, const LBTracePoint *to) {
+    double latitude1 = from->latitude * M_PI / 180.0;
+    double latitude2 = to->latitude * M_PI / 180.0;
+    double longitudeDelta = (to->longitude - from->longitude) * M_PI / 180.0;
+    double y = sin(longitudeDelta) * cos(latitude2);
+    double x = cos(latitude1) * sin(latitude2) - sin(latitude1) * cos(latitude2) * cos(longitudeDelta);
+    return fmod(atan2(y, x) * 180.0 / M_PI + 360.0, 360.0);
+}
+
+// the fix at trace time t, between the recorded points before and after it.
+// straight lines in degrees are close enough over the distance between fixes.
+static LBTracePoint interpolate(const LBTracePoint *before, const LBTracePoint *after, double t) {
+    double duration = after->timestamp - before->timestamp;
+    double f = duration > 0 ? (t - before->timestamp) / duration : 1.0;
+    if (f < 0) f = 0;
+    if (f > 1) f = 1;
+    double longitudeDelta = after->longitude - before->longitude;
+    if (longitudeDelta > 180.0) longitudeDelta -= 360.0;
+    if (longitudeDelta < -180.0) longitudeDelta += 360.0;
+    LBTracePoint fix;
+    fix.timestamp = t;
+    fix.latitude = before->latitude + f * (after->latitude - before->latitude);
+    fix.longitude = before->longitude + f * longitudeDelta;
+    if (fix.longitude > 180.0) fix.longitude -= 360.0;
+    if (fix.longitude < -180.0) fix.longitude += 360.0;
+    fix.altitude = before->altitude + f * (after->altitude - before->altitude); // NAN if either is
+    double distance = LBGeoDistance(before->latitude, before->longitude, after->latitude, after->longitude);
+    if (before->speed >= 0 && after->speed >= 0) {
+        fix.speed = before->speed + f * (after->speed - before->speed);
+    } else {
+        fix.speed = duration > 0 ? distance / duration : -1.0;
+    }
+    if (before->course >= 0 && after->course >= 0) {
+        double turn = fmod(after->course - before->course + 540.0, 360.0) - 180.0;
+        fix.course = fmod(before->course + f * turn + 360.0, 360.0);
+    } else {
+        fix.course = distance > 0 ? bearing(before, after) : before->course;
+    }
+    return fix;
+}
+
+static void flushBatch(LBTraceReplay *replay, LBTraceReplayDeliverFunction deliver, void *context) {
+    if (!replay->batchCount) return;
+    deliver(replay->batch, replay->batchCount, false, context);
+    replay->batchCount = 0;
+}
+
+static void finishDeferring(LBTraceReplay *replay, LBTraceReplayDeliverFunction deliver, void *context) {
+    flushBatch(replay, deliver, context);
+    replay->deferring = false;
+    deliver(replay->deferred, replay->deferredCount, true, context);
+    replay->deferredCount = 0;
+}
+
+static bool deferFix(LBTraceReplay *replay, const LBTracePoint *fix) {
+    if (replay->deferredCount == replay->deferredCapacity) {
+        size_t capacity = replay->deferredCapacity ? replay->deferredCapacity * 2 : 64;
+        LBTracePoint *deferred = realloc(replay->deferred, capacity * sizeof(LBTracePoint));
+        if (!deferred) return false;
+        replay->deferred = deferred;
+        replay->deferredCapacity = capacity;
+    }
+    replay->deferred[replay->deferredCount++] = *fix;
+    return true;
+}
+
+// filters one fix, then holds it back or batches it
+static size_t takeFix(LBTraceReplay *replay, const LBTracePoint *fix, LBTraceReplayDeliverFunction deliver, void *context) {
+    size_t delivered = 0;
+    bool keep = !replay->hasDelivered || replay->distanceFilter <= 0 ||
+        LBGeoDistance(replay->lastDelivered.latitude, replay->lastDelivered.longitude, fix->latitude, fix->longitude) >= replay->distanceFilter;
+    if (replay->deferring) {
+        // distance traveled counts every fix, filtered or not
+        if (replay->hasDeferLast) {
+            replay->deferTraveled += LBGeoDistance(replay->deferLast.latitude, replay->deferLast.longitude, fix->latitude, fix->longitude);
+        }
+        replay->deferLast = *fix;
+        replay->hasDeferLast = true;
+        if (keep && !deferFix(replay, fix)) {
+            // out of memory, so stop holding fixes back
+            delivered += replay->deferredCount;
+            finishDeferring(replay, deliver, context);
+        }
+    }
+    if (keep) {
+        replay->lastDelivered = *fix;
+        replay->hasDelivered = true;
+        if (!replay->deferring) {
+            replay->batch[replay->batchCount++] = *fix;
+            delivered++;
+            if (replay->batchCount == LB_TRACE_REPLAY_MAX_BATCH) flushBatch(replay, deliver, context);
+        }
+    }
+    if (replay->deferring && (replay->deferTraveled >= replay->deferDistance || fix->timestamp - replay->deferStart >= replay->deferTimeout)) {
+        delivered += replay->deferredCount;
+        finishDeferring(replay, deliver, context);
+    }
+    return delivered;
+}
+
+size_t LBTraceReplayAdvance(LBTraceReplay *replay, double now, LBTraceReplayDeliverFunction deliver, void *context) {
+    if (!replay->started || replay->finished) return 0;
+    double traceNow = LBTraceReplayTraceTime(replay, now);
+    size_t delivered = 0;
+    while (!replay->finished && replay->sampleTime <= traceNow) {
+        // move along the recorded points to the ones around the next fix
+        while (replay->hasAfter && replay->after.timestamp < replay->sampleTime) {
+            replay->before = replay->after;
+            replay->hasAfter = LBTraceReaderNext(replay->reader, &replay->after);
+        }
+        double interval = replay->sampleInterval > 0 ? replay->sampleInterval : LBTraceReplayDefaultSampleInterval;
+        LBTracePoint fix;
+        if (replay->hasAfter) {
+            fix = interpolate(&replay->before, &replay->after, replay->sampleTime);
+        } else {
+            // past the end, so the last fix is the last point, unless the one
+            // before was already there
+            replay->finished = true;
+            if (replay->before.timestamp <= replay->sampleTime - interval) break;
+            fix = replay->before;
+        }
+        replay->sampleTime += interval;
+        delivered += takeFix(replay, &fix, deliver, context);
+    }
+    flushBatch(replay, deliver, context);
+    if (replay->finished && replay->deferring) {
+        delivered += replay->deferredCount;
+        finishDeferring(replay, deliver, context);
+    }
+    return delivered;
+}
+
+void LBTraceReplayAllowDeferredUpdates(LBTraceReplay *replay, double distance, double timeout) {
+    replay->deferDistance = distance;
+    replay->deferTimeout = timeout;
+    if (replay->deferring) return;
+    replay->deferring = true;
+    replay->deferTraveled = 0;
+    replay->hasDeferLast = false;
+    // the timeout runs from the last fix
+    replay->deferStart = replay->started ? replay->sampleTime - replay->sampleInterval : 0.0;
+}
+
+void LBTraceReplayDisallowDeferredUpdates(LBTraceReplay *replay, LBTraceReplayDeliverFunction deliver, void *context) {
+    if (!replay->deferring) return;
+    finishDeferring(replay, deliver, context);
+}
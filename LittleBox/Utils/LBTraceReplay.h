@@ -0,0 +1,180 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ Replays a recorded GPS trace at many times real speed, behind
+ LBCLLocationManagerProxy's trace replay. It's plain C with an injected clock
+ and no CoreLocation dependency, so hours of a trace can be pushed through
+ location and region code in seconds, anywhere, e.g. in a headless soak test.
+ 
+ LBTraceReader streams points out of a trace in memory, or in a file it maps
+ read-only, without loading or copying the whole thing. Two formats are read,
+ told apart by the first non-blank character:
+ 
+   GPX: every <trkpt> and <rtept>, with lat and lon attributes and optional
+   <time>, <ele>, <speed> (m/s) and <course> children.
+ 
+   CSV: one point per line, comma separated. A header line names the columns
+   (time/timestamp/date, lat/latitude, lon/lng/long/longitude,
+   ele/elevation/alt/altitude, speed, course/bearing/heading, in any case and
+   order). Without one the columns are time, latitude, longitude, altitude.
+   Times are ISO 8601 (see LBTimestamp.h) or epoch seconds, or epoch
+   milliseconds if they're too big to be seconds. Blank lines and lines
+   starting with # are skipped.
+ 
+ Points without a time, with unparseable coordinates, or with a time before the
+ point read just before them are skipped, as they can't be replayed.
+ 
+ LBTraceReplay plays a reader's points against a clock the caller supplies:
+ trace time runs speed times as fast as the clock from the first point on. Each
+ LBTraceReplayAdvance() produces a fix for every sampleInterval of trace time
+ that has passed, like a receiver reporting once a second, placed on the trace
+ by interpolating between the recorded points around it. Fixes closer than
+ distanceFilter meters to the last one delivered are dropped, as
+ CLLocationManager does. The fixes are handed back in order, in batches.
+ 
+ Deferred updates work like CLLocationManager's: after
+ LBTraceReplayAllowDeferredUpdates(), fixes are held back until the trace has
+ covered the distance or the timeout (in trace time) has run out, then all come
+ back in one batch flagged as ending the deferral, and later fixes come back
+ as they happen again until the next call.
+ 
+ Neither is thread-safe. A typical soak test:
+ 
+   LBTraceReader reader;
+   LBTraceReplay replay;
+   if (!LBTraceReaderOpenFile(&reader, "commute.gpx")) return;
+   LBTraceReplayInit(&replay, &reader, 100.0);
+   double now = 0;
+   LBTraceReplayStart(&replay, now);
+   while (!LBTraceReplayFinished(&replay)) {
+       now += 0.1;
+       LBTraceReplayAdvance(&replay, now, myDeliverFunction, myContext);
+   }
+   LBTraceReplayDestroy(&replay);
+   LBTraceReaderClose(&reader);
+ 
+ */
+
+#ifndef LBTraceReplay_h
+#define LBTraceReplay_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LBTraceReplayDefaultSampleInterval 1.0
+#define LB_TRACE_REPLAY_MAX_BATCH 256
+
+typedef enum {
+    LBTraceFormatUnknown = 0,
+    LBTraceFormatGPX,
+    LBTraceFormatCSV,
+} LBTraceFormat;
+
+// unknown altitudes are NAN, unknown speeds and courses are negative, as in
+// CLLocation
+typedef struct {
+    double timestamp; // seconds since 1970
+    double latitude;
+    double longitude;
+    double altitude;
+    double speed;
+    double course;
+} LBTracePoint;
+
+typedef struct {
+    const char *bytes;
+    size_t length;
+    size_t position;
+    LBTraceFormat format;
+    void *mapping; // if opened from a file
+    size_t mappingLength;
+    // csv column numbers, -1 for none
+    int timeColumn, latitudeColumn, longitudeColumn, altitudeColumn, speedColumn, courseColumn;
+    bool sawHeader;
+    double lastTimestamp;
+} LBTraceReader;
+
+// maps the file read-only. returns false (with errno set) if it can't be
+// opened or mapped, or isn't GPX or CSV.
+bool LBTraceReaderOpenFile(LBTraceReader *reader, const char *path);
+// reads a trace already in memory, which must outlive the reader
+bool LBTraceReaderInitWithBytes(LBTraceReader *reader, const char *bytes, size_t length);
+void LBTraceReaderClose(LBTraceReader *reader);
+// the next replayable point, or false at the end
+bool LBTraceReaderNext(LBTraceReader *reader, LBTracePoint *point);
+void LBTraceReaderRewind(LBTraceReader *reader);
+
+// called with fixes in order. finishedDeferring is true for the batch that
+// ends a deferral (which may be empty).
+typedef void (*LBTraceReplayDeliverFunction)(const LBTracePoint *points, size_t count, bool finishedDeferring, void *context);
+
+typedef struct {
+    LBTraceReader *reader; // not owned
+    double speed; // trace seconds per clock second
+    double sampleInterval; // trace seconds between fixes
+    double distanceFilter; // meters, <= 0 for none
+    // the recorded points either side of the next fix
+    LBTracePoint before, after;
+    bool hasAfter;
+    bool started, finished;
+    double clockStart, traceStart; // where clock and trace times line up
+    double sampleTime; // trace time of the next fix
+    LBTracePoint lastDelivered;
+    bool hasDelivered;
+    // deferral
+    bool deferring;
+    double deferDistance, deferTimeout, deferStart, deferTraveled;
+    LBTracePoint deferLast;
+    bool hasDeferLast;
+    LBTracePoint *deferred;
+    size_t deferredCount, deferredCapacity;
+    LBTracePoint batch[LB_TRACE_REPLAY_MAX_BATCH];
+    size_t batchCount;
+} LBTraceReplay;
+
+void LBTraceReplayInit(LBTraceReplay *replay, LBTraceReader *reader, double speed);
+void LBTraceReplayDestroy(LBTraceReplay *replay);
+
+// reads the first point, which is trace time at clock time now. returns false
+// if the trace has no replayable points.
+bool LBTraceReplayStart(LBTraceReplay *replay, double now);
+// delivers every fix due by clock time now, and returns how many
+size_t LBTraceReplayAdvance(LBTraceReplay *replay, double now, LBTraceReplayDeliverFunction deliver, void *context);
+// changes speed from clock time now on, without jumping
+void LBTraceReplaySetSpeed(LBTraceReplay *replay, double speed, double now);
+double LBTraceReplayTraceTime(const LBTraceReplay *replay, double now);
+// true once the last point has been delivered (or filtered out)
+bool LBTraceReplayFinished(const LBTraceReplay *replay);
+
+// distance in meters, timeout in trace seconds
+void LBTraceReplayAllowDeferredUpdates(LBTraceReplay *replay, double distance, double timeout);
+// ends a deferral early, delivering whatever was held back
+void LBTraceReplayDisallowDeferredUpdates(LBTraceReplay *replay, LBTraceReplayDeliverFunction deliver, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
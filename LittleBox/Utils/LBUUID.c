@@ -0,0 +1,198 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#include "LBUUID.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#if defined(__APPLE__)
+#define LB_FILL_RANDOM(buffer, length) arc4random_buf(buffer, length)
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/random.h>
+#include <unistd.h>
+// for kernels (or sandboxes) without getrandom
+static void fillRandomFromDevice(uint8_t *bytes, size_t length) {
+    int fd;
+    do {
+        fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+    // like arc4random_buf, never hand back anything but random bytes
+    if (fd < 0) abort();
+    while (length) {
+        ssize_t got = read(fd, bytes, length);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) abort();
+        bytes += got;
+        length -= (size_t)got;
+    }
+    close(fd);
+}
+
+static void fillRandom(void *buffer, size_t length) {
+    uint8_t *bytes = buffer;
+    while (length) {
+        ssize_t got = getrandom(bytes, length, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            fillRandomFromDevice(bytes, length);
+            return;
+        }
+        bytes += got;
+        length -= (size_t)got;
+    }
+}
+#define LB_FILL_RANDOM(buffer, length) fillRandom(buffer, length)
+#endif
+
+#pragma mark - per-thread random buffer
+
+// enough for 16 ids per refill
+#define LB_RANDOM_BUFFER_SIZE 256
+
+typedef struct {
+    uint8_t bytes[LB_RANDOM_BUFFER_SIZE];
+    size_t used;
+    unsigned long generation;
+} LBRandomBuffer;
+
+static pthread_key_t _bufferKey;
+static pthread_once_t _bufferKeyOnce = PTHREAD_ONCE_INIT;
+// bumped in a forked child, so it doesn't hand out the same bytes as its parent
+static volatile unsigned long _forkGeneration = 0;
+
+static void forkChild(void) {
+    _forkGeneration++;
+}
+
+static void makeBufferKey(void) {
+    pthread_key_create(&_bufferKey, free);
+    pthread_atfork(NULL, NULL, forkChild);
+}
+
+static LBRandomBuffer *threadBuffer(void) {
+    pthread_once(&_bufferKeyOnce, makeBufferKey);
+    LBRandomBuffer *buffer = pthread_getspecific(_bufferKey);
+    if (!buffer) {
+        buffer = malloc(sizeof(LBRandomBuffer));
+        if (!buffer) return NULL;
+        buffer->used = LB_RANDOM_BUFFER_SIZE;
+        buffer->generation = _forkGeneration;
+        pthread_setspecific(_bufferKey, buffer);
+    }
+    if (buffer->generation != _forkGeneration) {
+        buffer->used = LB_RANDOM_BUFFER_SIZE;
+        buffer->generation = _forkGeneration;
+    }
+    return buffer;
+}
+
+void LBRandomBytes(void *output, size_t length) {
+    LBRandomBuffer *buffer = threadBuffer();
+    if (!buffer || length > LB_RANDOM_BUFFER_SIZE / 2) {
+        // big requests (or no buffer) go straight to the source
+        LB_FILL_RANDOM(output, length);
+        return;
+    }
+    uint8_t *out = output;
+    while (length) {
+        if (buffer->used == LB_RANDOM_BUFFER_SIZE) {
+            LB_FILL_RANDOM(buffer->bytes, LB_RANDOM_BUFFER_SIZE);
+            buffer->used = 0;
+        }
+        size_t take = LB_RANDOM_BUFFER_SIZE - buffer->used;
+        if (take > length) take = length;
+        memcpy(out, buffer->bytes + buffer->used, take);
+        // never hand out the same bytes twice
+        memset(buffer->bytes + buffer->used, 0, take);
+        buffer->used += take;
+        out += take;
+        length -= take;
+    }
+}
+
+#pragma mark - generation
+
+static void setVersion(uint8_t uuid[LB_UUID_LENGTH], uint8_t version) {
+    uuid[6] = (uint8_t)((uuid[6] & 0x0F) | (version << 4));
+    uuid[8] = (uint8_t)((uuid[8] & 0x3F) | 0x80); // RFC 4122 variant
+}
+
+void LBUUIDGenerateRandom(uint8_t uuid[LB_UUID_LENGTH]) {
+    LBRandomBytes(uuid, LB_UUID_LENGTH);
+    setVersion(uuid, 4);
+}
+
+static pthread_mutex_t _timeOrderedLock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t _lastMilliseconds = 0;
+static uint16_t _counter = 0;
+
+void LBUUIDGenerateTimeOrdered(uint8_t uuid[LB_UUID_LENGTH]) {
+    LBRandomBytes(uuid, LB_UUID_LENGTH);
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    uint64_t milliseconds = (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_usec / 1000;
+    // the 12 bits after the version are a counter, so ids from the same
+    // millisecond still increase. it starts from a random value with the top
+    // bit clear, leaving plenty of room to count up, and when it does run out
+    // we borrow from the next millisecond. the same happens if the clock steps
+    // back, so ids never go backwards.
+    pthread_mutex_lock(&_timeOrderedLock);
+    if (milliseconds > _lastMilliseconds) {
+        _lastMilliseconds = milliseconds;
+        _counter = (uint16_t)(((uuid[6] << 8) | uuid[7]) & 0x07FF);
+    } else if (++_counter > 0x0FFF) {
+        _lastMilliseconds++;
+        _counter = 0;
+    }
+    milliseconds = _lastMilliseconds;
+    uint16_t counter = _counter;
+    pthread_mutex_unlock(&_timeOrderedLock);
+    for (int i = 0; i < 6; i++) {
+        uuid[i] = (uint8_t)(milliseconds >> (40 - 8 * i));
+    }
+    uuid[6] = (uint8_t)(counter >> 8);
+    uuid[7] = (uint8_t)counter;
+    setVersion(uuid, 7);
+}
+
+#pragma mark - formatting
+
+// "00" "01" ... "FF"
+static const char kHexPairs[512] =
+    "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+void LBUUIDFormat(const uint8_t uuid[LB_UUID_LENGTH], char string[LB_UUID_STRING_LENGTH]) {
+    char *out = string;
+    for (int i = 0; i < LB_UUID_LENGTH; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) *out++ = '-';
+        memcpy(out, kHexPairs + uuid[i] * 2, 2);
+        out += 2;
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ Fast UUID generation, behind LBUtils generateGUID and friends.
+ 
+ Random bits come from a small per-thread buffer that is refilled in batches
+ from the system CSPRNG (arc4random_buf), so generating an id costs a memcpy
+ rather than a trip into the kernel, and threads never contend for it. Formatting
+ uses a byte-to-hex lookup table and writes into a caller-supplied buffer.
+ 
+ Two kinds of UUID are available:
+ 
+ * version 4, all random (122 bits), the same kind CFUUIDCreate makes. Use
+ these where ids must be unguessable, like OAuth nonces.
+ 
+ * version 7 (RFC 9562): a 48-bit Unix timestamp in milliseconds, followed by
+ a 12-bit counter and 62 random bits. They sort by creation time, both as bytes
+ and as strings, which keeps inserts into an index on them together at the
+ end instead of scattering them. Within a process they are strictly
+ increasing, even for many ids in the same millisecond or if the clock steps
+ back. Their creation time is visible to anyone who sees them.
+ 
+ */
+
+#ifndef LBUUID_h
+#define LBUUID_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LB_UUID_LENGTH 16
+#define LB_UUID_STRING_LENGTH 36
+
+// fills buffer with cryptographically secure random bytes
+void LBRandomBytes(void *buffer, size_t length);
+
+void LBUUIDGenerateRandom(uint8_t uuid[LB_UUID_LENGTH]);
+void LBUUIDGenerateTimeOrdered(uint8_t uuid[LB_UUID_LENGTH]);
+
+// the canonical 8-4-4-4-12 form in upper case, as CFUUIDCreateString gives.
+// writes exactly LB_UUID_STRING_LENGTH chars and no terminating NUL.
+void LBUUIDFormat(const uint8_t uuid[LB_UUID_LENGTH], char string[LB_UUID_STRING_LENGTH]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
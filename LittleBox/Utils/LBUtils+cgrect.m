@@ -17,6 +17,110 @@
  */
 
 #import "LBUtils.h"
+#import "LBRectIndex.h"
+#import "LBTextMeasurementCache.h"
+#import "LBWeakKeyTable.h"
+
+// an LBRectIndex of one scroll view's subview frames. each refresh compares
+// every frame with what's indexed and only touches the index for the ones that
+// moved, so the union of them all never has to be recomputed from scratch.
+@interface LBScrollViewSubviewIndex : NSObject {
+@public
+    LBRectIndex _index;
+    CFMutableDictionaryRef _handles; // subview -> handle + 1, not retained
+    const void **_views; // handle -> subview, not retained
+    size_t _viewsCapacity;
+}
+- (void)refreshWithSubviews:(NSArray *)subviews;
+@end
+
+@implementation LBScrollViewSubviewIndex
+
+- (id)init {
+    if ((self = [super init])) {
+        LBRectIndexInit(&_index, 0);
+        _handles = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    LBRectIndexDestroy(&_index);
+    CFRelease(_handles);
+    free(_views);
+}
+
+- (void)refreshWithSubviews:(NSArray *)subviews {
+    NSUInteger seen = 0;
+    for (UIView *view in subviews) {
+        CGRect frame = CGRectStandardize(view.frame);
+        LBIndexRect rect = LBRectIndexMakeRect(frame.origin.x, frame.origin.y, frame.size.width, frame.size.height);
+        const void *key = (__bridge const void *)view;
+        uintptr_t stored = (uintptr_t)CFDictionaryGetValue(_handles, key);
+        if (stored) {
+            LBIndexRect indexed;
+            LBRectIndexGet(&_index, stored - 1, &indexed);
+            if (indexed.x != rect.x || indexed.y != rect.y || indexed.width != rect.width || indexed.height != rect.height) {
+                LBRectIndexUpdate(&_index, stored - 1, rect);
+            }
+        } else {
+            size_t handle = LBRectIndexInsert(&_index, rect);
+            if (handle == LBRectIndexNoHandle) continue;
+            if (handle >= _viewsCapacity) {
+                size_t capacity = MAX(_viewsCapacity * 2, handle + 1);
+                const void **views = realloc(_views, capacity * sizeof(void *));
+                if (!views) {
+                    // leave this one out, like a failed insert
+                    LBRectIndexRemove(&_index, handle);
+                    continue;
+                }
+                _views = views;
+                _viewsCapacity = capacity;
+            }
+            _views[handle] = key;
+            CFDictionarySetValue(_handles, key, (const void *)(uintptr_t)(handle + 1));
+        }
+        seen++;
+    }
+    // if every indexed view was just seen, none have been removed
+    if (seen == LBRectIndexCount(&_index)) return;
+    CFMutableSetRef current = CFSetCreateMutable(NULL, [subviews count], NULL);
+    for (UIView *view in subviews) {
+        CFSetAddValue(current, (__bridge const void *)view);
+    }
+    CFIndex count = CFDictionaryGetCount(_handles);
+    const void **keys = malloc(count * sizeof(void *));
+    const void **values = malloc(count * sizeof(void *));
+    if (!keys || !values) {
+        // the removed views stay indexed until a refresh that can allocate
+        free(keys);
+        free(values);
+        CFRelease(current);
+        return;
+    }
+    CFDictionaryGetKeysAndValues(_handles, keys, values);
+    for (CFIndex i = 0; i < count; i++) {
+        if (CFSetContainsValue(current, keys[i])) continue;
+        LBRectIndexRemove(&_index, (uintptr_t)values[i] - 1);
+        CFDictionaryRemoveValue(_handles, keys[i]);
+    }
+    free(keys);
+    free(values);
+    CFRelease(current);
+}
+
+@end
+
+typedef struct {
+    const void **views;
+    __unsafe_unretained NSMutableArray *results;
+} LBSubviewQueryContext;
+
+static bool addIntersectingSubview(size_t handle, LBIndexRect rect, void *context) {
+    LBSubviewQueryContext *query = context;
+    [query->results addObject:(__bridge id)query->views[handle]];
+    return true;
+}
 
 @implementation LBUtils(cgrect)
 
@@ -51,7 +155,7 @@
     return CGRectMake(textView.frame.origin.x - 8, // slide up+right to offset the 8px margins
                       textView.frame.origin.y - 8,
                       textView.frame.size.width + 16, // expand 2x margin for proper inner width
-                      [textView sizeThatFits:CGSizeMake(textView.frame.size.width + 16, textView.frame.size.height)].height); // set height to fit
+                      [[LBTextMeasurementCache sharedInstance] sizeOfTextView:textView fittingSize:CGSizeMake(textView.frame.size.width + 16, textView.frame.size.height)].height); // set height to fit
 }
 
 +(void) autoAdjustHeightForUnlimitedLinesUILabel:(UILabel*)label {
@@ -60,7 +164,8 @@
     // note that this does not mean it can't be constrained in size, it will never be resized to exceed the label frame.
     // width is maintained.
     if ([label.text isKindOfClass:[NSString class]]) {
-        label.frame = [self rectFromRect:label.frame newHeight:[label.text sizeWithFont:label.font constrainedToSize:label.frame.size lineBreakMode:label.lineBreakMode].height];
+        CGSize size = [[LBTextMeasurementCache sharedInstance] sizeOfText:label.text font:label.font constrainedToSize:label.frame.size lineBreakMode:label.lineBreakMode];
+        label.frame = [self rectFromRect:label.frame newHeight:size.height];
     }
 }
 
@@ -72,7 +177,8 @@
     if ([label.text isKindOfClass:[NSString class]]) {
         CGSize frameSizeVeryTall = label.frame.size;
         frameSizeVeryTall.height = 9999;
-        label.frame = [self rectFromRect:label.frame newHeight:[label.text sizeWithFont:label.font constrainedToSize:frameSizeVeryTall lineBreakMode:label.lineBreakMode].height];
+        CGSize size = [[LBTextMeasurementCache sharedInstance] sizeOfText:label.text font:label.font constrainedToSize:frameSizeVeryTall lineBreakMode:label.lineBreakMode];
+        label.frame = [self rectFromRect:label.frame newHeight:size.height];
     }
 }
 
@@ -85,12 +191,18 @@
     BOOL showsVerticalScrollIndicator = scrollView.showsVerticalScrollIndicator;
     scrollView.showsHorizontalScrollIndicator = NO;
     scrollView.showsVerticalScrollIndicator = NO;
+    // only the subviews that moved since last time cost anything here
+    LBScrollViewSubviewIndex *index = [self subviewIndexForScrollView:scrollView];
+    scrollView.showsHorizontalScrollIndicator = showsHorizontalScrollIndicator;
+    scrollView.showsVerticalScrollIndicator = showsVerticalScrollIndicator;
     CGRect contentRect = CGRectZero;
     if (ensureScrollable) {
         contentRect = CGRectMake(0, 0, scrollView.frame.size.width, scrollView.frame.size.height);
     }
-    for (UIView* view in scrollView.subviews) {
-        contentRect = CGRectUnion(contentRect, view.frame);
+    // the union of all the subview frames, kept by the index
+    LBIndexRect bounds;
+    if (LBRectIndexBounds(&index->_index, &bounds)) {
+        contentRect = CGRectUnion(contentRect, CGRectMake(bounds.x, bounds.y, bounds.width, bounds.height));
     }
     if (ensureScrollable && contentRect.size.height <= (scrollView.frame.size.height + 0.1)) {
         contentRect = CGRectMake(contentRect.origin.x,
@@ -99,8 +211,30 @@
                                  contentRect.size.height + 10.0f); // with 1.0 instead of 10.0 as the extra padding, the scroll indicators don't show when you scroll/bounce the scrollview.
     }
     scrollView.contentSize = contentRect.size;
-    scrollView.showsHorizontalScrollIndicator = showsHorizontalScrollIndicator;
-    scrollView.showsVerticalScrollIndicator = showsVerticalScrollIndicator;
+}
+
++(NSArray*) subviewsOfScrollView:(UIScrollView*)scrollView intersectingRect:(CGRect)rect {
+    if (!scrollView) return nil;
+    LBScrollViewSubviewIndex *index = [self subviewIndexForScrollView:scrollView];
+    NSMutableArray *results = [NSMutableArray array];
+    LBSubviewQueryContext context = { index->_views, results };
+    CGRect area = CGRectStandardize(rect);
+    LBRectIndexQuery(&index->_index, LBRectIndexMakeRect(area.origin.x, area.origin.y, area.size.width, area.size.height), addIntersectingSubview, &context);
+    return results;
+}
+
++(LBScrollViewSubviewIndex*) subviewIndexForScrollView:(UIScrollView*)scrollView {
+    // one index per scroll view, for as long as it lives. main thread only,
+    // like the views themselves.
+    static LBWeakKeyTable *indexes = nil;
+    if (!indexes) indexes = [LBWeakKeyTable table];
+    LBScrollViewSubviewIndex *index = [indexes objectForKey:scrollView];
+    if (!index) {
+        index = [[LBScrollViewSubviewIndex alloc] init];
+        [indexes setObject:index forKey:scrollView];
+    }
+    [index refreshWithSubviews:scrollView.subviews];
+    return index;
 }
 
 @end
@@ -18,29 +18,79 @@
 
 #import "LBLog.h"
 #import "LBUtils.h"
+#import <mach/mach_time.h>
+
+// per-thread caches of date formatters and the current calendar, see
+// cachedDateFormatterWithFormat:locale:timeZone:. each thread's cache is thrown
+// away the next time it's used after the locale or time zone changes.
+static NSString * const LBDateCacheKey = @"LBUtilsDateCache";
+static NSString * const LBDateCacheGenerationKey = @"LBUtilsDateCacheGeneration";
+static NSString * const LBDateCacheCalendarKey = @"LBUtilsDateCacheCalendar";
+static volatile int32_t _dateCacheGeneration = 0;
 
 @implementation LBUtils(date)
 
++ (NSMutableDictionary *)threadDateCache {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        void (^invalidate)(NSNotification *) = ^(NSNotification *note) {
+            __atomic_add_fetch(&_dateCacheGeneration, 1, __ATOMIC_RELEASE);
+        };
+        NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+        [center addObserverForName:NSCurrentLocaleDidChangeNotification object:nil queue:nil usingBlock:invalidate];
+        [center addObserverForName:NSSystemTimeZoneDidChangeNotification object:nil queue:nil usingBlock:invalidate];
+    });
+    int32_t generation = __atomic_load_n(&_dateCacheGeneration, __ATOMIC_ACQUIRE);
+    NSMutableDictionary *threadDictionary = [[NSThread currentThread] threadDictionary];
+    NSMutableDictionary *cache = [threadDictionary objectForKey:LBDateCacheKey];
+    if (!cache || [[threadDictionary objectForKey:LBDateCacheGenerationKey] intValue] != generation) {
+        cache = [NSMutableDictionary dictionary];
+        [threadDictionary setObject:cache forKey:LBDateCacheKey];
+        [threadDictionary setObject:[NSNumber numberWithInt:generation] forKey:LBDateCacheGenerationKey];
+    }
+    return cache;
+}
+
++ (NSCalendar *)cachedCurrentCalendar {
+    NSMutableDictionary *cache = [self threadDateCache];
+    NSCalendar *calendar = [cache objectForKey:LBDateCacheCalendarKey];
+    if (!calendar) {
+        calendar = [[NSCalendar currentCalendar] copy];
+        [calendar setTimeZone:[NSTimeZone localTimeZone]];
+        [cache setObject:calendar forKey:LBDateCacheCalendarKey];
+    }
+    return calendar;
+}
+
++ (NSDateFormatter *)cachedDateFormatterWithFormat:(NSString *)format locale:(NSLocale *)locale timeZone:(NSTimeZone *)timeZone {
+    // NSDateFormatter is expensive to create and not safe to share between
+    // threads (before iOS 7), so keep one per thread per configuration.
+    if (!locale) locale = [NSLocale currentLocale];
+    if (!timeZone) timeZone = [NSTimeZone localTimeZone];
+    NSString *key = [NSString stringWithFormat:@"%@|%@|%@", format, [locale localeIdentifier], [timeZone name]];
+    NSMutableDictionary *cache = [self threadDateCache];
+    NSDateFormatter *formatter = [cache objectForKey:key];
+    if (!formatter) {
+        formatter = [[NSDateFormatter alloc] init];
+        [formatter setLocale:locale];
+        [formatter setCalendar:[self cachedCurrentCalendar]];
+        [formatter setTimeZone:timeZone];
+        [formatter setDateFormat:format];
+        [cache setObject:formatter forKey:key];
+    }
+    return formatter;
+}
+
 + (NSString *)compactTimeOnlyStringForDate:(NSDate*)date {
     // optimized for compact display to maximize real estate
     // this should return strings like:
     // 6pm              (if :00 minutes)
     // 6:30pm           (if not :00 minutes)
-    NSDateFormatter *outputFormatter = [[NSDateFormatter alloc] init];
-    [outputFormatter setCalendar:[NSCalendar currentCalendar]];
-    [outputFormatter setTimeZone:[NSTimeZone localTimeZone]];
-    [outputFormatter setDateFormat:@"h"];
-    NSString *hour = [outputFormatter stringFromDate:date];
-    [outputFormatter setDateFormat:@"mm"];
-    NSString *minute = [outputFormatter stringFromDate:date];
-    if ([minute isEqual:@"00"]) {
-        minute = @"";
-    } else {
-        minute = [@":" stringByAppendingString:minute];
-    }
-    [outputFormatter setDateFormat:@"a"];
-    NSString *ampm = [[outputFormatter stringFromDate:date] lowercaseString];
-    return [NSString stringWithFormat:@"%@%@ %@", hour, minute, ampm];
+    NSCalendar *calendar = [self cachedCurrentCalendar];
+    NSDateComponents *components = [calendar components:NSMinuteCalendarUnit fromDate:date];
+    NSString *format = ([components minute] == 0) ? @"h a" : @"h:mm a";
+    NSDateFormatter *formatter = [self cachedDateFormatterWithFormat:format locale:nil timeZone:nil];
+    return [[formatter stringFromDate:date] lowercaseString];
 }
 
 + (NSString *)compactDateOnlyStringForDate:(NSDate*)date {
@@ -52,35 +102,25 @@
     // this should return strings like:
     // Sat Jan 21st
     // Sat Jan 20th
-    NSDateFormatter *outputFormatter = [[NSDateFormatter alloc] init];
-    [outputFormatter setCalendar:[NSCalendar currentCalendar]];
-    [outputFormatter setTimeZone:[NSTimeZone localTimeZone]];
-    [outputFormatter setDateFormat:@"eee"];
-    NSString *dayName = [outputFormatter stringFromDate:date];
-    [outputFormatter setDateFormat:@"MMM"];
-    NSString *month = [outputFormatter stringFromDate:date];
-    [outputFormatter setDateFormat:@"M"];
-    NSString *monthNum = [outputFormatter stringFromDate:date];
-    [outputFormatter setDateFormat:@"dd"]; // day of the month, but strip leading zeros by doing an int conversion and back
-    NSString *dayNum = [NSString stringWithFormat:@"%d",[[outputFormatter stringFromDate:date] intValue]];
-    NSString *daySuffix = @"th";
-    if ([dayNum isEqual:@"10"] || [dayNum isEqual:@"11"] || [dayNum isEqual:@"12"] || [dayNum isEqual:@"13"]) {
-        daySuffix = @"th";
-    } else if ([dayNum rangeOfString:@"1"].location == ([dayNum length]-1)) {
-        daySuffix = @"st";
-    } else if ([dayNum rangeOfString:@"2"].location == ([dayNum length]-1)) {
-        daySuffix = @"nd";
-    } else if ([dayNum rangeOfString:@"3"].location == ([dayNum length]-1)) {
-        daySuffix = @"rd";
-    }
+    NSCalendar *calendar = [self cachedCurrentCalendar];
+    NSDateComponents *components = [calendar components:(NSMonthCalendarUnit | NSDayCalendarUnit) fromDate:date];
+    NSInteger day = [components day];
     // note: omit year because it takes up a lot of real estate and in practice
     // it will be clear enough from the month if the date is for a different
     // year.
     if (tiny) {
-        return [NSString stringWithFormat:@"%@/%@", monthNum, dayNum];
-    } else {
-        return [NSString stringWithFormat:@"%@ %@ %@%@", dayName, month, dayNum, daySuffix];
+        return [NSString stringWithFormat:@"%ld/%ld", (long)[components month], (long)day];
     }
+    NSString *daySuffix = @"th";
+    if (day % 100 < 11 || day % 100 > 13) {
+        switch (day % 10) {
+            case 1: daySuffix = @"st"; break;
+            case 2: daySuffix = @"nd"; break;
+            case 3: daySuffix = @"rd"; break;
+        }
+    }
+    NSDateFormatter *formatter = [self cachedDateFormatterWithFormat:@"eee MMM" locale:nil timeZone:nil];
+    return [NSString stringWithFormat:@"%@ %ld%@", [formatter stringFromDate:date], (long)day, daySuffix];
 }
 
 + (NSString *)compactDateStringForDate:(NSDate*)date {
@@ -107,99 +147,184 @@
     // 3 days
     // ...
     // switches to compactDateOnlyStringForDate if over a month ago
-    double delta = [date timeIntervalSinceNow] * -1;
-    if (delta < 60) {
-        if (tiny) {
-            return @"now";
-        } else {
-            return @"just now";
-        }
+    return [self relativeTimeStringForDate:date sinceDate:[NSDate date] tiny:tiny secondsUntilChange:NULL];
+}
+
++ (NSArray *)relativeTimeStringsForDates:(NSArray *)dates sinceDate:(NSDate *)now tiny:(BOOL)tiny nextChangeDate:(NSDate **)nextChangeDate {
+    if (!now) now = [NSDate date];
+    NSMutableArray *strings = [NSMutableArray arrayWithCapacity:[dates count]];
+    double soonest = INFINITY;
+    for (NSDate *date in dates) {
+        double untilChange = INFINITY;
+        [strings addObject:[self relativeTimeStringForDate:date sinceDate:now tiny:tiny secondsUntilChange:&untilChange]];
+        if (untilChange < soonest) soonest = untilChange;
     }
-    if (delta < 60*60) {
-        int minutes = (int)(delta / 60.0);
-        if (minutes > 1) {
-            if (tiny) {
-                return [NSString stringWithFormat:@"%d mins",minutes];
-            } else {
-                return [NSString stringWithFormat:@"%d mins ago",minutes];
-            }
-        } else {
-            if (tiny) {
-                return @"1 min";
-            } else {
-                return @"1 min ago";
-            }
-        }
+    if (nextChangeDate) {
+        *nextChangeDate = isinf(soonest) ? nil : [now dateByAddingTimeInterval:soonest];
     }
-    if (delta < 60*60*24) {
-        int hours = (int)(delta / (60.0*60.0));
-        if (hours > 1) {
-            if (tiny) {
-                return [NSString stringWithFormat:@"%d hrs",hours];
-            } else {
-                return [NSString stringWithFormat:@"%d hrs ago",hours];
-            }
-        } else {
-            if (tiny) {
-                return @"1hr";
-            } else {
-                return @"1 hr ago";
+    return strings;
+}
+
+// the relative time units, each used while the delta is under its limit. the
+// strings for every count are built once and shared, so formatting a row is a
+// lookup rather than a stringWithFormat.
+typedef struct {
+    double seconds;
+    double limit;
+    // literals, which live forever, so they needn't be retained
+    __unsafe_unretained NSString *singular;
+    __unsafe_unretained NSString *tinySingular;
+    __unsafe_unretained NSString *pluralFormat;
+    __unsafe_unretained NSString *tinyPluralFormat;
+} LBRelativeTimeUnit;
+
+#define LB_RELATIVE_TIME_UNIT_COUNT 4
+
+static LBRelativeTimeUnit _relativeTimeUnits[LB_RELATIVE_TIME_UNIT_COUNT] = {
+    { 60, 60*60, @"1 min ago", @"1 min", @"%d mins ago", @"%d mins" },
+    { 60*60, 60*60*24, @"1 hr ago", @"1hr", @"%d hrs ago", @"%d hrs" },
+    { 60*60*24, 60*60*24*7, @"1 day ago", @"1 day", @"%d days ago", @"%d days" },
+    { 60*60*24*7, 60*60*24*7*4, @"1 wk ago", @"1 wk", @"%d wks ago", @"%d wks" },
+};
+
++ (NSArray *)internedRelativeTimeStringsForUnit:(int)unit tiny:(BOOL)tiny {
+    static NSArray *tables[2][LB_RELATIVE_TIME_UNIT_COUNT];
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        for (int t = 0; t < 2; t++) {
+            for (int u = 0; u < LB_RELATIVE_TIME_UNIT_COUNT; u++) {
+                LBRelativeTimeUnit spec = _relativeTimeUnits[u];
+                int maxCount = (int)(spec.limit / spec.seconds);
+                NSMutableArray *strings = [NSMutableArray arrayWithCapacity:maxCount + 1];
+                [strings addObject:@""]; // no zero count
+                [strings addObject:(t ? spec.tinySingular : spec.singular)];
+                for (int count = 2; count <= maxCount; count++) {
+                    [strings addObject:[NSString stringWithFormat:(t ? spec.tinyPluralFormat : spec.pluralFormat), count]];
+                }
+                tables[t][u] = [strings copy];
             }
         }
+    });
+    return tables[tiny ? 1 : 0][unit];
+}
+
++ (NSString *)relativeTimeStringForDate:(NSDate *)date sinceDate:(NSDate *)now tiny:(BOOL)tiny secondsUntilChange:(double *)secondsUntilChange {
+    // callers pass nil for a missing timestamp, which has always read as just
+    // now (and stays that way)
+    if (!date) {
+        if (secondsUntilChange) *secondsUntilChange = INFINITY;
+        return tiny ? @"now" : @"just now";
     }
-    if (delta < 60*60*24*7) {
-        int days = (int)(delta / (60.0*60.0*24));
-        if (days > 1) {
-            if (tiny) {
-                return [NSString stringWithFormat:@"%d days",days];
-            } else {
-                return [NSString stringWithFormat:@"%d days ago",days];
-            }
+    double delta = [now timeIntervalSinceDate:date];
+    if (delta < 60) {
+        if (secondsUntilChange) *secondsUntilChange = 60 - delta;
+        if (tiny) {
+            return @"now";
         } else {
-            if (tiny) {
-                return @"1 day";
-            } else {
-                return @"1 day ago";
-            }
+            return @"just now";
         }
     }
-    if (delta < 60*60*24*7*4) {
-        int weeks = (int)(delta / (60.0*60.0*24*7));
-        if (weeks > 1) {
-            if (tiny) {
-                return [NSString stringWithFormat:@"%d wks",weeks];
-            } else {
-                return [NSString stringWithFormat:@"%d wks ago",weeks];
-            }
-        } else {
-            if (tiny) {
-                return @"1 wk";
-            } else {
-                return @"1 wk ago";
-            }
+    for (int unit = 0; unit < LB_RELATIVE_TIME_UNIT_COUNT; unit++) {
+        LBRelativeTimeUnit spec = _relativeTimeUnits[unit];
+        if (delta < spec.limit) {
+            int count = (int)(delta / spec.seconds);
+            // the string next changes when the count ticks over
+            if (secondsUntilChange) *secondsUntilChange = (count + 1) * spec.seconds - delta;
+            return [[self internedRelativeTimeStringsForUnit:unit tiny:tiny] objectAtIndex:count];
         }
     }
-    // if over a month ago, return the compact date (but without time of day)
+    // if over a month ago, return the compact date (but without time of day),
+    // which never changes.
+    if (secondsUntilChange) *secondsUntilChange = INFINITY;
     return [self compactDateOnlyStringForDate:date tiny:tiny];
 }
 
 + (NSDate *)dateFromEpochMillisecondsNSNumber:(NSNumber*)epoch_ms {
-    // yikes. isn't there a better way? problem is that dividing by 1000 with
-    // normal (objective-)c numbers produces rounding inaccuracies that result
-    // in dates like 5:59PM when it should be 6:00PM. for instance:
-    // 1297994400000 / 1000.0 -> 1297994350.592
-    return [NSDate dateWithTimeIntervalSince1970:
-            [[[NSDecimalNumber decimalNumberWithDecimal:[epoch_ms decimalValue]]
-              decimalNumberByDividingBy:(NSDecimalNumber*)[NSDecimalNumber numberWithInt:1000]] doubleValue]];
+    // millis are integers on the wire, so convert them as integers; going via
+    // float (or worse, a float NSNumber) is how you get 5:59PM instead of
+    // 6:00PM. a float number that comes in anyway is taken as it is.
+    // nil (e.g. a missing JSON field) gives 1970, as it always has.
+    if (!epoch_ms) return [NSDate dateWithTimeIntervalSince1970:0];
+    if ([epoch_ms isKindOfClass:[NSNumber class]] && CFNumberIsFloatType((__bridge CFNumberRef)epoch_ms)) {
+        return [NSDate dateWithTimeIntervalSince1970:[epoch_ms doubleValue] / 1000.0];
+    }
+    return [NSDate dateWithTimeIntervalSince1970:LBTimestampSecondsFromMillis([epoch_ms longLongValue])];
 }
 
 + (NSNumber *)epochMillisFromDate:(NSDate *)date {
-    NSNumber *epochMillis = [NSNumber numberWithDouble:([date timeIntervalSince1970] * 1000)];
-    NSNumberFormatter *formatter = [[NSNumberFormatter alloc] init];
-    [formatter setRoundingMode:NSNumberFormatterRoundHalfUp];
-    [formatter setMaximumFractionDigits:0];
-    NSNumber *rounded = [formatter numberFromString:[formatter stringFromNumber:epochMillis]];
-    return rounded;
+    return [NSNumber numberWithLongLong:LBTimestampMillisFromSeconds([date timeIntervalSince1970])];
+}
+
++ (NSArray *)datesFromEpochMillis:(const int64_t *)millis count:(NSUInteger)count {
+    if (count == 0) return [NSArray array];
+    double *seconds = malloc(count * sizeof(double));
+    if (!seconds) return nil;
+    LBTimestampSecondsFromMillisBulk(millis, seconds, count);
+    NSMutableArray *dates = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [dates addObject:[NSDate dateWithTimeIntervalSince1970:seconds[i]]];
+    }
+    free(seconds);
+    return dates;
+}
+
++ (NSDate *)dateFromISO8601Bytes:(const char *)bytes length:(NSUInteger)length {
+    double seconds;
+    if (!bytes || !LBTimestampParseISO8601(bytes, length, &seconds)) return nil;
+    return [NSDate dateWithTimeIntervalSince1970:seconds];
+}
+
++ (NSDate *)dateFromISO8601String:(NSString *)string {
+    if (!string) return nil;
+    // copy the chars out onto the stack rather than asking for a UTF8String.
+    // a valid timestamp is all ASCII, so a short conversion means invalid.
+    CFStringRef cfString = (__bridge CFStringRef)string;
+    CFIndex length = CFStringGetLength(cfString);
+    char buffer[64];
+    if (length > (CFIndex)sizeof(buffer)) {
+        // only possible with a silly number of fraction digits
+        const char *utf8 = [string UTF8String];
+        return [self dateFromISO8601Bytes:utf8 length:(utf8 ? strlen(utf8) : 0)];
+    }
+    CFIndex used = 0;
+    CFIndex converted = CFStringGetBytes(cfString, CFRangeMake(0, length), kCFStringEncodingASCII, 0, false, (UInt8 *)buffer, sizeof(buffer), &used);
+    if (converted != length) return nil;
+    return [self dateFromISO8601Bytes:buffer length:(NSUInteger)used];
+}
+
++ (NSArray *)datesFromISO8601Strings:(NSArray *)strings {
+    NSMutableArray *dates = [NSMutableArray arrayWithCapacity:[strings count]];
+    for (id string in strings) {
+        NSDate *date = [string isKindOfClass:[NSString class]] ? [self dateFromISO8601String:string] : nil;
+        [dates addObject:(date ? date : [NSNull null])];
+    }
+    return dates;
+}
+
++ (NSString *)ISO8601StringFromDate:(NSDate *)date {
+    return [self ISO8601StringFromDate:date fractionDigits:3 timeZone:nil];
+}
+
++ (NSString *)ISO8601StringFromDate:(NSDate *)date fractionDigits:(NSUInteger)fractionDigits timeZone:(NSTimeZone *)timeZone {
+    if (!date) return nil;
+    // nil means UTC here, not the local time zone: these are for the wire.
+    int offsetMinutes = timeZone ? (int)([timeZone secondsFromGMTForDate:date] / 60) : 0;
+    char buffer[LBTimestampISO8601MaxLength];
+    size_t length = LBTimestampFormatISO8601([date timeIntervalSince1970], (int)MIN(fractionDigits, (NSUInteger)9), offsetMinutes, buffer);
+    if (length == 0) return nil;
+    return [[NSString alloc] initWithBytes:buffer length:length encoding:NSASCIIStringEncoding];
+}
+
++ (NSTimeInterval)monotonicTime {
+    // seconds on a clock that never jumps (unlike [NSDate date], which follows
+    // wall clock changes). only meaningful for measuring intervals.
+    static double secondsPerTick = 0.0;
+    if (secondsPerTick == 0.0) {
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+        secondsPerTick = ((double)timebase.numer / (double)timebase.denom) / NSEC_PER_SEC;
+    }
+    return mach_absolute_time() * secondsPerTick;
 }
 
 @end
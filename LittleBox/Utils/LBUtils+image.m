@@ -17,11 +17,128 @@
  */
 
 #import "LBUtils.h"
+#import "LBImageResample.h"
+#import "LBThumbnailService.h"
+
+// maps a crop rect on the image as displayed back onto its raw pixels
+static LBPixelRect rawCropRect(LBPixelRect crop, UIImageOrientation orientation, size_t rawWidth, size_t rawHeight) {
+    size_t size = crop.width;
+    LBPixelRect raw = crop;
+    switch (orientation) {
+        case UIImageOrientationUp: break;
+        case UIImageOrientationUpMirrored: raw.x = rawWidth - crop.x - size; break;
+        case UIImageOrientationDown: raw.x = rawWidth - crop.x - size; raw.y = rawHeight - crop.y - size; break;
+        case UIImageOrientationDownMirrored: raw.y = rawHeight - crop.y - size; break;
+        case UIImageOrientationLeftMirrored: raw.x = crop.y; raw.y = crop.x; break;
+        case UIImageOrientationRight: raw.x = crop.y; raw.y = rawHeight - crop.x - size; break;
+        case UIImageOrientationRightMirrored: raw.x = rawWidth - crop.y - size; raw.y = rawHeight - crop.x - size; break;
+        case UIImageOrientationLeft: raw.x = rawWidth - crop.y - size; raw.y = crop.x; break;
+    }
+    return raw;
+}
+
+// the image's pixels in a layout LBImageResample takes: 4 bytes per pixel, 8
+// bits per channel, alpha premultiplied or ignored. most decoded JPEGs and
+// PNGs already are, anything else gets drawn once into one that is. note that
+// even the usable ones are copied out whole by CGDataProviderCopyData, as
+// there's no public way to borrow a CGImage's decoded bytes.
+static CFDataRef copyResamplablePixels(CGImageRef image, size_t *bytesPerRow, CGBitmapInfo *bitmapInfo, CGColorSpaceRef *colorSpace) {
+    CGImageAlphaInfo alpha = CGImageGetAlphaInfo(image);
+    BOOL usable = CGImageGetBitsPerComponent(image) == 8 && CGImageGetBitsPerPixel(image) == 32
+        && !(CGImageGetBitmapInfo(image) & kCGBitmapFloatComponents)
+        && CGColorSpaceGetModel(CGImageGetColorSpace(image)) == kCGColorSpaceModelRGB
+        && (alpha == kCGImageAlphaPremultipliedFirst || alpha == kCGImageAlphaPremultipliedLast
+            || alpha == kCGImageAlphaNoneSkipFirst || alpha == kCGImageAlphaNoneSkipLast);
+    if (usable) {
+        CFDataRef data = CGDataProviderCopyData(CGImageGetDataProvider(image));
+        if (data) {
+            *bytesPerRow = CGImageGetBytesPerRow(image);
+            *bitmapInfo = CGImageGetBitmapInfo(image);
+            *colorSpace = CGColorSpaceRetain(CGImageGetColorSpace(image));
+            return data;
+        }
+    }
+    size_t width = CGImageGetWidth(image);
+    size_t height = CGImageGetHeight(image);
+    CFMutableDataRef data = CFDataCreateMutable(NULL, width * height * 4);
+    // NULL sends the caller back to the UIKit path
+    if (!data) return NULL;
+    CFDataSetLength(data, width * height * 4);
+    if (!CFDataGetMutableBytePtr(data)) {
+        CFRelease(data);
+        return NULL;
+    }
+    CGColorSpaceRef deviceRGB = CGColorSpaceCreateDeviceRGB();
+    CGBitmapInfo info = kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little;
+    CGContextRef context = CGBitmapContextCreate(CFDataGetMutableBytePtr(data), width, height, 8, width * 4, deviceRGB, info);
+    if (!context) {
+        CGColorSpaceRelease(deviceRGB);
+        CFRelease(data);
+        return NULL;
+    }
+    CGContextDrawImage(context, CGRectMake(0, 0, width, height), image);
+    CGContextRelease(context);
+    *bytesPerRow = width * 4;
+    *bitmapInfo = info;
+    *colorSpace = deviceRGB;
+    return data;
+}
 
 @implementation LBUtils(image)
 
 + (UIImage*)squareCroppedImageFromImage:(UIImage*)originalImage withSize:(int)dimension {
     if (!originalImage) return nil;
+    CGImageRef image = originalImage.CGImage;
+    if (!image || dimension <= 0) return [self drawnSquareCroppedImageFromImage:originalImage withSize:dimension];
+
+    // crop and resample the raw pixels ourselves (see LBImageResample.h), then
+    // hand back the original orientation. the result is square, so turning it
+    // for display doesn't change its size.
+    size_t rawWidth = CGImageGetWidth(image);
+    size_t rawHeight = CGImageGetHeight(image);
+    UIImageOrientation orientation = originalImage.imageOrientation;
+    BOOL sideways = orientation == UIImageOrientationLeft || orientation == UIImageOrientationRight
+        || orientation == UIImageOrientationLeftMirrored || orientation == UIImageOrientationRightMirrored;
+    LBPixelRect crop = LBImageSquareCropRect(sideways ? rawHeight : rawWidth, sideways ? rawWidth : rawHeight);
+    crop = rawCropRect(crop, orientation, rawWidth, rawHeight);
+
+    size_t bytesPerRow;
+    CGBitmapInfo bitmapInfo;
+    CGColorSpaceRef colorSpace;
+    CFDataRef pixels = copyResamplablePixels(image, &bytesPerRow, &bitmapInfo, &colorSpace);
+    if (!pixels) return [self drawnSquareCroppedImageFromImage:originalImage withSize:dimension];
+
+    // same pixel dimensions the old retina/nonretina drawing context had
+    CGFloat scale = [[UIScreen mainScreen] scale];
+    size_t outputSize = (size_t)(dimension * scale + 0.5);
+    // and opaque like it was: the same byte layout with the alpha byte
+    // ignored. premultiplied color with its alpha ignored is the image
+    // flattened onto black, which is what the opaque drawing gave, and any
+    // filter ringing in the alpha channel can't show.
+    CGImageAlphaInfo alpha = bitmapInfo & kCGBitmapAlphaInfoMask;
+    BOOL alphaFirst = (alpha == kCGImageAlphaPremultipliedFirst || alpha == kCGImageAlphaNoneSkipFirst);
+    CGBitmapInfo outputInfo = (bitmapInfo & kCGBitmapByteOrderMask) | (alphaFirst ? kCGImageAlphaNoneSkipFirst : kCGImageAlphaNoneSkipLast);
+    CGContextRef output = CGBitmapContextCreate(NULL, outputSize, outputSize, 8, outputSize * 4, colorSpace, outputInfo);
+    CGColorSpaceRelease(colorSpace);
+    BOOL resampled = output && LBImageResample(CFDataGetBytePtr(pixels), rawWidth, rawHeight, bytesPerRow, crop,
+                                               CGBitmapContextGetData(output), outputSize, outputSize,
+                                               CGBitmapContextGetBytesPerRow(output), LBResampleLanczos3);
+    CFRelease(pixels);
+    CGImageRef cropped = resampled ? CGBitmapContextCreateImage(output) : NULL;
+    if (output) CGContextRelease(output);
+    if (!cropped) return [self drawnSquareCroppedImageFromImage:originalImage withSize:dimension];
+    UIImage *result = [UIImage imageWithCGImage:cropped scale:scale orientation:orientation];
+    CGImageRelease(cropped);
+    return result;
+}
+
++ (void)squareCroppedImagesFromSources:(NSArray*)sources withSize:(int)dimension completion:(void (^)(NSArray *images))completion {
+    [[LBThumbnailService sharedInstance] thumbnailsForSources:sources dimension:dimension completion:completion];
+}
+
+// the original UIKit drawing version, for images without a CGImage (e.g.
+// CIImage backed ones) or pixels we couldn't get at
++ (UIImage*)drawnSquareCroppedImageFromImage:(UIImage*)originalImage withSize:(int)dimension {
     // YES for opaque, scale 0.0 to use correct pixel dimensions for retina/nonretina
     UIGraphicsBeginImageContextWithOptions(CGSizeMake(dimension, dimension), YES, 0.0);
     CGContextRef currentContext = UIGraphicsGetCurrentContext();
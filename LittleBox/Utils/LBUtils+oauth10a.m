@@ -37,38 +37,54 @@
  */
 
 #import "LBUtils.h"
-#import <CommonCrypto/CommonHMAC.h>
+#import "LBFormURLEncodedBodyStream.h"
+#import "LBHMAC.h"
+#import "LBOAuth1Signer.h"
+#import "LBQueryParameters.h"
 
 @implementation LBUtils(oauth10a)
 
 + (NSDictionary*)queryParamsFromURL:(NSURL*)url {
-    NSArray *parts = [[url absoluteString] componentsSeparatedByString:@"?"];
-    NSDictionary *params = [NSDictionary dictionary];
-    if ([parts count] > 1) {
-        params = [LBUtils dictFromQueryString:[parts objectAtIndex:1]];
-    }
-    return params;
+    // the query alone, without the fragment
+    NSString *query = [url query];
+    if (!query) return [NSDictionary dictionary];
+    // keys as written, values decoded as they're looked up
+    return [[LBQueryParameters parametersWithQueryString:query decodingKeys:NO] lazyDictionary];
 }
 
 + (NSDictionary*)getParamDictFromResponseData:(NSData *)responseData {
     NSDictionary *params = nil;
     if (responseData && [responseData length] > 0) {
-        NSString *responseString = [[NSString alloc] initWithData:responseData encoding:NSUTF8StringEncoding];
-        // assumes this is an x-www-form-urlencoded response, which is parsed just like a querystring
-        params = [LBUtils dictFromQueryString:responseString];
+        // assumes this is an x-www-form-urlencoded response, which is parsed
+        // just like a querystring, straight from the response bytes.
+        params = [[LBQueryParameters parametersWithData:responseData decodingKeys:NO] lazyDictionary];
     }
     return params;
 }
 
 + (void)addPostBodyParams:(NSDictionary*)postBodyParams toRequest:(NSMutableURLRequest*)request {
     NSData *postData = [[LBUtils urlEncodedParamStringForDict:postBodyParams] dataUsingEncoding:NSUTF8StringEncoding];
-    NSString *postLength = [NSString stringWithFormat:@"%d", [postData length]];        
+    NSString *postLength = [NSString stringWithFormat:@"%llu", (unsigned long long)[postData length]];
     [request setHTTPMethod:@"POST"];
     [request setValue:postLength forHTTPHeaderField:@"Content-Length"];
     [request setValue:@"application/x-www-form-urlencoded" forHTTPHeaderField:@"Content-Type"];
     [request setHTTPBody:postData];
 }
 
++ (void)addStreamingPostBodyParams:(NSDictionary*)postBodyParams toRequest:(NSMutableURLRequest*)request {
+    // same body as above, encoded as it's sent, see LBFormURLEncodedBodyStream
+    LBFormURLEncodedBodyStream *stream = [LBFormURLEncodedBodyStream streamWithParams:postBodyParams];
+    if (!stream) {
+        [self addPostBodyParams:postBodyParams toRequest:request];
+        return;
+    }
+    NSString *postLength = [NSString stringWithFormat:@"%llu", stream.contentLength];
+    [request setHTTPMethod:@"POST"];
+    [request setValue:postLength forHTTPHeaderField:@"Content-Length"];
+    [request setValue:@"application/x-www-form-urlencoded" forHTTPHeaderField:@"Content-Type"];
+    [request setHTTPBodyStream:stream];
+}
+
 + (void)addOauth1HeaderToRequest:(NSMutableURLRequest*)request
               withPostBodyParams:(NSDictionary*)postBodyParams
                 oauthConsumerKey:(NSString*)oauthConsumerKey
@@ -78,91 +94,23 @@
            accesstOrRequestToken:(NSString*)accesstOrRequestToken
      accesssOrRequestTokenSecret:(NSString*)accesssOrRequestTokenSecret
 {
-    // modifies an NSMutableURLRequest to add the oauth 1.0 authorization header
-    
-    // build the basic set of oauth params, without the signature
-    NSMutableDictionary *oauthParams = [NSMutableDictionary dictionary];
-    [oauthParams setObject:oauthConsumerKey forKey:@"oauth_consumer_key"];
-    [oauthParams setObject:@"HMAC-SHA1" forKey:@"oauth_signature_method"];
-    [oauthParams setObject:[NSString stringWithFormat:@"%0.0f",[[NSDate date] timeIntervalSince1970]] forKey:@"oauth_timestamp"];
-    [oauthParams setObject:[LBUtils generateGUID] forKey:@"oauth_nonce"];
-    [oauthParams setObject:@"1.0" forKey:@"oauth_version"];
-    if (oauthCallback) {
-        [oauthParams setObject:oauthCallback forKey:@"oauth_callback"];
-    }
-    if (oauthVerifier) {
-        [oauthParams setObject:oauthVerifier forKey:@"oauth_verifier"];
-    }
-    if (accesstOrRequestToken) {
-        [oauthParams setObject:accesstOrRequestToken forKey:@"oauth_token"];
-    }
-    
-    // parse and merge in any querystring or post body params
-    NSMutableDictionary *mergedParams = [NSMutableDictionary dictionaryWithDictionary:oauthParams];
-    NSDictionary *queryParams = [self queryParamsFromURL:[[request URL] absoluteURL]];
-    if (queryParams) [mergedParams addEntriesFromDictionary:queryParams];
-    if (postBodyParams) [mergedParams addEntriesFromDictionary:postBodyParams];
-    
-    // generate signature
-    NSString *baseString = [self signatureBaseStringWithRequest:request params:mergedParams];
-    NSString *signature = [self signClearText:baseString withSecret:[NSString stringWithFormat:@"%@&%@",
-                                                                     [LBUtils URLEncodedStringFromString:oauthConsumerSecret],
-                                                                     [LBUtils URLEncodedStringFromString:(accesssOrRequestTokenSecret ? accesssOrRequestTokenSecret : @"")]]];
-    [oauthParams setObject:signature forKey:@"oauth_signature"];
-    
-    // generate oauth header
-    NSString *tokenPair = @"";
-    NSString *callbackPair = @"";
-    NSString *verifierPair = @"";
-    if ([oauthParams objectForKey:@"oauth_token"] && ![[oauthParams objectForKey:@"oauth_token"] isEqual:@""]) {
-        tokenPair = [NSString stringWithFormat:@"oauth_token=\"%@\", ",[LBUtils URLEncodedStringFromString:[oauthParams objectForKey:@"oauth_token"]]];
-    }
-    if ([oauthParams objectForKey:@"oauth_callback"] && ![[oauthParams objectForKey:@"oauth_callback"] isEqual:@""]) {
-        callbackPair = [NSString stringWithFormat:@"oauth_callback=\"%@\", ",[LBUtils URLEncodedStringFromString:[oauthParams objectForKey:@"oauth_callback"]]];
-    }
-    if ([oauthParams objectForKey:@"oauth_verifier"] && ![[oauthParams objectForKey:@"oauth_verifier"] isEqual:@""]) {
-        verifierPair = [NSString stringWithFormat:@"oauth_verifier=\"%@\", ",[LBUtils URLEncodedStringFromString:[oauthParams objectForKey:@"oauth_verifier"]]];
-    }
-    NSString *oauthHeader = [NSString stringWithFormat:@"OAuth realm=\"\", %@oauth_consumer_key=\"%@\", %@%@oauth_signature_method=\"HMAC-SHA1\", oauth_signature=\"%@\", oauth_timestamp=\"%@\", oauth_nonce=\"%@\", oauth_version=\"%@\"",
-                             callbackPair,
-                             [LBUtils URLEncodedStringFromString:[oauthParams objectForKey:@"oauth_consumer_key"]],
-                             tokenPair,
-                             verifierPair,
-                             [LBUtils URLEncodedStringFromString:[oauthParams objectForKey:@"oauth_signature"]],
-                             [LBUtils URLEncodedStringFromString:[oauthParams objectForKey:@"oauth_timestamp"]],
-                             [LBUtils URLEncodedStringFromString:[oauthParams objectForKey:@"oauth_nonce"]],
-                             [LBUtils URLEncodedStringFromString:[oauthParams objectForKey:@"oauth_version"]]];
-    [request setValue:oauthHeader forHTTPHeaderField:@"Authorization"];
-}
-
-+ (NSString*)signatureBaseStringWithRequest:(NSURLRequest*)request params:(NSDictionary*)params {
-    NSArray *parts = [[[request URL] absoluteString] componentsSeparatedByString:@"?"];
-    NSString *baseURL = [parts objectAtIndex:0];
-    NSMutableArray *parameterPairs = [NSMutableArray array];
-    NSEnumerator *e = [params keyEnumerator];
-    NSString *key = nil;
-    while (key = [e nextObject]) {
-        [parameterPairs addObject:[NSString stringWithFormat:@"%@=%@",
-                                   [LBUtils URLEncodedStringFromString:key],
-                                   [LBUtils URLEncodedStringFromString:[params objectForKey:key]]]];
-    }    
-    NSArray *sortedPairs = [parameterPairs sortedArrayUsingSelector:@selector(compare:)];
-    NSString *normalizedRequestParameters = [sortedPairs componentsJoinedByString:@"&"];
-    NSString *ret = [NSString stringWithFormat:@"%@&%@&%@",
-					 [request HTTPMethod],
-					 [LBUtils URLEncodedStringFromString:baseURL],
-                     [LBUtils URLEncodedStringFromString:normalizedRequestParameters]
-					 ];
-	return ret;
+    // modifies an NSMutableURLRequest to add the oauth 1.0 authorization header.
+    // a throwaway signer, see LBOAuth1Signer if you sign a lot with the same
+    // credentials.
+    LBOAuth1Signer *signer = [[LBOAuth1Signer alloc] initWithConsumerKey:oauthConsumerKey
+                                                           consumerSecret:oauthConsumerSecret
+                                                                    token:accesstOrRequestToken
+                                                              tokenSecret:accesssOrRequestTokenSecret];
+    [signer signRequest:request withPostBodyParams:postBodyParams callback:oauthCallback verifier:oauthVerifier];
 }
 
 + (NSString *)signClearText:(NSString *)text withSecret:(NSString *)secret 
 {
     NSData *secretData = [secret dataUsingEncoding:NSUTF8StringEncoding];
     NSData *clearTextData = [text dataUsingEncoding:NSUTF8StringEncoding];
-    unsigned char result[20];
-	CCHmac(kCCHmacAlgSHA1, [secretData bytes], [secretData length], [clearTextData bytes], [clearTextData length], result);    
-    return [LBUtils base64forData:[NSData dataWithBytes:result length:20]];
+    uint8_t result[LB_SHA1_DIGEST_LENGTH];
+    LBHMAC(LBHashSHA1, [secretData bytes], [secretData length], [clearTextData bytes], [clearTextData length], result);
+    return [LBUtils base64forData:[NSData dataWithBytes:result length:sizeof(result)]];
 }
 
 @end
@@ -17,104 +17,165 @@
  */
 
 #import "LBUtils.h"
+#import "LBPercentEncoding.h"
+#import "LBQueryParameters.h"
+#import "LBStringBytes.h"
+#import "LBUUID.h"
 
 @implementation LBUtils(string)
 
+// GUIDs are UUID strings in the same upper case format CFUUIDCreateString
+// gives, see LBUUID.h. the plain ones are random (version 4), the time ordered
+// ones (version 7) sort by when they were made.
 + (NSString *)generateGUID {
-    CFUUIDRef uuid = CFUUIDCreate(kCFAllocatorDefault);
-    NSString *uuidString = (NSString *)CFBridgingRelease(CFUUIDCreateString(kCFAllocatorDefault, uuid));
-    CFRelease(uuid);
-    return uuidString;
+    uint8_t uuid[LB_UUID_LENGTH];
+    char string[LB_UUID_STRING_LENGTH];
+    LBUUIDGenerateRandom(uuid);
+    LBUUIDFormat(uuid, string);
+    return [[NSString alloc] initWithBytes:string length:LB_UUID_STRING_LENGTH encoding:NSASCIIStringEncoding];
+}
+
++ (NSString *)generateTimeOrderedGUID {
+    uint8_t uuid[LB_UUID_LENGTH];
+    char string[LB_UUID_STRING_LENGTH];
+    LBUUIDGenerateTimeOrdered(uuid);
+    LBUUIDFormat(uuid, string);
+    return [[NSString alloc] initWithBytes:string length:LB_UUID_STRING_LENGTH encoding:NSASCIIStringEncoding];
+}
+
++ (NSData *)generateGUIDBytes {
+    uint8_t uuid[LB_UUID_LENGTH];
+    LBUUIDGenerateRandom(uuid);
+    return [NSData dataWithBytes:uuid length:LB_UUID_LENGTH];
+}
+
++ (NSData *)generateTimeOrderedGUIDBytes {
+    uint8_t uuid[LB_UUID_LENGTH];
+    LBUUIDGenerateTimeOrdered(uuid);
+    return [NSData dataWithBytes:uuid length:LB_UUID_LENGTH];
 }
 
 + (NSString*)URLDecodedStringFromString:(NSString*)string {
     if (!string) return nil;
-    NSMutableString *newString = [NSMutableString stringWithString:string];
-    [newString replaceOccurrencesOfString:@"+" withString:@" " options:NSLiteralSearch range:NSMakeRange(0, [newString length])];
-    return [newString stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+    size_t length;
+    const char *bytes = LBUTF8BytesOfString(string, &length);
+    if (!LBPercentNeedsDecoding(bytes, length, true)) return [string copy];
+    uint8_t *buffer = malloc(MAX(length, (size_t)1));
+    if (!buffer) return nil;
+    size_t decodedLength = LBPercentDecode(bytes, length, buffer, true);
+    NSString *result = [[NSString alloc] initWithBytesNoCopy:buffer length:decodedLength encoding:NSUTF8StringEncoding freeWhenDone:YES];
+    // as with stringByReplacingPercentEscapesUsingEncoding:, escapes that
+    // don't decode to valid UTF-8 give nil. the buffer is ours again then.
+    if (!result) free(buffer);
+    return result;
 }
 
+// escapes everything but RFC 3986 unreserved characters, see LBPercentEncoding.h
 + (NSString *)URLEncodedStringFromString:(NSString *)string
 {
     if (!string) return nil;
-    NSString *result = (NSString *) CFBridgingRelease(CFURLCreateStringByAddingPercentEscapes(kCFAllocatorDefault, (CFStringRef)string, NULL, CFSTR("\":/?#[]@!$&’()*+,;="), kCFStringEncodingUTF8));
-    return result;
+    size_t length;
+    const char *bytes = LBUTF8BytesOfString(string, &length);
+    size_t encodedLength = LBPercentEncodedLength((const uint8_t *)bytes, length);
+    if (encodedLength == length) return [string copy];
+    char *buffer = malloc(encodedLength);
+    if (!buffer) return nil;
+    LBPercentEncode((const uint8_t *)bytes, length, buffer);
+    return [[NSString alloc] initWithBytesNoCopy:buffer length:encodedLength encoding:NSASCIIStringEncoding freeWhenDone:YES];
 }
 
-// From: http://www.cocoadev.com/index.pl?BaseSixtyFour
+// see LBBase64.h for the encoder and decoder
 + (NSString *)base64forData:(NSData*)theData {
-    if (!theData) return nil;
-    const uint8_t* input = (const uint8_t*)[theData bytes];
-    NSInteger length = [theData length];
-    
-    static char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=";
-    
-    NSMutableData* data = [NSMutableData dataWithLength:((length + 2) / 3) * 4];
-    uint8_t* output = (uint8_t*)data.mutableBytes;
-    
-    NSInteger i;
-    for (i=0; i < length; i += 3) {
-        NSInteger value = 0;
-        NSInteger j;
-        for (j = i; j < (i + 3); j++) {
-            value <<= 8;
-            
-            if (j < length) {
-                value |= (0xFF & input[j]);
-            }
-        }
-        
-        NSInteger theIndex = (i / 3) * 4;
-        output[theIndex + 0] =                    table[(value >> 18) & 0x3F];
-        output[theIndex + 1] =                    table[(value >> 12) & 0x3F];
-        output[theIndex + 2] = (i + 1) < length ? table[(value >> 6)  & 0x3F] : '=';
-        output[theIndex + 3] = (i + 2) < length ? table[(value >> 0)  & 0x3F] : '=';
+    return [self base64StringForData:theData options:LBBase64Standard];
+}
+
++ (NSString *)base64StringForData:(NSData *)data options:(LBBase64Options)options {
+    if (!data) return nil;
+    size_t length = LBBase64EncodedLength([data length], options);
+    char *buffer = malloc(MAX(length, (size_t)1));
+    if (!buffer) return nil;
+    LBBase64Encode((const uint8_t *)[data bytes], [data length], buffer, options);
+    return [[NSString alloc] initWithBytesNoCopy:buffer length:length encoding:NSASCIIStringEncoding freeWhenDone:YES];
+}
+
++ (NSData *)dataFromBase64String:(NSString *)string {
+    return [self dataFromBase64String:string options:LBBase64Standard];
+}
+
++ (NSData *)dataFromBase64String:(NSString *)string options:(LBBase64Options)options {
+    // returns nil if the string isn't valid base64, see LBBase64.h for what's
+    // accepted.
+    if (!string) return nil;
+    NSData *ascii = nil;
+    const char *chars = CFStringGetCStringPtr((__bridge CFStringRef)string, kCFStringEncodingASCII);
+    size_t length = chars ? (size_t)[string length] : 0;
+    if (!chars) {
+        // not stored as ASCII internally, copy it out. anything non-ASCII
+        // can't be base64 anyway.
+        ascii = [string dataUsingEncoding:NSASCIIStringEncoding allowLossyConversion:NO];
+        if (!ascii) return nil;
+        chars = (const char *)[ascii bytes];
+        length = [ascii length];
     }
-    
-    return [[NSString alloc] initWithData:data encoding:NSASCIIStringEncoding];
+    NSMutableData *data = [NSMutableData dataWithLength:LBBase64DecodedMaxLength(length)];
+    size_t decodedLength = 0;
+    if (!LBBase64Decode(chars, length, (uint8_t *)[data mutableBytes], &decodedLength, options)) return nil;
+    [data setLength:decodedLength];
+    return data;
 }
 
 + (NSString *)urlEncodedParamStringForDict:(NSDictionary*)dict {
     if (!dict) return nil;
-    NSMutableString *paramString = [NSMutableString string];
-    NSString *amp = @"";
-    for (id key in [dict allKeys]) {
+    // borrow the UTF-8 bytes of every string key and value up front, so the
+    // output can be sized exactly once and then written pair by pair.
+    NSUInteger count = [dict count];
+    const char **parts = malloc(MAX(count, (NSUInteger)1) * 2 * sizeof(const char *));
+    size_t *lengths = malloc(MAX(count, (NSUInteger)1) * 2 * sizeof(size_t));
+    if (!parts || !lengths) {
+        free(parts);
+        free(lengths);
+        return nil;
+    }
+    NSUInteger partCount = 0;
+    size_t total = 0;
+    for (id key in dict) {
         if ([key isKindOfClass:[NSString class]]) {
             id value = [dict objectForKey:key];
             if ([value isKindOfClass:[NSString class]]) {
-                [paramString appendString:amp];
-                amp = @"&";
-                [paramString appendString:[self URLEncodedStringFromString:(NSString*)key]];
-                [paramString appendString:@"="];
-                [paramString appendString:[self URLEncodedStringFromString:(NSString*)value]];
+                parts[partCount] = LBUTF8BytesOfString(key, &lengths[partCount]);
+                parts[partCount + 1] = LBUTF8BytesOfString(value, &lengths[partCount + 1]);
+                total += LBPercentEncodedLength((const uint8_t *)parts[partCount], lengths[partCount]);
+                total += LBPercentEncodedLength((const uint8_t *)parts[partCount + 1], lengths[partCount + 1]);
+                total += partCount ? 2 : 1; // "=", and "&" between pairs
+                partCount += 2;
             }
         }
     }
-    return (NSString*)paramString;
+    char *buffer = malloc(MAX(total, (size_t)1));
+    if (!buffer) {
+        free(parts);
+        free(lengths);
+        return nil;
+    }
+    char *out = buffer;
+    for (NSUInteger i = 0; i < partCount; i += 2) {
+        if (i) *out++ = '&';
+        out += LBPercentEncode((const uint8_t *)parts[i], lengths[i], out);
+        *out++ = '=';
+        out += LBPercentEncode((const uint8_t *)parts[i + 1], lengths[i + 1], out);
+    }
+    free(parts);
+    free(lengths);
+    return [[NSString alloc] initWithBytesNoCopy:buffer length:total encoding:NSASCIIStringEncoding freeWhenDone:YES];
 }
 
 + (NSMutableDictionary *)dictFromQueryString:(NSString *)queryString {
-    // Parse a set of url-encoded query string parameters into a dictionary
+    // Parse a set of url-encoded query string parameters into a dictionary.
+    // values are decoded, keys are kept as written, and only the first value
+    // of a repeated key is kept; use LBQueryParameters directly to get them
+    // all. mutable, so every value is decoded here.
     if (!queryString) return nil;
-    NSArray *pairs = [queryString componentsSeparatedByString:@"&"];
-    NSMutableDictionary *params = [NSMutableDictionary dictionaryWithCapacity:[pairs count]];
-    for (int i = 0; i < [pairs count]; i++) {
-        NSArray *kvPair = [[pairs objectAtIndex:i] componentsSeparatedByString:@"="];
-        if ([kvPair count] > 0) {
-            NSString *strKey = [kvPair objectAtIndex:0];
-            NSString *strVal = @"";
-            if ([kvPair count] > 1) {
-                strVal = [self URLDecodedStringFromString:(NSString *)[kvPair objectAtIndex:1]];
-            }
-            if (![params objectForKey:strKey]) {
-                if (strKey.length > 0)
-                    [params setObject:strVal forKey:strKey];
-            } else {
-                // ignore dupe keys
-            }
-        }
-    }
-    return params;
+    return [[LBQueryParameters parametersWithQueryString:queryString decodingKeys:NO] dictionary];
 }
 
 + (BOOL)string:(NSString *)string contains:(NSString *)substring {
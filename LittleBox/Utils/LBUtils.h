@@ -35,15 +35,23 @@
  */
 
 #import <Foundation/Foundation.h>
+#import "LBBase64.h"
+#import "LBTimestamp.h"
 
 @interface LBUtils : NSObject
 @end
 
 @interface LBUtils(string)
 + (NSString *)generateGUID;
++ (NSString *)generateTimeOrderedGUID;
++ (NSData *)generateGUIDBytes;
++ (NSData *)generateTimeOrderedGUIDBytes;
 + (NSString *)URLDecodedStringFromString:(NSString*)string;
 + (NSString *)URLEncodedStringFromString:(NSString *)string;
 + (NSString *)base64forData:(NSData*)theData;
++ (NSString *)base64StringForData:(NSData *)data options:(LBBase64Options)options;
++ (NSData *)dataFromBase64String:(NSString *)string;
++ (NSData *)dataFromBase64String:(NSString *)string options:(LBBase64Options)options;
 + (NSString *)urlEncodedParamStringForDict:(NSDictionary*)dict;
 + (NSMutableDictionary *)dictFromQueryString:(NSString *)queryString;
 + (BOOL)string:(NSString *)string contains:(NSString *)substring;
@@ -58,18 +66,48 @@
 + (NSString *)compactDateStringForDate:(NSDate*)date;
 + (NSString *)relativeTimeStringSinceNowForDate:(NSDate*)date;
 + (NSString *)relativeTimeStringSinceNowForDate:(NSDate*)date tiny:(BOOL)tiny;
+// relative time strings for many dates against one shared now (nil for the
+// current time). the strings are interned, so equal outputs are the same
+// object. nextChangeDate, if given, is set to the earliest time any of the
+// strings would read differently, or nil if none ever will; schedule your
+// next refresh for then instead of polling.
++ (NSArray *)relativeTimeStringsForDates:(NSArray *)dates sinceDate:(NSDate *)now tiny:(BOOL)tiny nextChangeDate:(NSDate **)nextChangeDate;
 + (NSDate *)dateFromEpochMillisecondsNSNumber:(NSNumber*)epoch_ms;
 + (NSNumber *)epochMillisFromDate:(NSDate *)date;
+// many at once, e.g. straight out of a parsed feed. see LBTimestamp.h for the
+// C array versions of both directions.
++ (NSArray *)datesFromEpochMillis:(const int64_t *)millis count:(NSUInteger)count;
+// ISO 8601 / RFC 3339 timestamps without NSDateFormatter, see LBTimestamp.h for
+// exactly what's accepted. parsing returns nil for anything invalid; the array
+// version has NSNull in those places. formatting defaults to UTC with
+// milliseconds, e.g. 2013-03-02T18:30:05.123Z.
++ (NSDate *)dateFromISO8601String:(NSString *)string;
++ (NSDate *)dateFromISO8601Bytes:(const char *)bytes length:(NSUInteger)length;
++ (NSArray *)datesFromISO8601Strings:(NSArray *)strings;
++ (NSString *)ISO8601StringFromDate:(NSDate *)date;
++ (NSString *)ISO8601StringFromDate:(NSDate *)date fractionDigits:(NSUInteger)fractionDigits timeZone:(NSTimeZone *)timeZone;
++ (NSTimeInterval)monotonicTime;
+// a formatter from a per-thread cache, so it's cheap to call for every table
+// cell. nil means the current locale / local time zone. don't change the
+// formatter you get back, it's shared with every other caller on the thread.
++ (NSDateFormatter *)cachedDateFormatterWithFormat:(NSString *)format locale:(NSLocale *)locale timeZone:(NSTimeZone *)timeZone;
 @end
 
 @interface LBUtils(image)
 + (UIImage*)squareCroppedImageFromImage:(UIImage*)originalImage withSize:(int)dimension;
+// many at once, off the main thread and cached, see LBThumbnailService for the
+// kinds of sources and for tuning. the images come back in the same order, with
+// NSNull for any that failed, on the main thread.
++ (void)squareCroppedImagesFromSources:(NSArray*)sources withSize:(int)dimension completion:(void (^)(NSArray *images))completion;
 @end
 
 @interface LBUtils(oauth10a)
 + (NSDictionary*)queryParamsFromURL:(NSURL*)url;
 + (NSDictionary*)getParamDictFromResponseData:(NSData *)responseData;
 + (void)addPostBodyParams:(NSDictionary*)postBodyParams toRequest:(NSMutableURLRequest*)request;
+// for big bodies: streams the encoded params instead of building them in
+// memory. sign with the same dictionary either way.
++ (void)addStreamingPostBodyParams:(NSDictionary*)postBodyParams toRequest:(NSMutableURLRequest*)request;
 + (void)addOauth1HeaderToRequest:(NSMutableURLRequest*)request
               withPostBodyParams:(NSDictionary*)postBodyParams
                 oauthConsumerKey:(NSString*)oauthConsumerKey
@@ -91,4 +129,9 @@
 + (void)autoAdjustHeightForUnlimitedLinesUILabel:(UILabel*)label;
 + (void)autoAdjustHeightForUnlimitedLinesUILabelUnlimitedHeight:(UILabel*)label;
 + (void)setCorrectContentSizeOnScrollView:(UIScrollView*)scrollView ensureScrollable:(BOOL)ensureScrollable;
+// the subviews whose frames overlap or touch rect (e.g. the visible bounds),
+// from the same per scroll view index setCorrectContentSizeOnScrollView keeps
+// (see LBRectIndex.h). not in subview order. this doesn't touch the scroll
+// indicators, so UIKit's indicator image views are included while showing.
++ (NSArray*)subviewsOfScrollView:(UIScrollView*)scrollView intersectingRect:(CGRect)rect;
 @end
@@ -0,0 +1,67 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+/*
+ 
+ A hash table with zeroing weak keys and strong values, for keeping track of
+ observers, delegates and the like by identity without retaining them. It's what
+ LBBaseMultiDelegateSingleton stores its delegates in.
+ 
+ Keys are compared by identity (==), never with isEqual:. Each key is hashed on
+ its address, captured when it's inserted, so lookups never message the key.
+ The table uses open addressing (linear probing) over flat arrays, so a lookup
+ is typically one or two slot reads rather than the linear scan you'd need to
+ find an object by identity in an NSDictionary of LBZeroingWeakContainers.
+ 
+ When a key is deallocated its weak reference zeroes and the entry is dead: it
+ no longer shows up in lookups or enumeration. Dead entries are reclaimed (and
+ their values released) incrementally, a few slots per mutation and whenever a
+ probe runs across one, so there is no long pause to clean up after many
+ observers go away at once. -compact reclaims everything immediately. Note that
+ because of this, -count may include dead entries that haven't been reclaimed
+ yet.
+ 
+ LBWeakKeyTable is not thread-safe; synchronize access yourself if you need to.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+@interface LBWeakKeyTable : NSObject
+
++ (LBWeakKeyTable *)table;
+- (id)initWithCapacity:(NSUInteger)capacity;
+
+- (id)objectForKey:(id)key;
+- (void)setObject:(id)object forKey:(id)key; // object must not be nil
+- (void)removeObjectForKey:(id)key;
+- (void)removeAllObjects;
+
+// number of entries, possibly including some dead ones, see above
+- (NSUInteger)count;
+
+// the live keys, retained in the returned array
+- (NSArray *)allKeys;
+
+// enumerates only live entries. don't mutate the table while enumerating.
+- (void)enumerateKeysAndObjectsUsingBlock:(void (^)(id key, id object, BOOL *stop))block;
+
+// reclaims all dead entries now, and shrinks the table if it's mostly empty
+- (void)compact;
+
+@end
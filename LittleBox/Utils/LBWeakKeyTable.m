@@ -0,0 +1,251 @@
+/*
+ 
+ Copyright 2013 Klout
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ 
+ */
+
+#import "LBWeakKeyTable.h"
+
+// slot states kept in _addresses. no object lives at address 0 or 1, so any
+// other value is the address a key had when it was inserted.
+#define LB_SLOT_EMPTY ((uintptr_t)0)
+#define LB_SLOT_TOMBSTONE ((uintptr_t)1)
+
+#define LB_MIN_CAPACITY 8
+// how many slots each mutation sweeps for dead entries
+#define LB_SWEEP_SLOTS 2
+
+@interface LBWeakKeyTable () {
+    // three parallel arrays of _capacity slots. _keys and _values are plain
+    // C arrays of ownership-qualified pointers, so every slot has to be set to
+    // nil before the memory is freed to keep ARC's books straight.
+    uintptr_t *_addresses;
+    __weak id *_keys;
+    __strong id *_values;
+    NSUInteger _capacity; // always a power of two
+    NSUInteger _count; // entries that aren't empty or tombstones
+    NSUInteger _tombstones;
+    NSUInteger _sweepCursor;
+}
+@end
+
+static NSUInteger LBSlotForAddress(uintptr_t address, NSUInteger capacity) {
+    // objects are 16-byte aligned, so the low bits carry nothing. fibonacci
+    // hashing spreads the rest over the table.
+    uint64_t hash = ((uint64_t)address >> 4) * 0x9E3779B97F4A7C15ULL;
+    return (NSUInteger)(hash >> 32) & (capacity - 1);
+}
+
+@implementation LBWeakKeyTable
+
++ (LBWeakKeyTable *)table {
+    return [[LBWeakKeyTable alloc] init];
+}
+
+- (id)init {
+    return [self initWithCapacity:0];
+}
+
+- (id)initWithCapacity:(NSUInteger)capacity {
+    if ((self = [super init])) {
+        [self allocateSlots:[self capacityForCount:capacity]];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self freeSlots];
+}
+
+#pragma mark storage
+
+- (NSUInteger)capacityForCount:(NSUInteger)count {
+    // keep the load (including tombstones) under 3/4
+    NSUInteger capacity = LB_MIN_CAPACITY;
+    while (capacity * 3 / 4 <= count) capacity *= 2;
+    return capacity;
+}
+
+- (void)allocateSlots:(NSUInteger)capacity {
+    _capacity = capacity;
+    _addresses = calloc(capacity, sizeof(uintptr_t));
+    _keys = (__weak id *)calloc(capacity, sizeof(id));
+    _values = (__strong id *)calloc(capacity, sizeof(id));
+    _count = 0;
+    _tombstones = 0;
+    _sweepCursor = 0;
+}
+
+- (void)freeSlots {
+    for (NSUInteger i = 0; i < _capacity; i++) {
+        _keys[i] = nil;
+        _values[i] = nil;
+    }
+    free(_addresses);
+    free(_keys);
+    free(_values);
+    _addresses = NULL;
+    _keys = NULL;
+    _values = NULL;
+    _capacity = 0;
+}
+
+- (void)rehashToCapacity:(NSUInteger)capacity {
+    uintptr_t *oldAddresses = _addresses;
+    __weak id *oldKeys = _keys;
+    __strong id *oldValues = _values;
+    NSUInteger oldCapacity = _capacity;
+    [self allocateSlots:capacity];
+    for (NSUInteger i = 0; i < oldCapacity; i++) {
+        if (oldAddresses[i] > LB_SLOT_TOMBSTONE) {
+            id key = oldKeys[i];
+            // dead entries simply don't make the trip
+            if (key) [self insertKey:key address:oldAddresses[i] object:oldValues[i]];
+        }
+        oldKeys[i] = nil;
+        oldValues[i] = nil;
+    }
+    free(oldAddresses);
+    free(oldKeys);
+    free(oldValues);
+}
+
+// places an entry known not to be present, into a table with room for it.
+- (void)insertKey:(id)key address:(uintptr_t)address object:(id)object {
+    NSUInteger mask = _capacity - 1;
+    NSUInteger i = LBSlotForAddress(address, _capacity);
+    while (_addresses[i] > LB_SLOT_TOMBSTONE) i = (i + 1) & mask;
+    if (_addresses[i] == LB_SLOT_TOMBSTONE) _tombstones--;
+    _addresses[i] = address;
+    _keys[i] = key;
+    _values[i] = object;
+    _count++;
+}
+
+- (void)clearSlot:(NSUInteger)i {
+    _addresses[i] = LB_SLOT_TOMBSTONE;
+    _keys[i] = nil;
+    _values[i] = nil;
+    _count--;
+    _tombstones++;
+}
+
+// the slot holding key, or NSNotFound. reclaims any dead entries with the same
+// address it comes across, since a new object may now live at that address.
+- (NSUInteger)findKey:(id)key {
+    uintptr_t address = (uintptr_t)key;
+    NSUInteger mask = _capacity - 1;
+    NSUInteger i = LBSlotForAddress(address, _capacity);
+    for (NSUInteger probes = 0; probes < _capacity && _addresses[i] != LB_SLOT_EMPTY; probes++) {
+        if (_addresses[i] == address) {
+            id existing = _keys[i];
+            if (existing == key) return i;
+            if (!existing) [self clearSlot:i];
+        }
+        i = (i + 1) & mask;
+    }
+    return NSNotFound;
+}
+
+- (void)sweep {
+    for (NSUInteger n = 0; n < LB_SWEEP_SLOTS && _count; n++) {
+        NSUInteger i = _sweepCursor;
+        _sweepCursor = (_sweepCursor + 1) & (_capacity - 1);
+        if (_addresses[i] > LB_SLOT_TOMBSTONE && !_keys[i]) [self clearSlot:i];
+    }
+}
+
+#pragma mark public
+
+- (id)objectForKey:(id)key {
+    if (!key) return nil;
+    NSUInteger i = [self findKey:key];
+    return i == NSNotFound ? nil : _values[i];
+}
+
+- (void)setObject:(id)object forKey:(id)key {
+    if (!key) return;
+    if (!object) {
+        [self removeObjectForKey:key];
+        return;
+    }
+    [self sweep];
+    NSUInteger i = [self findKey:key];
+    if (i != NSNotFound) {
+        _values[i] = object;
+        return;
+    }
+    if ((_count + _tombstones + 1) * 4 > _capacity * 3) {
+        // full of tombstones: rebuild at the same size. full of entries: grow.
+        [self rebuildKeepingCapacity:YES];
+        if ((_count + 1) * 4 > _capacity * 3) [self rehashToCapacity:_capacity * 2];
+    }
+    [self insertKey:key address:(uintptr_t)key object:object];
+}
+
+- (void)removeObjectForKey:(id)key {
+    if (!key) return;
+    [self sweep];
+    NSUInteger i = [self findKey:key];
+    if (i != NSNotFound) [self clearSlot:i];
+}
+
+- (void)removeAllObjects {
+    [self freeSlots];
+    [self allocateSlots:LB_MIN_CAPACITY];
+}
+
+- (NSUInteger)count {
+    return _count;
+}
+
+- (NSArray *)allKeys {
+    NSMutableArray *keys = [NSMutableArray arrayWithCapacity:_count];
+    for (NSUInteger i = 0; i < _capacity; i++) {
+        if (_addresses[i] <= LB_SLOT_TOMBSTONE) continue;
+        id key = _keys[i];
+        if (key) [keys addObject:key];
+    }
+    return keys;
+}
+
+- (void)enumerateKeysAndObjectsUsingBlock:(void (^)(id key, id object, BOOL *stop))block {
+    BOOL stop = NO;
+    for (NSUInteger i = 0; i < _capacity && !stop; i++) {
+        if (_addresses[i] <= LB_SLOT_TOMBSTONE) continue;
+        // hold the key strongly for the duration of the callback
+        id key = _keys[i];
+        if (key) block(key, _values[i], &stop);
+    }
+}
+
+- (void)compact {
+    [self rebuildKeepingCapacity:NO];
+}
+
+- (void)rebuildKeepingCapacity:(BOOL)keepCapacity {
+    NSUInteger live = 0;
+    for (NSUInteger i = 0; i < _capacity; i++) {
+        if (_addresses[i] > LB_SLOT_TOMBSTONE && _keys[i]) live++;
+    }
+    NSUInteger capacity = keepCapacity ? _capacity : MIN(_capacity, [self capacityForCount:live]);
+    [self rehashToCapacity:capacity];
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p; count = %lu; capacity = %lu>", NSStringFromClass([self class]), self, (unsigned long)_count, (unsigned long)_capacity];
+}
+
+@end